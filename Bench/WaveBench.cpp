@@ -0,0 +1,2859 @@
+//
+// WaveBench.cpp
+// Headless driver for the wave solver. Runs Waves::Init/Update/Disturb with
+// the same constants as the demo and reports how long the update takes.
+//
+
+#include "Waves.h"
+#include "WaveBatch.h"
+#include "HalfWaves.h"
+#include "WaveHalf.h"
+#include "StaticWaves.h"
+#include "WaveAllocator.h"
+#include "WaveSimThread.h"
+#include "WaveCheckpoint.h"
+#include "WaveRecording.h"
+#include "WaveProfiler.h"
+#include "WaveHistogram.h"
+#include "StepTimer.h"
+#include "WaveMesh.h"
+#include "WaveVertexCache.h"
+#include "WaveCuller.h"
+#include "ComputeWaves.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Same simulation constants as Game.cpp.
+	const float dx = 0.8f;
+	const float dt = 0.03f;
+	const float speed = 3.25f;
+	const float damping = 0.4f;
+
+	struct Options
+	{
+		size_t Rows = 200;
+		size_t Cols = 200;
+		size_t Steps = 1000;
+		size_t DisturbEvery = 8;
+		size_t Threads = 1;
+		size_t Advance = 0;
+		size_t Grids = 0;
+		bool Half = false;
+		const char* Fill = nullptr;
+		bool Gradients = false;
+		float Sparse = 0.0f;
+		size_t Rain = 0;
+		bool Static = false;
+		WaveHugePages HugePages = WaveHugePages::Off;
+		size_t Async = 0;
+		const char* Checkpoint = nullptr;
+		const char* Record = nullptr;
+		size_t RecordEvery = 1;
+		const char* Profile = nullptr;
+		size_t Lod = 0;
+		size_t Cache = 0;
+		bool Cull = false;
+		bool Compute = false;
+		const char* Kernel = nullptr;
+		bool Verify = false;
+	};
+
+	void PrintUsage()
+	{
+		std::printf(
+			"usage: wave_bench [--size N] [--rows M] [--cols N] [--steps S] [--disturb-every K]\n"
+			"                  [--threads T] [--advance K] [--kernel scalar|sse4|avx2|avx512]\n"
+			"                  [--grids G] [--half] [--fill copy|sink] [--gradients]\n"
+			"                  [--sparse EPS] [--rain N] [--static] [--huge off|thp|explicit]\n"
+			"                  [--async HZ] [--checkpoint FILE] [--record FILE]\n"
+			"                  [--record-every K] [--profile FILE] [--lod P]\n"
+			"                  [--cache N] [--cull] [--compute] [--verify]\n"
+			"  --size N           square grid of N x N vertices (default 200)\n"
+			"  --rows/--cols      grid dimensions\n"
+			"  --steps S          number of solver steps to time (default 1000)\n"
+			"  --disturb-every K  random disturbance every K steps, 0 = never (default 8)\n"
+			"  --threads T        solver threads, 0 = all hardware threads (default 1)\n"
+			"  --advance K        run K steps per Waves::Advance call instead of Update\n"
+			"  --grids G          update G grids of mixed sizes (N, N/2, N/4) as one WaveBatch\n"
+			"  --half             time HalfWaves and report its drift from a float run\n"
+			"  --fill copy|sink   also fill a vertex buffer laid out like the demo's every\n"
+			"                     frame, with a copy loop after the update or through a\n"
+			"                     WaveOutputSink during it\n"
+			"  --gradients        with --fill, also fill the slope arrays, in a second\n"
+			"                     pass (copy) or during the update (sink)\n"
+			"  --sparse EPS       skip tiles whose waves stay below EPS (activity tracking)\n"
+			"  --rain N           queue N small Gaussian impulses every step\n"
+			"  --static           compare StaticWaves with Waves at 256, 512 and 1024\n"
+			"  --huge MODE        back the height planes with huge pages: transparent\n"
+			"                     (thp) or from the reserved pool (explicit)\n"
+			"  --async HZ         run the solver flat out on its own thread while a render\n"
+			"                     loop takes the newest snapshot HZ times a second\n"
+			"  --checkpoint FILE  save the final state to FILE and time loading it back\n"
+			"  --record FILE      record every K-th step (--record-every, default 1) to FILE,\n"
+			"                     then time decoding it\n"
+			"  --profile FILE     time every phase of every step (or frame, with --async)\n"
+			"                     with a WaveProfiler, print p50/p95/p99 and write a\n"
+			"                     Chrome trace to FILE\n"
+			"  --lod P            time level-of-detail selection over patches of P x P quads\n"
+			"                     for a camera circling the grid, --steps frames\n"
+			"  --cache N          compare the vertex cache misses (ACMR/ATVR) of the\n"
+			"                     triangle orders for a cache of N vertices\n"
+			"  --cull             time frustum culling of the patches (--lod P, default 32)\n"
+			"                     and writing only the visible ones, --steps frames\n"
+			"  --compute          time the GPU mode's compute shaders run on CPU threads\n"
+			"                     (ComputeWaves, --threads T) against Waves\n"
+			"  --kernel NAME      force a stencil kernel (default: best for this CPU)\n"
+			"  --verify           check the SIMD kernels and the threaded update against\n"
+			"                     the serial scalar path\n");
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& opt)
+	{
+		for (int a = 1; a < argc; ++a)
+		{
+			const char* arg = argv[a];
+			const bool hasValue = a + 1 < argc;
+
+			if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
+			{
+				return false;
+			}
+			else if (std::strcmp(arg, "--size") == 0 && hasValue)
+			{
+				opt.Rows = opt.Cols = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--rows") == 0 && hasValue)
+			{
+				opt.Rows = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--cols") == 0 && hasValue)
+			{
+				opt.Cols = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--steps") == 0 && hasValue)
+			{
+				opt.Steps = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--disturb-every") == 0 && hasValue)
+			{
+				opt.DisturbEvery = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--threads") == 0 && hasValue)
+			{
+				opt.Threads = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--advance") == 0 && hasValue)
+			{
+				opt.Advance = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--grids") == 0 && hasValue)
+			{
+				opt.Grids = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--half") == 0)
+			{
+				opt.Half = true;
+			}
+			else if (std::strcmp(arg, "--fill") == 0 && hasValue)
+			{
+				opt.Fill = argv[++a];
+				if (std::strcmp(opt.Fill, "copy") != 0 && std::strcmp(opt.Fill, "sink") != 0)
+				{
+					std::fprintf(stderr, "--fill takes copy or sink\n");
+					return false;
+				}
+			}
+			else if (std::strcmp(arg, "--gradients") == 0)
+			{
+				opt.Gradients = true;
+			}
+			else if (std::strcmp(arg, "--sparse") == 0 && hasValue)
+			{
+				opt.Sparse = std::strtof(argv[++a], nullptr);
+			}
+			else if (std::strcmp(arg, "--rain") == 0 && hasValue)
+			{
+				opt.Rain = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--static") == 0)
+			{
+				opt.Static = true;
+			}
+			else if (std::strcmp(arg, "--huge") == 0 && hasValue)
+			{
+				const char* mode = argv[++a];
+				if (std::strcmp(mode, "off") == 0)
+				{
+					opt.HugePages = WaveHugePages::Off;
+				}
+				else if (std::strcmp(mode, "thp") == 0)
+				{
+					opt.HugePages = WaveHugePages::Transparent;
+				}
+				else if (std::strcmp(mode, "explicit") == 0)
+				{
+					opt.HugePages = WaveHugePages::Explicit;
+				}
+				else
+				{
+					std::fprintf(stderr, "--huge takes off, thp or explicit\n");
+					return false;
+				}
+			}
+			else if (std::strcmp(arg, "--async") == 0 && hasValue)
+			{
+				opt.Async = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--checkpoint") == 0 && hasValue)
+			{
+				opt.Checkpoint = argv[++a];
+			}
+			else if (std::strcmp(arg, "--record") == 0 && hasValue)
+			{
+				opt.Record = argv[++a];
+			}
+			else if (std::strcmp(arg, "--record-every") == 0 && hasValue)
+			{
+				opt.RecordEvery = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--profile") == 0 && hasValue)
+			{
+				opt.Profile = argv[++a];
+			}
+			else if (std::strcmp(arg, "--lod") == 0 && hasValue)
+			{
+				opt.Lod = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--cache") == 0 && hasValue)
+			{
+				opt.Cache = std::strtoull(argv[++a], nullptr, 10);
+			}
+			else if (std::strcmp(arg, "--cull") == 0)
+			{
+				opt.Cull = true;
+			}
+			else if (std::strcmp(arg, "--compute") == 0)
+			{
+				opt.Compute = true;
+			}
+			else if (std::strcmp(arg, "--kernel") == 0 && hasValue)
+			{
+				opt.Kernel = argv[++a];
+			}
+			else if (std::strcmp(arg, "--verify") == 0)
+			{
+				opt.Verify = true;
+			}
+			else
+			{
+				std::fprintf(stderr, "unknown or incomplete option: %s\n", arg);
+				return false;
+			}
+		}
+
+		// Disturb() touches a plus shaped stencil two cells away from the boundary.
+		return opt.Rows >= 8 && opt.Cols >= 8;
+	}
+
+	// Vertex layout of the demo's CPU path (VertexWave): position, then colour.
+	struct BenchVertex
+	{
+		float Pos[3];
+		float Color[4];
+	};
+
+	const float BenchColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	WaveOutputSink MakeSink(std::vector<BenchVertex>& vertices)
+	{
+		WaveOutputSink sink;
+		sink.Data = vertices.data();
+		sink.Stride = sizeof(BenchVertex);
+		sink.Payload = BenchColor;
+		sink.PayloadSize = sizeof(BenchColor);
+		return sink;
+	}
+
+	// The demo's copy loop before the sink existed.
+	void CopyVertices(const Waves& waves, std::vector<BenchVertex>& vertices)
+	{
+		for (size_t i = 0; i < waves.VertexCount(); ++i)
+		{
+			DirectX::XMFLOAT3 p = waves[int(i)];
+			BenchVertex& v = vertices[i];
+			v.Pos[0] = p.x;
+			v.Pos[1] = p.y;
+			v.Pos[2] = p.z;
+			std::memcpy(v.Color, BenchColor, sizeof(BenchColor));
+		}
+	}
+
+	// Slopes by a separate pass over the heights, as WaveOutputSink defines them.
+	void CopyGradients(const Waves& waves, std::vector<float>& gx, std::vector<float>& gz)
+	{
+		const size_t m = waves.RowCount();
+		const size_t n = waves.ColumnCount();
+		const float dx = waves.SpatialStep();
+
+		for (size_t i = 0; i < m; ++i)
+		{
+			const size_t above = i > 0 ? i - 1 : i;
+			const size_t below = i + 1 < m ? i + 1 : i;
+			const float zScale = (i > 0 && i + 1 < m ? 0.5f : 1.0f) / dx;
+
+			for (size_t j = 0; j < n; ++j)
+			{
+				const size_t left = j > 0 ? j - 1 : j;
+				const size_t right = j + 1 < n ? j + 1 : j;
+				const float xScale = (j > 0 && j + 1 < n ? 0.5f : 1.0f) / dx;
+
+				gx[i*n + j] = (waves.Height(i*n + right) - waves.Height(i*n + left))*xScale;
+				gz[i*n + j] = (waves.Height(above*n + j) - waves.Height(below*n + j))*zScale;
+			}
+		}
+	}
+
+	const WaveKernelIsa AllKernels[] =
+	{
+		WaveKernelIsa::Scalar,
+		WaveKernelIsa::SSE4,
+		WaveKernelIsa::AVX2,
+		WaveKernelIsa::AVX512,
+	};
+
+	bool FindKernel(const char* name, WaveKernelIsa& isa)
+	{
+		for (WaveKernelIsa k : AllKernels)
+		{
+			if (std::strcmp(name, WaveKernelIsaName(k)) == 0)
+			{
+				isa = k;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// True if two grids of the same size hold bit-identical heights, whatever
+	// their row strides.
+	template<typename A, typename B>
+	bool SameHeights(const A& a, const B& b)
+	{
+		for (size_t i = 0; i < a.VertexCount(); ++i)
+		{
+			float x = a.Height(i);
+			float y = b.Height(i);
+			if (std::memcmp(&x, &y, sizeof(float)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Distance between two floats in units in the last place.
+	uint32_t UlpDistance(float a, float b)
+	{
+		int32_t ia, ib;
+		std::memcpy(&ia, &a, sizeof(float));
+		std::memcpy(&ib, &b, sizeof(float));
+
+		// Map the sign-magnitude encoding onto a monotonic integer line.
+		int64_t la = ia < 0 ? int64_t(INT32_MIN) - ia : ia;
+		int64_t lb = ib < 0 ? int64_t(INT32_MIN) - ib : ib;
+		int64_t d = la - lb;
+		return uint32_t(d < 0 ? -d : d);
+	}
+
+	// Applies each available kernel once to the same random planes and compares
+	// every cell with the scalar kernel.  Odd dimensions exercise the tails.
+	bool VerifyKernels(const Options& opt)
+	{
+		const size_t rows = opt.Rows | 1;
+		const size_t cols = opt.Cols | 1;
+		const WaveConstants k = { -0.98f, 1.7f, 0.12f };
+
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+
+		std::vector<float> prev(rows * cols), curr(rows * cols);
+		for (size_t i = 0; i < prev.size(); ++i)
+		{
+			prev[i] = dist(rng);
+			curr[i] = dist(rng);
+		}
+
+		auto apply = [&](WaveRowKernel kernel)
+		{
+			std::vector<float> out = prev;
+			for (size_t i = 1; i < rows - 1; ++i)
+			{
+				kernel(out.data() + i * cols + 1, curr.data() + i * cols + 1, cols, cols - 2, k);
+			}
+			return out;
+		};
+
+		const std::vector<float> reference = apply(GetWaveRowKernel(WaveKernelIsa::Scalar));
+
+		bool ok = true;
+		for (WaveKernelIsa isa : AllKernels)
+		{
+			WaveRowKernel kernel = GetWaveRowKernel(isa);
+			if (!kernel)
+			{
+				std::printf("%-8s not available\n", WaveKernelIsaName(isa));
+				continue;
+			}
+
+			const std::vector<float> result = apply(kernel);
+
+			uint32_t maxUlp = 0;
+			for (size_t i = 0; i < result.size(); ++i)
+			{
+				maxUlp = std::max(maxUlp, UlpDistance(result[i], reference[i]));
+			}
+
+			const bool pass = maxUlp <= WaveKernelUlpTolerance;
+			std::printf("%-8s max %u ulp (tolerance %u)  %s\n",
+				WaveKernelIsaName(isa), maxUlp, WaveKernelUlpTolerance, pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+
+		return ok;
+	}
+
+	// Half kernels: all must round exactly like the scalar one, and the software
+	// conversions must round-trip every finite half.
+	bool VerifyHalfKernels(const Options& opt)
+	{
+		bool ok = true;
+
+		uint32_t badRoundTrips = 0;
+		for (uint32_t h = 0; h < 0x10000; ++h)
+		{
+			bool isNan = (h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0;
+			if (!isNan && FloatToHalf(HalfToFloat(uint16_t(h))) != h)
+			{
+				++badRoundTrips;
+			}
+		}
+		std::printf("half     round trip of all 65536 values: %u mismatches  %s\n", badRoundTrips, badRoundTrips ? "FAILED" : "ok");
+		ok = badRoundTrips == 0;
+
+		const size_t rows = opt.Rows | 1;
+		const size_t cols = opt.Cols | 1;
+		const WaveConstants k = { -0.98f, 1.7f, 0.12f };
+
+		std::mt19937 rng(43);
+		std::uniform_real_distribution<float> dist(-2.0f, 2.0f);
+
+		std::vector<uint16_t> prev(rows * cols), curr(rows * cols);
+		for (size_t i = 0; i < prev.size(); ++i)
+		{
+			// Include tiny values so subnormal results are exercised.
+			float scale = (i % 7 == 0) ? 1e-5f : 1.0f;
+			prev[i] = FloatToHalf(dist(rng) * scale);
+			curr[i] = FloatToHalf(dist(rng) * scale);
+		}
+
+		auto apply = [&](WaveRowKernelHalf kernel)
+		{
+			std::vector<uint16_t> out = prev;
+			for (size_t i = 1; i < rows - 1; ++i)
+			{
+				kernel(out.data() + i * cols + 1, curr.data() + i * cols + 1, cols, cols - 2, k);
+			}
+			return out;
+		};
+
+		const std::vector<uint16_t> reference = apply(GetWaveRowKernelHalf(WaveKernelIsa::Scalar));
+
+		for (WaveKernelIsa isa : AllKernels)
+		{
+			WaveRowKernelHalf kernel = GetWaveRowKernelHalf(isa);
+			if (!kernel)
+			{
+				continue;
+			}
+
+			const std::vector<uint16_t> result = apply(kernel);
+			const bool pass = result == reference;
+			std::printf("half     %-8s vs scalar  %s\n", WaveKernelIsaName(isa), pass ? "bit-identical" : "FAILED");
+			ok = ok && pass;
+		}
+
+		return ok;
+	}
+
+	// Runs a float and a half grid side by side and reports how far they drift apart.
+	int RunHalf(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		Waves reference;
+		HalfWaves half;
+		reference.Init(opt.Rows, opt.Cols, dx, dt, speed, damping);
+		half.Init(opt.Rows, opt.Cols, dx, dt, speed, damping);
+		reference.SetThreadCount(opt.Threads);
+		half.SetThreadCount(opt.Threads);
+
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<size_t> rowDist(5, opt.Rows - 6);
+		std::uniform_int_distribution<size_t> colDist(5, opt.Cols - 6);
+		std::uniform_real_distribution<float> magDist(1.0f, 2.0f);
+
+		const size_t reportEvery = std::max<size_t>(opt.Steps / 10, 1);
+		double floatSeconds = 0.0;
+		double halfSeconds = 0.0;
+
+		std::printf("%10s %14s %14s %14s %10s\n", "step", "max |err|", "rms err", "rms height", "rel rms");
+
+		for (size_t step = 0; step < opt.Steps; ++step)
+		{
+			if (opt.DisturbEvery != 0 && step % opt.DisturbEvery == 0)
+			{
+				size_t i = rowDist(rng);
+				size_t j = colDist(rng);
+				float r = magDist(rng);
+				reference.Disturb(i, j, r);
+				half.Disturb(i, j, r);
+			}
+
+			auto t0 = Clock::now();
+			reference.Update(dt);
+			auto t1 = Clock::now();
+			half.Update(dt);
+			auto t2 = Clock::now();
+
+			floatSeconds += std::chrono::duration<double>(t1 - t0).count();
+			halfSeconds += std::chrono::duration<double>(t2 - t1).count();
+
+			if ((step + 1) % reportEvery == 0 || step + 1 == opt.Steps)
+			{
+				WaveDrift d = MeasureDrift(reference, half);
+				std::printf("%10zu %14.6g %14.6g %14.6g %10.3g\n", step + 1, d.MaxAbsError, d.RmsError, d.ReferenceRms,
+					d.ReferenceRms > 0.0f ? d.RmsError / d.ReferenceRms : 0.0f);
+			}
+		}
+
+		const double steps = double(std::max<size_t>(opt.Steps, 1));
+		std::printf("kernel        %s (half), %s (float)\n", WaveKernelIsaName(half.Kernel()), WaveKernelIsaName(reference.Kernel()));
+		std::printf("float update  %.3f us/step\n", floatSeconds / steps * 1e6);
+		std::printf("half update   %.3f us/step\n", halfSeconds / steps * 1e6);
+		std::printf("footprint     %.1f MB (half) vs %.1f MB (float)\n",
+			2.0 * half.VertexCount() * sizeof(uint16_t) / 1e6, 2.0 * reference.VertexCount() * sizeof(float) / 1e6);
+
+		return 0;
+	}
+
+	// Runs the same disturbed simulation on waves as every other call with the same seed.
+	void RunScenario(Waves& waves, size_t steps, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<size_t> rowDist(5, waves.RowCount() - 6);
+		std::uniform_int_distribution<size_t> colDist(5, waves.ColumnCount() - 6);
+		std::uniform_real_distribution<float> magDist(1.0f, 2.0f);
+
+		for (size_t step = 0; step < steps; ++step)
+		{
+			if (step % 4 == 0)
+			{
+				waves.Disturb(rowDist(rng), colDist(rng), magDist(rng));
+			}
+			waves.Update(dt);
+		}
+	}
+
+	// The threaded update must be bit-identical to the serial one.
+	bool VerifyThreads(const Options& opt)
+	{
+		// Large enough that Update() actually splits the work.
+		const size_t rows = std::max<size_t>(opt.Rows, 300);
+		const size_t cols = std::max<size_t>(opt.Cols, 300);
+		const size_t threads = opt.Threads > 1 ? opt.Threads : 4;
+		const size_t steps = 64;
+
+		Waves serial, parallel;
+		serial.Init(rows, cols, dx, dt, speed, damping);
+		parallel.Init(rows, cols, dx, dt, speed, damping);
+		parallel.SetThreadCount(threads);
+
+		RunScenario(serial, steps, 7);
+		RunScenario(parallel, steps, 7);
+
+		const bool pass = SameHeights(serial, parallel);
+		std::printf("threads  %zu vs serial, %zu steps  %s\n", parallel.ThreadCount(), steps, pass ? "bit-identical" : "FAILED");
+		return pass;
+	}
+
+	// Update() must turn elapsed time into fixed steps: fractions carry over,
+	// steps over the substep budget are dropped and reported, and the steps it
+	// reports are the ones it ran.
+	bool VerifyClock(const Options&)
+	{
+		Waves timed, counted;
+		timed.Init(61, 93, dx, dt, speed, damping);
+		counted.Init(61, 93, dx, dt, speed, damping);
+		timed.Disturb(30, 40, 1.5f);
+		counted.Disturb(30, 40, 1.5f);
+
+		size_t total = 0;
+		auto near = [](float a, float b) { return std::fabs(a - b) < 1e-5f; };
+		auto update = [&](float elapsed, size_t steps, float dropped)
+		{
+			const WaveStepReport report = timed.Update(elapsed);
+			total += report.Steps;
+			return report.Steps == steps && near(report.DroppedTime, dropped);
+		};
+
+		// Half steps accumulate into one.
+		bool carry = update(0.5f*dt, 0, 0.0f);
+		carry = update(0.5f*dt, 1, 0.0f) && carry;
+		carry = near(timed.Accumulator(), 0.0f) && carry;
+
+		// The default budget of 8 drops the other 12 whole steps but keeps the half.
+		bool budget = timed.MaxSubsteps() == 8 && update(20.5f*dt, 8, 12.0f*dt);
+		budget = near(timed.Accumulator(), 0.5f*dt) && budget;
+		budget = update(0.5f*dt, 1, 0.0f) && budget;
+
+		// A zero budget is clamped to one step per call.
+		timed.SetMaxSubsteps(0);
+		bool clamped = timed.MaxSubsteps() == 1 && update(3.5f*dt, 1, 2.0f*dt);
+		clamped = near(timed.Accumulator(), 0.5f*dt) && clamped;
+
+		counted.Advance(total);
+		const bool stepped = total == 11 && SameHeights(timed, counted);
+
+		std::printf("clock    carry %s, budget %s, clamp %s, %zu steps run %s\n", carry ? "ok" : "FAILED",
+			budget ? "ok" : "FAILED", clamped ? "ok" : "FAILED", total, stepped ? "ok" : "FAILED");
+		return carry && budget && clamped && stepped;
+	}
+
+	// Temporally blocked Advance() must be bit-identical to stepping with Update().
+	bool VerifyAdvance(const Options& opt)
+	{
+		const size_t rows = std::max<size_t>(opt.Rows, 300) | 1;
+		const size_t cols = std::max<size_t>(opt.Cols, 300) | 1;
+		const size_t chunk = 13;
+		const size_t chunks = 8;
+
+		bool ok = true;
+		for (size_t threads : { size_t(1), std::max<size_t>(opt.Threads, 4) })
+		{
+			Waves stepped, blocked;
+			stepped.Init(rows, cols, dx, dt, speed, damping);
+			blocked.Init(rows, cols, dx, dt, speed, damping);
+			blocked.SetThreadCount(threads);
+
+			// Small odd tiles and a block length that does not divide the chunk.
+			blocked.SetTemporalBlocking(5, 37, 61);
+
+			std::mt19937 rng(11);
+			std::uniform_int_distribution<size_t> rowDist(5, rows - 6);
+			std::uniform_int_distribution<size_t> colDist(5, cols - 6);
+
+			for (size_t c = 0; c < chunks; ++c)
+			{
+				size_t i = rowDist(rng);
+				size_t j = colDist(rng);
+				stepped.Disturb(i, j, 1.5f);
+				blocked.Disturb(i, j, 1.5f);
+
+				for (size_t s = 0; s < chunk; ++s)
+				{
+					stepped.Update(dt);
+				}
+				blocked.Advance(chunk);
+			}
+
+			const bool pass = SameHeights(stepped, blocked);
+			std::printf("advance  %zu thread(s) vs Update, %zu steps  %s\n", blocked.ThreadCount(), chunk * chunks, pass ? "bit-identical" : "FAILED");
+			ok = ok && pass;
+		}
+
+		return ok;
+	}
+
+	// Vertices written through a sink must match operator[] exactly, whichever
+	// path (serial, banded, temporally blocked, no step due) produced them.
+	bool VerifySink(const Options& opt)
+	{
+		const size_t rows = std::max<size_t>(opt.Rows, 300) | 1;
+		const size_t cols = std::max<size_t>(opt.Cols, 300) | 1;
+
+		bool ok = true;
+		for (size_t threads : { size_t(1), std::max<size_t>(opt.Threads, 4) })
+		{
+			Waves waves;
+			waves.Init(rows, cols, dx, dt, speed, damping);
+			waves.SetThreadCount(threads);
+			waves.SetTemporalBlocking(5, 37, 61);
+
+			std::vector<BenchVertex> expected(waves.VertexCount());
+			std::vector<BenchVertex> actual(waves.VertexCount());
+			const WaveOutputSink sink = MakeSink(actual);
+
+			bool pass = true;
+			auto check = [&]()
+			{
+				CopyVertices(waves, expected);
+				pass = pass && std::memcmp(expected.data(), actual.data(), actual.size() * sizeof(BenchVertex)) == 0;
+
+				// Poison the buffer so the next check sees only fresh writes.
+				std::memset(actual.data(), 0xff, actual.size() * sizeof(BenchVertex));
+			};
+
+			for (size_t c = 0; c < 6; ++c)
+			{
+				waves.Disturb(5 + c*17 % (rows - 10), 5 + c*29 % (cols - 10), 1.5f);
+
+				std::memset(actual.data(), 0xff, actual.size() * sizeof(BenchVertex));
+				waves.Update(dt, sink);
+				check();
+				waves.Update(0.25f*dt, sink);
+				check();
+				waves.Advance(12, sink);
+				check();
+			}
+
+			std::printf("sink     %zu thread(s) vs operator[]  %s\n", waves.ThreadCount(), pass ? "identical" : "FAILED");
+			ok = ok && pass;
+		}
+
+		return ok;
+	}
+
+	// Slopes written during a step must match a separate pass over the final
+	// heights exactly, across band seams, the edges and every step path.
+	bool VerifyGradients(const Options& opt)
+	{
+		const size_t rows = std::max<size_t>(opt.Rows, 300) | 1;
+		const size_t cols = std::max<size_t>(opt.Cols, 300) | 1;
+
+		bool ok = true;
+		for (int variant = 0; variant < 3; ++variant)
+		{
+			Waves waves;
+			waves.Init(rows, cols, dx, dt, speed, damping);
+			waves.SetThreadCount(variant == 0 ? 1 : std::max<size_t>(opt.Threads, 4));
+			if (variant == 2)
+			{
+				waves.SetActivityTracking(1e-5f, 32);
+			}
+			else
+			{
+				waves.SetTemporalBlocking(5, 37, 61);
+			}
+
+			const size_t count = waves.VertexCount();
+			std::vector<BenchVertex> vertices(count);
+			std::vector<float> expectedX(count), expectedZ(count), actualX(count), actualZ(count);
+			WaveOutputSink sink = MakeSink(vertices);
+			sink.GradientX = actualX.data();
+			sink.GradientZ = actualZ.data();
+
+			bool pass = true;
+			auto check = [&]()
+			{
+				CopyGradients(waves, expectedX, expectedZ);
+				pass = pass && std::memcmp(expectedX.data(), actualX.data(), count * sizeof(float)) == 0
+					&& std::memcmp(expectedZ.data(), actualZ.data(), count * sizeof(float)) == 0;
+
+				std::memset(actualX.data(), 0xff, count * sizeof(float));
+				std::memset(actualZ.data(), 0xff, count * sizeof(float));
+			};
+
+			std::memset(actualX.data(), 0xff, count * sizeof(float));
+			std::memset(actualZ.data(), 0xff, count * sizeof(float));
+			for (size_t c = 0; c < 4; ++c)
+			{
+				waves.Disturb(5 + c*17 % (rows - 10), 5 + c*29 % (cols - 10), 1.5f);
+
+				waves.Update(dt, sink);
+				check();
+				waves.Update(0.25f*dt, sink);
+				check();
+				waves.Advance(12, sink);
+				check();
+			}
+
+			// Only the slopes: no vertex data at all.
+			WaveOutputSink slopes;
+			slopes.GradientX = actualX.data();
+			slopes.GradientZ = actualZ.data();
+			waves.Update(dt, slopes);
+			check();
+
+			const char* names[] = { "serial", "banded", "sparse" };
+			std::printf("gradient %s, %zu thread(s) vs separate pass  %s\n", names[variant], waves.ThreadCount(), pass ? "identical" : "FAILED");
+			ok = ok && pass;
+		}
+
+		return ok;
+	}
+
+	// Activity tracking: threads must not change the result, skipped tiles
+	// must cost no more than the flush threshold, and calm water must end up
+	// with every tile asleep.
+	bool VerifySparse(const Options& opt)
+	{
+		const size_t rows = std::max<size_t>(opt.Rows, 300) | 1;
+		const size_t cols = std::max<size_t>(opt.Cols, 300) | 1;
+		const float epsilon = 1e-5f;
+		const size_t steps = 400;
+
+		Waves dense, serial, parallel;
+		for (Waves* w : { &dense, &serial, &parallel })
+		{
+			w->Init(rows, cols, dx, dt, speed, damping);
+		}
+		serial.SetActivityTracking(epsilon, 32);
+		parallel.SetActivityTracking(epsilon, 32);
+		parallel.SetThreadCount(std::max<size_t>(opt.Threads, 4));
+
+		std::vector<BenchVertex> expected(parallel.VertexCount());
+		std::vector<BenchVertex> actual(parallel.VertexCount());
+		const WaveOutputSink sink = MakeSink(actual);
+
+		// A few local splashes in one corner, then calm.
+		bool sinkOk = true;
+		size_t peakActive = 0;
+		for (size_t step = 0; step < steps; ++step)
+		{
+			if (step < 40 && step % 10 == 0)
+			{
+				for (Waves* w : { &dense, &serial, &parallel })
+				{
+					w->Disturb(20 + step, 30, 1.5f);
+				}
+			}
+
+			dense.Advance(1);
+			serial.Advance(1);
+			parallel.Advance(1, sink);
+			peakActive = std::max(peakActive, parallel.ActiveTileCount());
+
+			if (step % 50 == 0)
+			{
+				CopyVertices(parallel, expected);
+				sinkOk = sinkOk && std::memcmp(expected.data(), actual.data(), actual.size() * sizeof(BenchVertex)) == 0;
+			}
+		}
+
+		const bool same = SameHeights(serial, parallel);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < dense.VertexCount(); ++i)
+		{
+			maxError = std::max(maxError, std::fabs(dense.Height(i) - serial.Height(i)));
+		}
+		const bool closeOk = maxError < 100.0f * epsilon;
+
+		std::printf("sparse   %zu threads vs serial  %s, sink %s\n", parallel.ThreadCount(),
+			same ? "bit-identical" : "FAILED", sinkOk ? "identical" : "FAILED");
+		std::printf("sparse   max |dense - sparse| %.3g after %zu steps (eps %g, peak %zu/%zu tiles)  %s\n",
+			maxError, steps, epsilon, peakActive, serial.TileCount(), closeOk ? "ok" : "FAILED");
+
+		// Without disturbances the damped waves decay until every tile sleeps.
+		// The smoothest mode of a large grid decays very slowly, so use a small one.
+		Waves calm;
+		calm.Init(48, 48, dx, dt, speed, damping);
+		calm.SetActivityTracking(epsilon, 16);
+		calm.Disturb(20, 20, 1.5f);
+
+		size_t calmSteps = 0;
+		while (calm.ActiveTileCount() != 0 && calmSteps < 20000)
+		{
+			calm.Advance(1);
+			++calmSteps;
+		}
+
+		bool flat = calm.ActiveTileCount() == 0;
+		for (size_t i = 0; flat && i < calm.VertexCount(); ++i)
+		{
+			flat = calm.Height(i) == 0.0f;
+		}
+		std::printf("sparse   48 x 48 grid asleep and flat %zu steps after a splash  %s\n", calmSteps, flat ? "ok" : "FAILED");
+
+		return same && sinkOk && closeOk && flat;
+	}
+
+	// Queued impulses must match stamping them one by one in queue order,
+	// clip at the edges and wake sleeping tiles.
+	bool VerifyDisturbances(const Options& opt)
+	{
+		const size_t rows = std::max<size_t>(opt.Rows, 200) | 1;
+		const size_t cols = std::max<size_t>(opt.Cols, 200) | 1;
+
+		Waves waves;
+		waves.Init(rows, cols, dx, dt, speed, damping);
+		const size_t disc = waves.AddBrush(WaveBrush::Custom([](float) { return 1.0f; }));
+		const WaveBrush gaussian = WaveBrush::Gaussian();
+		const WaveBrush flat = WaveBrush::Custom([](float) { return 1.0f; });
+
+		struct Impulse { float Row, Col, Radius, Magnitude; size_t Brush; };
+		std::vector<Impulse> impulses;
+
+		std::mt19937 rng(5);
+		std::uniform_real_distribution<float> rowDist(-6.0f, float(rows) + 6.0f);
+		std::uniform_real_distribution<float> colDist(-6.0f, float(cols) + 6.0f);
+		std::uniform_real_distribution<float> radiusDist(0.5f, 6.0f);
+		std::uniform_real_distribution<float> magDist(-1.0f, 1.0f);
+		for (size_t k = 0; k < 5000; ++k)
+		{
+			impulses.push_back({ rowDist(rng), colDist(rng), radiusDist(rng), magDist(rng), k % 3 == 0 ? disc : 0 });
+		}
+
+		// Corners and edges, partly or entirely off the grid.
+		impulses.push_back({ 0.0f, 0.0f, 4.0f, 1.0f, 0 });
+		impulses.push_back({ float(rows - 1), float(cols - 1), 3.0f, 1.0f, disc });
+		impulses.push_back({ -10.0f, 20.0f, 3.0f, 1.0f, 0 });
+		impulses.push_back({ -0.5f, 20.0f, 3.0f, 1.0f, 0 });
+		impulses.push_back({ float(rows), 20.0f, 3.0f, 1.0f, 0 });
+
+		// Non-finite arguments are dropped.
+		impulses.push_back({ std::nanf(""), 20.0f, 3.0f, 1.0f, 0 });
+		impulses.push_back({ 20.0f, INFINITY, 3.0f, 1.0f, disc });
+		impulses.push_back({ -INFINITY, 20.0f, 3.0f, 1.0f, 0 });
+		impulses.push_back({ 20.0f, 20.0f, std::nanf(""), 1.0f, 0 });
+		impulses.push_back({ 20.0f, 20.0f, INFINITY, 1.0f, disc });
+		impulses.push_back({ 20.0f, 20.0f, 3.0f, std::nanf(""), 0 });
+
+		std::vector<double> expected(waves.VertexCount(), 0.0);
+		for (const Impulse& p : impulses)
+		{
+			waves.QueueDisturbance(p.Row, p.Col, p.Radius, p.Magnitude, p.Brush);
+			if (!std::isfinite(p.Row) || !std::isfinite(p.Col) || !std::isfinite(p.Radius) || !std::isfinite(p.Magnitude))
+			{
+				continue;
+			}
+
+			const WaveBrush& brush = p.Brush == disc ? flat : gaussian;
+			const float r = std::max(p.Radius, 1.0f);
+			for (size_t i = 1; i + 1 < rows; ++i)
+			{
+				for (size_t j = 1; j + 1 < cols; ++j)
+				{
+					const float di = float(i) - p.Row;
+					const float dj = float(j) - p.Col;
+					const float u = (di*di + dj*dj) * (1.0f / (r*r));
+					if (u < 1.0f)
+					{
+						expected[i*cols + j] += p.Magnitude * brush.Weight(u);
+					}
+				}
+			}
+		}
+
+		waves.ApplyDisturbances();
+
+		// Sorting reorders the additions within a cell, so allow rounding.
+		double maxError = 0.0;
+		for (size_t i = 0; i < waves.VertexCount(); ++i)
+		{
+			maxError = std::max(maxError, std::fabs(expected[i] - waves.Height(i)));
+		}
+
+		bool edges = waves.QueuedDisturbanceCount() == 0;
+		for (size_t i = 0; i < rows; ++i)
+		{
+			edges = edges && waves.Height(i*cols) == 0.0f && waves.Height(i*cols + cols - 1) == 0.0f;
+		}
+		for (size_t j = 0; j < cols; ++j)
+		{
+			edges = edges && waves.Height(j) == 0.0f && waves.Height((rows - 1)*cols + j) == 0.0f;
+		}
+
+		Waves calm;
+		calm.Init(rows, cols, dx, dt, speed, damping);
+		calm.SetActivityTracking(1e-4f);
+		calm.Advance(1);
+		const size_t asleep = calm.ActiveTileCount();
+		calm.QueueDisturbance(float(rows) / 2 + 0.3f, float(cols) / 2 - 0.6f, 3.0f, 1.0f);
+		calm.Advance(1);
+		const bool woke = asleep == 0 && calm.ActiveTileCount() != 0;
+
+		const bool close = maxError < 1e-4;
+		std::printf("queue    %zu impulses vs one by one: max err %.3g  %s, edges %s, wake %s\n", impulses.size(), maxError,
+			close ? "ok" : "FAILED", edges ? "ok" : "FAILED", woke ? "ok" : "FAILED");
+		return close && edges && woke;
+	}
+
+	// StaticWaves runs the scalar kernel's expression with constant strides, so
+	// it must match Waves bit for bit, including on odd sizes.
+	bool VerifyStatic(const Options&)
+	{
+		StaticWaves<61, 93> fixed;
+		Waves waves;
+		fixed.Init(dx, dt, speed, damping);
+		waves.Init(61, 93, dx, dt, speed, damping);
+
+		for (size_t step = 0; step < 200; ++step)
+		{
+			if (step % 7 == 0)
+			{
+				size_t i = 3 + step % 55;
+				size_t j = 3 + (step * 5) % 87;
+				fixed.Disturb(i, j, 1.25f);
+				waves.Disturb(i, j, 1.25f);
+			}
+			fixed.Update(dt);
+			waves.Update(dt);
+		}
+
+		const bool pass = SameHeights(fixed, waves);
+		std::printf("static   61 x 93 vs Waves, 200 steps  %s\n", pass ? "bit-identical" : "FAILED");
+		return pass;
+	}
+
+	// Counts the blocks Waves asks for and checks their alignment.
+	class CountingAllocator : public WaveAllocator
+	{
+	public:
+		void* Allocate(size_t bytes, size_t alignment) override
+		{
+			++Allocations;
+			void* p = DefaultWaveAllocator().Allocate(bytes, alignment);
+			Aligned = Aligned && reinterpret_cast<uintptr_t>(p) % 64 == 0 && alignment >= 64;
+			return p;
+		}
+
+		void Free(void* p, size_t bytes) override
+		{
+			Frees += p ? 1 : 0;
+			DefaultWaveAllocator().Free(p, bytes);
+		}
+
+		size_t Allocations = 0;
+		size_t Frees = 0;
+		bool Aligned = true;
+	};
+
+	// Plane layout and reuse: re-Init must not reallocate when the planes are
+	// big enough, and a 4KB row pitch must be padded without changing results.
+	bool VerifyAllocator(const Options&)
+	{
+		CountingAllocator counting;
+		bool ok = true;
+
+		{
+			Waves waves;
+			waves.SetAllocator(&counting);
+			waves.Init(300, 300, dx, dt, speed, damping);
+			waves.Init(300, 300, dx, dt, speed, damping);
+			waves.Init(200, 250, dx, dt, speed, damping);
+			ok = ok && counting.Allocations == 1;
+
+			waves.Init(600, 600, dx, dt, speed, damping);
+			ok = ok && counting.Allocations == 2 && counting.Frees == 1;
+
+			// Temporal blocking adds the second pair of planes once.
+			waves.Advance(16);
+			waves.Init(600, 600, dx, dt, speed, damping);
+			waves.Advance(16);
+			ok = ok && counting.Allocations == 3;
+
+			ok = ok && reinterpret_cast<uintptr_t>(waves.Heights()) % 64 == 0 && waves.RowStride() % 16 == 0;
+
+			// Both pairs of planes are reused by a smaller grid: the padding
+			// of the new rows must start zero in each, stepped or not.
+			for (size_t i = 10; i < 590; i += 20)
+			{
+				for (size_t j = 10; j < 590; j += 20)
+				{
+					waves.Disturb(i, j, 1.5f);
+				}
+			}
+			waves.Advance(16);
+			waves.Init(590, 500, dx, dt, speed, damping);
+			waves.Disturb(300, 250, 1.5f);
+			waves.Advance(8);
+			ok = ok && counting.Allocations == 3;
+			for (size_t i = 0; ok && i < waves.RowCount(); ++i)
+			{
+				const float* row = waves.Heights() + i*waves.RowStride();
+				ok = std::all_of(row + waves.ColumnCount(), row + waves.RowStride(), [](float h) { return h == 0.0f; });
+			}
+		}
+		ok = ok && counting.Frees == counting.Allocations && counting.Aligned;
+
+		std::printf("alloc    %zu blocks for 6 Init calls, 64-byte aligned, zero padding, all freed  %s\n", counting.Allocations, ok ? "ok" : "FAILED");
+
+		// 1024 columns are exactly 4KB; the stride must be padded.
+		StaticWaves<64, 1024> fixed;
+		Waves waves;
+		fixed.Init(dx, dt, speed, damping);
+		waves.Init(64, 1024, dx, dt, speed, damping);
+		fixed.Disturb(30, 500, 1.0f);
+		waves.Disturb(30, 500, 1.0f);
+		fixed.Advance(40);
+		waves.Advance(40);
+
+		const bool padded = waves.RowStride() == 1040 && SameHeights(fixed, waves);
+		std::printf("alloc    64 x 1024 with row stride %zu vs contiguous StaticWaves  %s\n", waves.RowStride(), padded ? "bit-identical" : "FAILED");
+
+		return ok && padded;
+	}
+
+	// Every snapshot the render side reads must be the grid after exactly
+	// snapshot.Step steps, whatever the solver thread was doing meanwhile.
+	bool VerifySimThread(const Options&)
+	{
+		const size_t m = 64, n = 96;
+
+		WaveSimThread sim;
+		sim.SetTimeScale(0.0f);
+		sim.Solver().Init(m, n, dx, dt, speed, damping);
+		sim.Solver().Disturb(30, 40, 1.5f);
+
+		Waves reference;
+		reference.Init(m, n, dx, dt, speed, damping);
+		reference.Disturb(30, 40, 1.5f);
+		uint64_t referenceSteps = 0;
+
+		std::vector<BenchVertex> expected(reference.VertexCount());
+		std::vector<BenchVertex> actual(reference.VertexCount());
+		const WaveOutputSink sink = MakeSink(actual);
+
+		bool pass = true;
+		size_t read = 0;
+
+		sim.Start();
+		while (pass && (read < 20 || referenceSteps < 400))
+		{
+			const WaveSnapshot* snapshot = sim.AcquireSnapshot();
+			if (!snapshot || (read != 0 && snapshot->Step == referenceSteps))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			pass = snapshot->Step >= referenceSteps && sim.Age(*snapshot).Steps <= sim.Stats().Steps;
+			if (snapshot->Step > referenceSteps)
+			{
+				reference.Advance(size_t(snapshot->Step - referenceSteps));
+				referenceSteps = snapshot->Step;
+			}
+
+			sim.WriteVertices(*snapshot, sink);
+			CopyVertices(reference, expected);
+			pass = pass && std::memcmp(expected.data(), actual.data(), actual.size() * sizeof(BenchVertex)) == 0;
+			++read;
+		}
+		sim.Stop();
+
+		const WaveSimStats stats = sim.Stats();
+		pass = pass && stats.Snapshots == stats.Steps + 1 && stats.DroppedSteps == 0;
+
+		std::printf("simthread %zu of %llu snapshots read vs Advance  %s\n", read, (unsigned long long)stats.Snapshots,
+			pass ? "bit-identical" : "FAILED");
+		return pass;
+	}
+
+	// A grid saved mid-run and loaded into a fresh Waves must carry on exactly
+	// as the original, through the mapped planes and through the copy taken
+	// for a checkpoint whose layout differs.
+	bool VerifyCheckpoint(const Options&)
+	{
+		const char* path = "wave_bench_verify.ckpt";
+		const char* copyPath = "wave_bench_verify_copy.ckpt";
+		const size_t m = 70, n = 1024;
+
+		Waves original;
+		original.Init(m, n, dx, dt, speed, damping);
+		original.Disturb(30, 500, 1.5f);
+		original.Advance(25);
+		original.Update(0.5f * dt);
+
+		bool ok = original.Save(path);
+
+		Waves mapped;
+		mapped.SetActivityTracking(1e-5f);
+		ok = ok && mapped.Load(path);
+		ok = ok && mapped.RowCount() == m && mapped.ColumnCount() == n && mapped.Accumulator() == original.Accumulator();
+
+		// The same state with contiguous rows, as another layout would store it.
+		// A separate file: the first one stays mapped by the loaded grid.
+		WaveCheckpointHeader header;
+		std::vector<float> planes(2 * m * n);
+		if (std::FILE* file = std::fopen(path, "rb"))
+		{
+			ok = ok && std::fread(&header, sizeof(header), 1, file) == 1;
+			for (size_t plane = 0; ok && plane < 2; ++plane)
+			{
+				for (size_t i = 0; ok && i < m; ++i)
+				{
+					const long offset = long(header.HeaderBytes + (plane * header.PlaneStride + i * header.RowStride) * sizeof(float));
+					ok = std::fseek(file, offset, SEEK_SET) == 0 && std::fread(&planes[(plane * m + i) * n], sizeof(float), n, file) == n;
+				}
+			}
+			std::fclose(file);
+		}
+		header.RowStride = n;
+		header.PlaneStride = m * n;
+		if (std::FILE* file = std::fopen(copyPath, "wb"))
+		{
+			std::vector<char> page(WaveCheckpointPageSize, 0);
+			std::memcpy(page.data(), &header, sizeof(header));
+			ok = ok && std::fwrite(page.data(), 1, page.size(), file) == page.size();
+			ok = ok && std::fwrite(planes.data(), sizeof(float), planes.size(), file) == planes.size();
+			std::fclose(file);
+		}
+
+		Waves copied;
+		ok = ok && copied.Load(copyPath);
+		std::remove(copyPath);
+
+		// Writes the copy's header with one field corrupted; Load() must reject
+		// it and leave the grid untouched.
+		auto rejectsHeader = [&](auto corrupt)
+		{
+			WaveCheckpointHeader bad = header;
+			corrupt(bad);
+			if (std::FILE* file = std::fopen(copyPath, "wb"))
+			{
+				std::vector<char> page(WaveCheckpointPageSize, 0);
+				std::memcpy(page.data(), &bad, sizeof(bad));
+				ok = ok && std::fwrite(page.data(), 1, page.size(), file) == page.size();
+				ok = ok && std::fwrite(planes.data(), sizeof(float), planes.size(), file) == planes.size();
+				std::fclose(file);
+			}
+
+			Waves loaded;
+			loaded.Init(8, 8, dx, dt, speed, damping);
+			const bool rejected = !loaded.Load(copyPath) && loaded.RowCount() == 8;
+			std::remove(copyPath);
+			return rejected;
+		};
+
+		// A header offset chosen so that the offset plus the planes wraps
+		// to zero must be rejected, not mapped past the end of the file.
+		const bool rejectsCorrupt = rejectsHeader([](WaveCheckpointHeader& h) { h.HeaderBytes = uint64_t(0) - 2*h.PlaneStride*sizeof(float); });
+
+		// Steps and constants that would fill the planes with inf or NaN, or
+		// stall the clock.
+		const float nan = std::nanf("");
+		bool rejectsValues = true;
+		for (float value : { nan, float(INFINITY), 0.0f, -1.0f })
+		{
+			rejectsValues = rejectsHeader([=](WaveCheckpointHeader& h) { h.SpatialStep = value; }) && rejectsValues;
+			rejectsValues = rejectsHeader([=](WaveCheckpointHeader& h) { h.TimeStep = value; }) && rejectsValues;
+		}
+		for (float value : { nan, float(INFINITY), -float(INFINITY) })
+		{
+			rejectsValues = rejectsHeader([=](WaveCheckpointHeader& h) { h.K1 = value; }) && rejectsValues;
+			rejectsValues = rejectsHeader([=](WaveCheckpointHeader& h) { h.K2 = value; }) && rejectsValues;
+			rejectsValues = rejectsHeader([=](WaveCheckpointHeader& h) { h.K3 = value; }) && rejectsValues;
+		}
+		for (float value : { nan, float(INFINITY), -1.0f, dt })
+		{
+			rejectsValues = rejectsHeader([=](WaveCheckpointHeader& h) { h.Accumulator = value; }) && rejectsValues;
+		}
+
+		// Saving over the file mapped must not disturb the grid stepping it.
+		ok = ok && original.Save(path);
+
+		for (size_t s = 0; s < 3; ++s)
+		{
+			original.Update(dt);
+			mapped.Update(dt);
+			copied.Update(dt);
+			original.Advance(16);
+			mapped.Advance(16);
+			copied.Advance(16);
+		}
+
+		const bool same = ok && SameHeights(original, mapped) && SameHeights(original, copied);
+
+		Waves untouched;
+		untouched.Init(8, 8, dx, dt, speed, damping);
+		const bool rejects = !untouched.Load(copyPath) && untouched.RowCount() == 8;
+
+		mapped.Init(8, 8, dx, dt, speed, damping);
+		std::remove(path);
+
+		std::printf("ckpt     %zu x %zu saved and loaded (mapped, copied) vs original  %s, missing file %s, huge header %s, bad values %s\n", m, n,
+			same ? "bit-identical" : "FAILED", rejects ? "rejected" : "ACCEPTED", rejectsCorrupt ? "rejected" : "ACCEPTED",
+			rejectsValues ? "rejected" : "ACCEPTED");
+		return same && rejects && rejectsCorrupt && rejectsValues;
+	}
+
+	// Every recorded frame must play back as the grid at its step, to within
+	// half a quantum plus the 1/256 quantum the recorder's rounding may add.
+	bool VerifyRecording(const Options&)
+	{
+		const char* path = "wave_bench_verify.rec";
+		const size_t m = 64, n = 96, every = 4, steps = 200;
+		const float quantum = 1.0f / 1024.0f;
+
+		Waves waves;
+		waves.Init(m, n, dx, dt, speed, damping);
+
+		// Room for every frame, so none is dropped however slow the writer.
+		WaveRecorder recorder;
+		bool ok = recorder.Open(path, waves, every, quantum, steps / every);
+
+		std::mt19937 rng(99);
+		for (size_t s = 0; s < steps; ++s)
+		{
+			if (s % 16 == 0)
+			{
+				waves.Disturb(5 + rng() % (m - 10), 5 + rng() % (n - 10), 1.5f);
+			}
+			waves.Advance(1);
+			recorder.Record(waves, 1);
+		}
+		ok = recorder.Close() && ok;
+		ok = ok && recorder.FramesRecorded() == steps / every && recorder.FramesDropped() == 0;
+
+		Waves reference;
+		reference.Init(m, n, dx, dt, speed, damping);
+		rng.seed(99);
+		size_t referenceSteps = 0;
+
+		WavePlayback playback;
+		ok = ok && playback.Open(path);
+
+		size_t frames = 0;
+		float maxError = 0.0f;
+		while (ok && playback.NextFrame())
+		{
+			for (; referenceSteps < playback.Step(); ++referenceSteps)
+			{
+				if (referenceSteps % 16 == 0)
+				{
+					reference.Disturb(5 + rng() % (m - 10), 5 + rng() % (n - 10), 1.5f);
+				}
+				reference.Advance(1);
+			}
+
+			for (size_t i = 0; i < reference.VertexCount(); ++i)
+			{
+				maxError = std::max(maxError, std::fabs(playback.Heights()[i] - reference.Height(i)));
+			}
+			++frames;
+		}
+		playback.Close();
+		std::remove(path);
+
+		const bool pass = ok && frames == steps / every && maxError <= (0.5f + 1.0f / 256.0f) * quantum;
+		std::printf("record   %zu frames, %llu bytes, max err %.3g (quantum %.3g)  %s\n", frames,
+			(unsigned long long)recorder.BytesWritten(), maxError, quantum, pass ? "ok" : "FAILED");
+		return pass;
+	}
+
+	// A full ring keeps its newest samples, percentiles are nearest-rank, and
+	// Stats() racing writers on other threads never sees a torn sample.
+	bool VerifyProfiler(const Options&)
+	{
+		const char* path = "wave_bench_verify_trace.json";
+		const size_t capacity = 64;
+
+		WaveProfiler profiler(capacity);
+		const uint32_t ramp = profiler.AddPhase("ramp");
+		const uint32_t fixed = profiler.AddPhase("fixed");
+		const bool idsOk = profiler.AddPhase("ramp") == ramp && fixed != ramp;
+
+		// Durations of 1..1000 us; the ring keeps 937..1000.
+		for (uint64_t k = 1; k <= 1000; ++k)
+		{
+			profiler.Record(ramp, k * 10000000, k * 10000000 + k * 1000);
+		}
+		const WavePhaseStats r = profiler.Stats()[ramp];
+		bool pass = idsOk && r.Count == capacity && r.P50 == 968.0 && r.P95 == 997.0 && r.P99 == 1000.0 && r.Max == 1000.0;
+		pass = pass && profiler.Stats(969 * uint64_t(10000000))[ramp].Count == 32;
+
+		// Every writer's samples last exactly 7 ns; one mixing two writes would not.
+		const size_t writers = 2;
+		const uint64_t perWriter = 200000;
+		std::atomic<size_t> done(0);
+		std::vector<std::thread> threads;
+		for (size_t w = 0; w < writers; ++w)
+		{
+			threads.emplace_back([&, w]()
+			{
+				profiler.SetThreadName(w == 0 ? "writer 0" : "writer 1");
+				for (uint64_t k = 0; k < perWriter; ++k)
+				{
+					profiler.Record(fixed, k * 1000, k * 1000 + 7);
+				}
+				done.fetch_add(1);
+			});
+		}
+
+		size_t reads = 0;
+		bool torn = false;
+		do
+		{
+			const WavePhaseStats f = profiler.Stats()[fixed];
+			torn = torn || (f.Count != 0 && (f.Max != 0.007 || f.P50 != 0.007));
+			++reads;
+		}
+		while (done.load() != writers);
+
+		for (std::thread& t : threads)
+		{
+			t.join();
+		}
+		pass = pass && !torn && profiler.Stats()[fixed].Count == writers * capacity;
+
+		// One event per sample held, and a name for both writer tracks.
+		size_t events = 0, names = 0;
+		if (profiler.WriteChromeTrace(path))
+		{
+			std::string text;
+			if (std::FILE* f = std::fopen(path, "r"))
+			{
+				char buffer[4096];
+				size_t n;
+				while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+				{
+					text.append(buffer, n);
+				}
+				std::fclose(f);
+			}
+
+			for (size_t at = text.find("\"ph\":\"X\""); at != std::string::npos; at = text.find("\"ph\":\"X\"", at + 1))
+			{
+				++events;
+			}
+			for (size_t at = text.find("thread_name"); at != std::string::npos; at = text.find("thread_name", at + 1))
+			{
+				++names;
+			}
+		}
+		std::remove(path);
+		pass = pass && events == (writers + 1) * capacity && names == writers;
+
+		std::printf("profile  p50/p95/p99 %.0f/%.0f/%.0f us of the newest %llu, %zu reads racing %zu writers %s, %zu trace events  %s\n",
+			r.P50, r.P95, r.P99, (unsigned long long)r.Count, reads, writers, torn ? "TORN" : "untorn", events,
+			pass ? "ok" : "FAILED");
+		return pass;
+	}
+
+	// Percentiles stay within the histogram's relative error of the exact
+	// ones, merging halves gives the whole, and StepTimer times real frames.
+	bool VerifyHistogram(const Options&)
+	{
+		const uint64_t n = 100000;
+		WaveHistogram all(1000000, 8), low(1000000, 8), high(1000000, 8);
+		for (uint64_t v = 1; v <= n; ++v)
+		{
+			all.Record(v);
+			(v <= n / 2 ? low : high).Record(v);
+		}
+		low.Merge(high);
+
+		// 8 bits of precision: exact below 256, within 1/128 above.
+		bool pass = all.Count() == n && all.Min() == 1 && all.Max() == n && all.ValueAtPercentile(100.0) == n;
+		double worst = 0.0;
+		for (double p : { 0.1, 1.0, 25.0, 50.0, 90.0, 99.0, 99.9, 99.99 })
+		{
+			const double exact = std::ceil(p / 100.0 * double(n));
+			const double got = double(all.ValueAtPercentile(p));
+			worst = std::max(worst, (got - exact) / exact);
+			pass = pass && got >= exact && low.ValueAtPercentile(p) == all.ValueAtPercentile(p);
+		}
+		pass = pass && worst <= 1.0 / 128.0 && std::fabs(all.Mean() / (0.5 * double(n + 1)) - 1.0) < 1.0 / 256.0;
+
+		WaveHistogram small(1000, 8);
+		for (uint64_t v = 0; v < 256; ++v)
+		{
+			small.Record(v);
+		}
+		small.Record(5000);
+		pass = pass && small.ValueAtPercentile(50.0) == 128 && small.Clamped() == 1 && small.Max() == 1000;
+
+		// 12 frames of 2 ms: 11 frame times (the first Tick ends none), 12 updates, 10 jitters.
+		DX::StepTimer timer;
+		for (int frame = 0; frame < 12; ++frame)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			timer.Tick([]() {});
+		}
+		const WaveHistogram& frames = timer.GetFrameTimes();
+		const bool timerOk = frames.Count() == 11 && timer.GetUpdateTimes().Count() == 12 &&
+			timer.GetFrameJitter().Count() == 10 && frames.Min() >= 2000000;
+		pass = pass && timerOk;
+
+		std::printf("hist     1..%llu worst percentile error %.3f%%, merge exact, clamp ok, StepTimer frames p50 %.2f ms  %s\n",
+			(unsigned long long)n, worst * 100.0, double(frames.ValueAtPercentile(50.0)) * 1e-6, pass ? "ok" : "FAILED");
+		return pass;
+	}
+
+	// The current draws of mesh must cover the grid exactly once: every
+	// triangle turns the same way, the areas add up to the grid's, and every
+	// edge is shared by two triangles in opposite directions unless it lies
+	// on the grid's outline.  That rules out holes, overlaps and T-junctions.
+	bool CheckMesh(const WaveLodMesh& mesh)
+	{
+		const size_t m = mesh.RowCount();
+		const size_t n = mesh.ColumnCount();
+		std::vector<uint64_t> edges;
+		int64_t area = 0;
+		for (const WaveMeshDraw& draw : mesh.Draws())
+		{
+			for (uint32_t k = draw.IndexStart; k < draw.IndexStart + draw.IndexCount; k += 3)
+			{
+				int64_t r[3], c[3];
+				uint64_t v[3];
+				for (int e = 0; e < 3; ++e)
+				{
+					v[e] = uint64_t(int64_t(mesh.Index(k + e)) + draw.BaseVertex);
+					if (v[e] >= m*n)
+					{
+						return false;
+					}
+					r[e] = int64_t(v[e] / n);
+					c[e] = int64_t(v[e] % n);
+				}
+
+				// Twice the area in (column, row) units, positive for the grid's winding.
+				const int64_t doubled = (c[1] - c[0])*(r[2] - r[0]) - (c[2] - c[0])*(r[1] - r[0]);
+				if (doubled <= 0)
+				{
+					return false;
+				}
+				area += doubled;
+
+				for (int e = 0; e < 3; ++e)
+				{
+					edges.push_back(v[e] << 32 | v[(e + 1) % 3]);
+				}
+			}
+		}
+
+		if (area != 2*int64_t(m - 1)*int64_t(n - 1))
+		{
+			return false;
+		}
+
+		std::sort(edges.begin(), edges.end());
+		if (std::adjacent_find(edges.begin(), edges.end()) != edges.end())
+		{
+			return false;
+		}
+
+		for (uint64_t edge : edges)
+		{
+			const uint64_t a = edge >> 32, b = edge & 0xffffffffu;
+			if (!std::binary_search(edges.begin(), edges.end(), b << 32 | a))
+			{
+				const bool outline = (a / n == b / n && (a / n == 0 || a / n == m - 1)) ||
+					(a % n == b % n && (a % n == 0 || a % n == n - 1));
+				if (!outline)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Every level, and level mixes picked from several viewpoints, must
+	// stitch into a closed surface; level 0 must be the full grid.  Wide
+	// grids get short patches to stay in 16-bit indices, until not even one
+	// row fits.
+	bool VerifyMesh(const Options&)
+	{
+		struct Case { size_t Rows, Cols, Patch, Levels, IndexSize; };
+		const Case cases[] = { { 200, 200, 32, 4, 2 }, { 65, 97, 16, 5, 2 }, { 301, 258, 64, 6, 2 }, { 9, 40, 8, 4, 2 },
+			{ 100, 2100, 32, 4, 2 }, { 3, 65530, 8, 2, 4 } };
+
+		bool ok = true;
+		for (const Case& c : cases)
+		{
+			WaveLodMesh mesh;
+			bool pass = mesh.Init(c.Rows, c.Cols, dx, c.Patch, c.Levels) && mesh.IndexSize() == c.IndexSize;
+			pass = pass && mesh.DrawnTriangleCount() == 2*(c.Rows - 1)*(c.Cols - 1) && CheckMesh(mesh);
+
+			for (size_t level = 1; pass && level < mesh.LevelCount(); ++level)
+			{
+				mesh.SetLevel(level);
+				pass = CheckMesh(mesh);
+			}
+
+			size_t mixed = 0;
+			const float width = float(c.Cols - 1)*dx, depth = float(c.Rows - 1)*dx;
+			const float eyes[][3] = { { 0.0f, 1.0f, 0.0f }, { -0.5f*width, 2.0f, 0.5f*depth }, { 0.3f*width, 5.0f, -0.6f*depth } };
+			for (const float* eye : eyes)
+			{
+				for (float detail : { 1.0f, 4.0f, 0.1f*width })
+				{
+					if (!pass)
+					{
+						break;
+					}
+					mesh.SelectLod(eye[0], eye[1], eye[2], detail);
+					pass = CheckMesh(mesh);
+
+					size_t coarsest = 0;
+					for (size_t p = 0; p < mesh.PatchCount(); ++p)
+					{
+						coarsest = std::max(coarsest, mesh.PatchLevel(p));
+					}
+					mixed += coarsest > mesh.PatchLevel(0) || coarsest > mesh.PatchLevel(mesh.PatchCount() - 1) ? 1 : 0;
+				}
+			}
+
+			std::printf("mesh     %zu x %zu, %zu x %zu patches of %zu x %zu, %zu levels, %zu-bit, %zu mixed  %s\n", c.Rows, c.Cols,
+				mesh.PatchRowCount(), mesh.PatchColumnCount(), mesh.PatchRowQuads(), mesh.PatchQuads(), mesh.LevelCount(),
+				8*mesh.IndexSize(), mixed, pass ? "closed" : "FAILED");
+			ok = ok && pass;
+		}
+		return ok;
+	}
+
+	// Every index the current draws of mesh fetch, in draw order, with the
+	// base vertices applied.
+	std::vector<uint32_t> DrawnIndices(const WaveLodMesh& mesh)
+	{
+		std::vector<uint32_t> indices;
+		for (const WaveMeshDraw& draw : mesh.Draws())
+		{
+			for (uint32_t k = draw.IndexStart; k < draw.IndexStart + draw.IndexCount; ++k)
+			{
+				indices.push_back(uint32_t(int64_t(mesh.Index(k)) + draw.BaseVertex));
+			}
+		}
+		return indices;
+	}
+
+	// The triangles of indices, each rotated to start at its smallest
+	// vertex, sorted: equal for two lists that differ only in order.
+	std::vector<uint64_t> TriangleSet(const std::vector<uint32_t>& indices)
+	{
+		std::vector<uint64_t> set;
+		for (size_t k = 0; k + 2 < indices.size(); k += 3)
+		{
+			const uint32_t* t = &indices[k];
+			const size_t lowest = t[0] < t[1] ? (t[0] < t[2] ? 0 : 2) : (t[1] < t[2] ? 1 : 2);
+			set.push_back(uint64_t(t[lowest]) << 42 | uint64_t(t[(lowest + 1) % 3]) << 21 | t[(lowest + 2) % 3]);
+		}
+		std::sort(set.begin(), set.end());
+		return set;
+	}
+
+	// The cache model must tell FIFO from LRU, and reordering must keep
+	// every triangle (and the stitching) while cutting the misses.
+	bool VerifyVertexCache(const Options&)
+	{
+		// Cache of 3: a FIFO cache evicts vertex 0 though it was just used.
+		const uint32_t sequence[] = { 0, 1, 2, 0, 3, 0 };
+		const WaveCacheStats fifo = SimulateVertexCache(sequence, 6, 3, WaveCacheModel::Fifo);
+		const WaveCacheStats lru = SimulateVertexCache(sequence, 6, 3, WaveCacheModel::Lru);
+		bool pass = fifo.Misses == 5 && lru.Misses == 4 && fifo.Vertices == 4 && fifo.Triangles == 2;
+
+		const WaveMeshOrder orders[] = { WaveMeshOrder::RowMajor, WaveMeshOrder::Strips, WaveMeshOrder::Optimized };
+		const char* names[] = { "row-major", "strips", "optimized" };
+		std::vector<uint64_t> triangles;
+		double acmr[3] = {};
+		for (int o = 0; o < 3; ++o)
+		{
+			WaveLodMesh mesh;
+			mesh.SetIndexOrder(orders[o], 16);
+			mesh.Init(201, 201, dx, 32, 4);
+
+			const std::vector<uint32_t> indices = DrawnIndices(mesh);
+			acmr[o] = SimulateVertexCache(indices.data(), indices.size(), 16, WaveCacheModel::Fifo).Acmr();
+			if (o == 0)
+			{
+				triangles = TriangleSet(indices);
+			}
+			pass = pass && TriangleSet(indices) == triangles;
+
+			mesh.SelectLod(0.0f, 1.0f, 0.0f, 4.0f);
+			pass = pass && CheckMesh(mesh);
+		}
+		pass = pass && acmr[1] < 0.65 && acmr[2] < acmr[0];
+
+		std::printf("vcache   FIFO/LRU model ok, 201 x 201 ACMR at 16:");
+		for (int o = 0; o < 3; ++o)
+		{
+			std::printf(" %s %.3f", names[o], acmr[o]);
+		}
+		std::printf("  %s\n", pass ? "ok" : "FAILED");
+		return pass;
+	}
+
+	// Vertex cache misses of the full-resolution mesh in every triangle order,
+	// against the single row-major list the demo drew before patches.
+	int RunCache(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		const size_t m = opt.Rows, n = opt.Cols;
+		const size_t patch = opt.Lod != 0 ? opt.Lod : 32;
+
+		std::printf("grid %zu x %zu, patches of %zu quads, cache of %zu vertices\n", m, n, patch, opt.Cache);
+		std::printf("%-16s %10s %10s %10s %10s %10s\n", "order", "build ms", "FIFO ACMR", "FIFO ATVR", "LRU ACMR", "LRU ATVR");
+
+		auto report = [&](const char* name, const std::vector<uint32_t>& indices, double buildSeconds)
+		{
+			const WaveCacheStats fifo = SimulateVertexCache(indices.data(), indices.size(), opt.Cache, WaveCacheModel::Fifo);
+			const WaveCacheStats lru = SimulateVertexCache(indices.data(), indices.size(), opt.Cache, WaveCacheModel::Lru);
+			std::printf("%-16s %10.2f %10.3f %10.3f %10.3f %10.3f\n", name, buildSeconds * 1e3,
+				fifo.Acmr(), fifo.Atvr(), lru.Acmr(), lru.Atvr());
+		};
+
+		{
+			auto t0 = Clock::now();
+			std::vector<uint32_t> indices;
+			indices.reserve(6*(m - 1)*(n - 1));
+			for (size_t i = 0; i + 1 < m; ++i)
+			{
+				for (size_t j = 0; j + 1 < n; ++j)
+				{
+					const uint32_t quad[] = { uint32_t(i*n + j), uint32_t(i*n + j + 1), uint32_t((i + 1)*n + j),
+						uint32_t((i + 1)*n + j), uint32_t(i*n + j + 1), uint32_t((i + 1)*n + j + 1) };
+					indices.insert(indices.end(), quad, quad + 6);
+				}
+			}
+			report("whole grid", indices, std::chrono::duration<double>(Clock::now() - t0).count());
+		}
+
+		const WaveMeshOrder orders[] = { WaveMeshOrder::RowMajor, WaveMeshOrder::Strips, WaveMeshOrder::Optimized };
+		const char* names[] = { "patch row-major", "patch strips", "patch optimized" };
+		for (int o = 0; o < 3; ++o)
+		{
+			WaveLodMesh mesh;
+			mesh.SetIndexOrder(orders[o], opt.Cache);
+			auto t0 = Clock::now();
+			if (!mesh.Init(m, n, dx, patch))
+			{
+				std::fprintf(stderr, "--lod takes a power of 2\n");
+				return 1;
+			}
+			report(names[o], DrawnIndices(mesh), std::chrono::duration<double>(Clock::now() - t0).count());
+		}
+		return 0;
+	}
+
+	// Level selection for a camera circling the grid at the demo's distance.
+	int RunLod(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		WaveLodMesh mesh;
+		auto t0 = Clock::now();
+		if (!mesh.Init(opt.Rows, opt.Cols, dx, opt.Lod))
+		{
+			std::fprintf(stderr, "--lod takes a power of 2\n");
+			return 1;
+		}
+		const double buildSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+		const float radius = 0.6f*float(std::max(opt.Rows, opt.Cols))*dx;
+		const float detail = 0.25f*radius;
+		const size_t frames = std::max<size_t>(opt.Steps, 1);
+
+		double selectSeconds = 0.0;
+		double triangles = 0.0;
+		for (size_t frame = 0; frame < frames; ++frame)
+		{
+			const float angle = 6.2831853f*float(frame) / float(frames);
+
+			t0 = Clock::now();
+			mesh.SelectLod(radius*std::cos(angle), 0.3f*radius, radius*std::sin(angle), detail);
+			selectSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+			triangles += double(mesh.DrawnTriangleCount());
+		}
+
+		const double full = 2.0*double(opt.Rows - 1)*double(opt.Cols - 1);
+		std::printf("grid          %zu x %zu\n", opt.Rows, opt.Cols);
+		std::printf("patches       %zu x %zu of %zu x %zu quads, %zu levels\n", mesh.PatchRowCount(), mesh.PatchColumnCount(),
+			mesh.PatchRowQuads(), mesh.PatchQuads(), mesh.LevelCount());
+		std::printf("index lists   %.1f KB of %zu-bit indices, built in %.3f ms\n", double(mesh.IndexCount()*mesh.IndexSize()) / 1024.0,
+			8*mesh.IndexSize(), buildSeconds * 1e3);
+		std::printf("select        %.3f us/frame\n", selectSeconds / double(frames) * 1e6);
+		std::printf("triangles     %.0f of %.0f on average (%.1f%%)\n", triangles / double(frames), full,
+			100.0 * triangles / double(frames) / full);
+		return 0;
+	}
+
+	// Right-handed look-at and perspective, multiplied as SimpleMath's
+	// CreateLookAt() * CreatePerspectiveFieldOfView() in the demo: row-major,
+	// for row vectors.
+	void ViewProjection(const float eye[3], const float target[3], float fovY, float aspect, float zNear, float zFar, float out[16])
+	{
+		auto normalize = [](float v[3])
+		{
+			const float length = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		};
+
+		float z[3] = { eye[0] - target[0], eye[1] - target[1], eye[2] - target[2] };
+		normalize(z);
+		float x[3] = { z[2], 0.0f, -z[0] };	// up (0, 1, 0) x z
+		normalize(x);
+		const float y[3] = { z[1]*x[2] - z[2]*x[1], z[2]*x[0] - z[0]*x[2], z[0]*x[1] - z[1]*x[0] };
+
+		const float view[16] = {
+			x[0], y[0], z[0], 0.0f,
+			x[1], y[1], z[1], 0.0f,
+			x[2], y[2], z[2], 0.0f,
+			-(x[0]*eye[0] + x[1]*eye[1] + x[2]*eye[2]), -(y[0]*eye[0] + y[1]*eye[1] + y[2]*eye[2]),
+			-(z[0]*eye[0] + z[1]*eye[1] + z[2]*eye[2]), 1.0f };
+
+		const float h = 1.0f / std::tan(0.5f*fovY);
+		const float range = zFar / (zNear - zFar);
+		const float proj[16] = {
+			h / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, h, 0.0f, 0.0f,
+			0.0f, 0.0f, range, -1.0f,
+			0.0f, 0.0f, range*zNear, 0.0f };
+
+		for (size_t r = 0; r < 4; ++r)
+		{
+			for (size_t c = 0; c < 4; ++c)
+			{
+				out[r*4 + c] = view[r*4]*proj[c] + view[r*4 + 1]*proj[4 + c] + view[r*4 + 2]*proj[8 + c] + view[r*4 + 3]*proj[12 + c];
+			}
+		}
+	}
+
+	// Whether a point lands inside the clip volume of viewProj.
+	bool InClipVolume(const float viewProj[16], float x, float y, float z)
+	{
+		float clip[4];
+		for (size_t c = 0; c < 4; ++c)
+		{
+			clip[c] = x*viewProj[c] + y*viewProj[4 + c] + z*viewProj[8 + c] + viewProj[12 + c];
+		}
+		return std::fabs(clip[0]) <= clip[3] && std::fabs(clip[1]) <= clip[3] && clip[2] >= 0.0f && clip[2] <= clip[3];
+	}
+
+	// Height ranges of every patch of mesh, one vertex at a time.
+	void PatchBounds(const Waves& waves, const WaveLodMesh& mesh, std::vector<float>& lo, std::vector<float>& hi)
+	{
+		lo.assign(mesh.PatchCount(), 0.0f);
+		hi.assign(mesh.PatchCount(), 0.0f);
+		for (size_t patch = 0; patch < mesh.PatchCount(); ++patch)
+		{
+			const WaveMeshPatch p = mesh.Patch(patch);
+			lo[patch] = hi[patch] = waves.Height(p.Row*waves.ColumnCount() + p.Column);
+			for (size_t i = p.Row; i <= p.Row + p.Rows; ++i)
+			{
+				for (size_t j = p.Column; j <= p.Column + p.Columns; ++j)
+				{
+					const float h = waves.Height(i*waves.ColumnCount() + j);
+					lo[patch] = std::min(lo[patch], h);
+					hi[patch] = std::max(hi[patch], h);
+				}
+			}
+		}
+	}
+
+	// Height bounds against a vertex-by-vertex scan, the SSE culler against
+	// the scalar one, and culled patches against projecting every vertex:
+	// a patch with a vertex on screen must never be culled.
+	bool VerifyCuller(const Options&)
+	{
+		bool ok = true;
+
+		struct Case { size_t Rows, Cols, Patch; };
+		const Case cases[] = { { 201, 201, 32 }, { 67, 45, 8 }, { 130, 97, 16 } };
+		for (const Case& c : cases)
+		{
+			Waves waves;
+			waves.Init(c.Rows, c.Cols, dx, dt, speed, damping);
+			waves.Disturb(c.Rows / 3, c.Cols / 2, 1.5f);
+			waves.Disturb(2*c.Rows / 3, c.Cols / 4, -1.0f);
+			for (size_t step = 0; step < 40; ++step)
+			{
+				waves.Update(dt);
+			}
+
+			WaveLodMesh mesh;
+			bool pass = mesh.Init(c.Rows, c.Cols, dx, c.Patch);
+
+			std::vector<float> lo(mesh.PatchCount()), hi(mesh.PatchCount()), expectedLo, expectedHi;
+			waves.HeightBounds(waves.Heights(), waves.RowStride(), mesh.PatchRowQuads(), mesh.PatchQuads(), lo.data(), hi.data());
+			PatchBounds(waves, mesh, expectedLo, expectedHi);
+			pass = pass && lo == expectedLo && hi == expectedHi;
+
+			// From inside the grid, looking along -z: the patches behind go.
+			const float width = float(c.Cols - 1)*dx;
+			const float eye[3] = { 0.1f*width, 0.05f*width, 0.1f*width };
+			const float target[3] = { -0.2f*width, 0.0f, -0.5f*width };
+			float viewProj[16];
+			ViewProjection(eye, target, 0.7853982f, 16.0f / 9.0f, 0.01f, 1000.0f, viewProj);
+			const WaveFrustum frustum = WaveFrustum::FromViewProjection(viewProj);
+
+			WaveCuller culler;
+			culler.SetPatchBoxes(mesh, lo.data(), hi.data());
+			std::vector<uint8_t> visible(mesh.PatchCount()), scalar(mesh.PatchCount());
+			const size_t count = culler.Cull(frustum, visible.data());
+			pass = pass && culler.CullScalar(frustum, scalar.data()) == count && visible == scalar;
+			pass = pass && count > 0 && count < mesh.PatchCount();
+
+			for (size_t patch = 0; pass && patch < mesh.PatchCount(); ++patch)
+			{
+				const WaveMeshPatch p = mesh.Patch(patch);
+				for (size_t i = p.Row; !visible[patch] && i <= p.Row + p.Rows; ++i)
+				{
+					for (size_t j = p.Column; j <= p.Column + p.Columns; ++j)
+					{
+						const DirectX::XMFLOAT3 v = waves[int(i*c.Cols + j)];
+						pass = pass && !InClipVolume(viewProj, v.x, v.y, v.z);
+					}
+				}
+			}
+
+			// Writing the visible patches writes what the full write would
+			// there and nothing else.
+			std::vector<BenchVertex> full(waves.VertexCount()), partial(waves.VertexCount());
+			std::memset(partial.data(), 0xcd, partial.size() * sizeof(BenchVertex));
+			waves.WriteVertices(waves.Heights(), waves.RowStride(), MakeSink(full));
+
+			std::vector<uint8_t> covered(waves.VertexCount(), 0);
+			for (size_t patch = 0; patch < mesh.PatchCount(); ++patch)
+			{
+				if (visible[patch])
+				{
+					const WaveMeshPatch p = mesh.Patch(patch);
+					waves.WriteVertices(waves.Heights(), waves.RowStride(), MakeSink(partial), p.Row, p.Row + p.Rows + 1, p.Column, p.Column + p.Columns + 1);
+					for (size_t i = p.Row; i <= p.Row + p.Rows; ++i)
+					{
+						std::fill(&covered[i*c.Cols + p.Column], &covered[i*c.Cols + p.Column + p.Columns] + 1, uint8_t(1));
+					}
+				}
+			}
+
+			BenchVertex untouched;
+			std::memset(&untouched, 0xcd, sizeof(untouched));
+			for (size_t v = 0; pass && v < full.size(); ++v)
+			{
+				const BenchVertex& want = covered[v] ? full[v] : untouched;
+				pass = std::memcmp(&want, &partial[v], sizeof(BenchVertex)) == 0;
+			}
+
+			std::printf("cull     %zu x %zu, patches of %zu: %zu of %zu visible  %s\n", c.Rows, c.Cols, c.Patch, count,
+				mesh.PatchCount(), pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+
+		// Boxes in every direction around the eye, a count that leaves a
+		// partial batch.
+		{
+			const float eye[3] = { 0.0f, 10.0f, 0.0f };
+			const float target[3] = { 0.0f, 0.0f, -50.0f };
+			float viewProj[16];
+			ViewProjection(eye, target, 0.7853982f, 1.5f, 0.1f, 200.0f, viewProj);
+			const WaveFrustum frustum = WaveFrustum::FromViewProjection(viewProj);
+
+			std::mt19937 rng(24);
+			std::uniform_real_distribution<float> position(-300.0f, 300.0f), extent(0.0f, 20.0f);
+
+			WaveCuller culler;
+			culler.Resize(1003);
+			for (size_t b = 0; b < culler.Count(); ++b)
+			{
+				const float center[3] = { position(rng), 0.1f*position(rng), position(rng) };
+				const float half[3] = { extent(rng), extent(rng), extent(rng) };
+				const float minCorner[3] = { center[0] - half[0], center[1] - half[1], center[2] - half[2] };
+				const float maxCorner[3] = { center[0] + half[0], center[1] + half[1], center[2] + half[2] };
+				culler.SetBox(b, minCorner, maxCorner);
+			}
+
+			std::vector<uint8_t> visible(culler.Count()), scalar(culler.Count());
+			const size_t count = culler.Cull(frustum, visible.data());
+			bool pass = culler.CullScalar(frustum, scalar.data()) == count && visible == scalar;
+
+			// In front, behind, beyond the far plane and off to the side.
+			const float boxes[4][6] = {
+				{ -1.0f, -1.0f, -51.0f, 1.0f, 1.0f, -49.0f },
+				{ -1.0f, 9.0f, 10.0f, 1.0f, 11.0f, 12.0f },
+				{ -1.0f, -1.0f, -260.0f, 1.0f, 1.0f, -250.0f },
+				{ 100.0f, -1.0f, -51.0f, 102.0f, 1.0f, -49.0f } };
+			const uint8_t expected[4] = { 1, 0, 0, 0 };
+			culler.Resize(4);
+			for (size_t b = 0; b < 4; ++b)
+			{
+				culler.SetBox(b, &boxes[b][0], &boxes[b][3]);
+			}
+			uint8_t known[4];
+			culler.Cull(frustum, known);
+			pass = pass && std::memcmp(known, expected, sizeof(known)) == 0;
+
+			std::printf("cull     SSE and scalar agree on %zu boxes (%zu visible), known boxes  %s\n", visible.size(), count,
+				pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+
+		// Snapshots carry the bounds Waves::HeightBounds() gives.
+		{
+			WaveSimThread sim;
+			sim.SetTimeScale(0.0f);
+			sim.Solver().Init(64, 96, dx, dt, speed, damping);
+			sim.Solver().Disturb(30, 40, 1.5f);
+			sim.SetHeightBounds(16, 32);
+
+			sim.Start();
+			const WaveSnapshot* snapshot = nullptr;
+			while (!(snapshot = sim.AcquireSnapshot()))
+			{
+				std::this_thread::yield();
+			}
+			sim.Stop();
+
+			std::vector<float> lo(4*3), hi(4*3);
+			sim.Solver().HeightBounds(snapshot->Heights.data(), snapshot->RowStride, 16, 32, lo.data(), hi.data());
+			const bool pass = snapshot->MinHeights == lo && snapshot->MaxHeights == hi;
+			std::printf("cull     snapshot height bounds  %s\n", pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+		return ok;
+	}
+
+	// Culling for a camera low over the grid, circling inside it and looking
+	// out, as when zoomed in on the demo: bounds, cull and the partial write
+	// against writing every vertex.
+	int RunCull(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		const size_t m = opt.Rows, n = opt.Cols;
+		WaveLodMesh mesh;
+		if (!mesh.Init(m, n, dx, opt.Lod != 0 ? opt.Lod : 32))
+		{
+			std::fprintf(stderr, "--lod takes a power of 2\n");
+			return 1;
+		}
+
+		Waves waves;
+		waves.Init(m, n, dx, dt, speed, damping);
+		std::mt19937 rng(7);
+		for (size_t k = 0; k < 16; ++k)
+		{
+			waves.Disturb(1 + rng() % (m - 2), 1 + rng() % (n - 2), 1.5f);
+		}
+		for (size_t step = 0; step < 50; ++step)
+		{
+			waves.Update(dt);
+		}
+
+		std::vector<BenchVertex> vertices(waves.VertexCount());
+		const WaveOutputSink sink = MakeSink(vertices);
+		std::vector<float> lo(mesh.PatchCount()), hi(mesh.PatchCount());
+		std::vector<uint8_t> visible(mesh.PatchCount());
+		WaveCuller culler;
+
+		const float size = float(std::max(m, n) - 1)*dx;
+		const size_t frames = std::max<size_t>(opt.Steps, 1);
+		double boundsSeconds = 0.0, boxSeconds = 0.0, cullSeconds = 0.0, scalarSeconds = 0.0, writeSeconds = 0.0, fullSeconds = 0.0;
+		double visibleSum = 0.0;
+
+		for (size_t frame = 0; frame < frames; ++frame)
+		{
+			const float angle = 6.2831853f*float(frame) / float(frames);
+			const float eye[3] = { 0.25f*size*std::cos(angle), 0.05f*size, 0.25f*size*std::sin(angle) };
+			const float target[3] = { 2.0f*eye[0], 0.0f, 2.0f*eye[2] };
+			float viewProj[16];
+			ViewProjection(eye, target, 0.7853982f, 16.0f / 9.0f, 0.01f, 1000.0f, viewProj);
+
+			auto t0 = Clock::now();
+			waves.HeightBounds(waves.Heights(), waves.RowStride(), mesh.PatchRowQuads(), mesh.PatchQuads(), lo.data(), hi.data());
+			auto t1 = Clock::now();
+			culler.SetPatchBoxes(mesh, lo.data(), hi.data());
+			auto t1b = Clock::now();
+			const WaveFrustum frustum = WaveFrustum::FromViewProjection(viewProj);
+			const size_t count = culler.Cull(frustum, visible.data());
+			auto t2 = Clock::now();
+			culler.CullScalar(frustum, visible.data());
+			auto t3 = Clock::now();
+			for (size_t patch = 0; patch < mesh.PatchCount(); ++patch)
+			{
+				if (visible[patch])
+				{
+					const WaveMeshPatch p = mesh.Patch(patch);
+					waves.WriteVertices(waves.Heights(), waves.RowStride(), sink, p.Row, p.Row + p.Rows + 1, p.Column, p.Column + p.Columns + 1);
+				}
+			}
+			auto t4 = Clock::now();
+			waves.WriteVertices(waves.Heights(), waves.RowStride(), sink);
+			auto t5 = Clock::now();
+
+			boundsSeconds += std::chrono::duration<double>(t1 - t0).count();
+			boxSeconds += std::chrono::duration<double>(t1b - t1).count();
+			cullSeconds += std::chrono::duration<double>(t2 - t1b).count();
+			scalarSeconds += std::chrono::duration<double>(t3 - t2).count();
+			writeSeconds += std::chrono::duration<double>(t4 - t3).count();
+			fullSeconds += std::chrono::duration<double>(t5 - t4).count();
+			visibleSum += double(count);
+		}
+
+		const double perFrame = 1e6 / double(frames);
+		std::printf("grid          %zu x %zu\n", m, n);
+		std::printf("patches       %zu x %zu of %zu x %zu quads\n", mesh.PatchRowCount(), mesh.PatchColumnCount(),
+			mesh.PatchRowQuads(), mesh.PatchQuads());
+		std::printf("visible       %.1f of %zu on average (%.1f%%)\n", visibleSum / double(frames), mesh.PatchCount(),
+			100.0 * visibleSum / double(frames) / double(mesh.PatchCount()));
+		std::printf("bounds        %.2f us/frame heights, %.2f us/frame boxes\n", boundsSeconds * perFrame, boxSeconds * perFrame);
+		std::printf("cull          %.2f us/frame (scalar %.2f)\n", cullSeconds * perFrame, scalarSeconds * perFrame);
+		std::printf("write         %.2f us/frame visible patches, %.2f us/frame every vertex\n", writeSeconds * perFrame,
+			fullSeconds * perFrame);
+		return 0;
+	}
+
+	// One step of CS_Wave_gpu.hlsl over a whole width x height texture,
+	// written out serially: every texel, with zero outside.
+	void ReferenceComputeStep(const WaveConstants& k, const std::vector<float>& prev, const std::vector<float>& curr,
+		std::vector<float>& next, int width, int height)
+	{
+		auto load = [&](const std::vector<float>& plane, int x, int y)
+		{
+			return x >= 0 && x < width && y >= 0 && y < height ? plane[size_t(y)*width + x] : 0.0f;
+		};
+
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				next[size_t(y)*width + x] = k.K1*load(prev, x, y) + k.K2*load(curr, x, y) +
+					k.K3*(load(curr, x, y + 1) + load(curr, x, y - 1) + load(curr, x + 1, y) + load(curr, x - 1, y));
+			}
+		}
+	}
+
+	// Dispatch coverage and ids, ComputeWaves against a serial reference of
+	// the shaders on sizes that are no multiple of 16, and against Waves
+	// while the waves are still away from the edges (which only the shader
+	// updates).
+	bool VerifyCompute(const Options&)
+	{
+		bool ok = true;
+
+		// Every texel of the demo's 200 x 200 texture is written once and
+		// told its own ids; 200 / 16 groups would stop at 192.
+		{
+			WaveComputeDevice device(4);
+			const uint32_t size = 200;
+			const uint32_t groups = WaveComputeDevice::GroupCount(size, 16);
+
+			std::vector<float> plane(size_t(size)*size, 0.0f);
+			const WaveTextureView view(plane.data(), size, size, size);
+			std::atomic<uint32_t> wrongIds(0);
+			device.Dispatch(groups, groups, 1, WaveGroupSize{ 16, 16, 1 }, [&](const WaveThreadIds& id)
+			{
+				for (size_t k = 0; k < 2; ++k)
+				{
+					if (id.DispatchThread[k] != id.Group[k]*16 + id.GroupThread[k] || id.GroupThread[k] >= 16)
+					{
+						wrongIds.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+				const int x = int(id.DispatchThread[0]), y = int(id.DispatchThread[1]);
+				view.Store(x, y, view.Load(x, y) + 1.0f);
+			});
+
+			bool pass = groups == 13 && wrongIds.load() == 0;
+			pass = pass && std::all_of(plane.begin(), plane.end(), [](float v) { return v == 1.0f; });
+			std::printf("compute  200 x 200 in %u x %u groups of 16 x 16: every texel once  %s\n", groups, groups,
+				pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+
+		struct Case { uint32_t Width, Height; size_t Threads; };
+		const Case cases[] = { { 67, 45, 1 }, { 67, 45, 4 }, { 200, 200, 0 }, { 33, 129, 3 } };
+		for (const Case& c : cases)
+		{
+			ComputeWaves waves(c.Threads);
+			waves.Init(c.Width, c.Height, dx, dt, speed, damping);
+
+			const size_t texels = size_t(c.Width)*c.Height;
+			std::vector<float> prev(texels, 0.0f), curr(texels, 0.0f), next(texels, 0.0f);
+
+			// Inside, and on the edge where some of the stamp falls outside.
+			const int disturbs[3][2] = { { int(c.Width) / 2, int(c.Height) / 3 }, { 0, 3 }, { int(c.Width) - 1, int(c.Height) - 1 } };
+
+			bool pass = true;
+			for (size_t step = 0; pass && step < 60; ++step)
+			{
+				if (step % 20 == 0)
+				{
+					const int x = disturbs[step / 20][0], y = disturbs[step / 20][1];
+					waves.Disturb(x, y, 1.5f);
+
+					const int stamp[5][2] = { { 0, 0 }, { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+					for (const auto& d : stamp)
+					{
+						const int sx = x + d[0], sy = y + d[1];
+						if (sx >= 0 && sx < int(c.Width) && sy >= 0 && sy < int(c.Height))
+						{
+							curr[size_t(sy)*c.Width + sx] += d[0] == 0 && d[1] == 0 ? 1.5f : 0.75f;
+						}
+					}
+				}
+
+				waves.Update();
+				ReferenceComputeStep(waves.Constants(), prev, curr, next, int(c.Width), int(c.Height));
+				std::swap(prev, curr);
+				std::swap(curr, next);
+
+				pass = std::memcmp(waves.Current().Data(), curr.data(), texels*sizeof(float)) == 0 &&
+					std::memcmp(waves.Previous().Data(), prev.data(), texels*sizeof(float)) == 0;
+			}
+
+			std::printf("compute  %u x %u on %zu threads, 60 steps: matches the serial shader  %s\n", c.Width, c.Height,
+				waves.ThreadCount(), pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+
+		// Until the waves reach the edges both are the same stencil on the
+		// same constants.
+		{
+			const size_t m = 64, n = 80;
+			Waves reference;
+			reference.Init(m, n, dx, dt, speed, damping);
+			reference.SetKernel(WaveKernelIsa::Scalar);
+			reference.Disturb(32, 40, 1.5f);
+
+			ComputeWaves waves(2);
+			waves.Init(uint32_t(n), uint32_t(m), dx, dt, speed, damping);
+			waves.Disturb(40, 32, 1.5f);
+
+			bool pass = true;
+			for (size_t step = 0; step < 20; ++step)
+			{
+				reference.Advance(1);
+				waves.Update();
+			}
+			for (size_t i = 0; i < m; ++i)
+			{
+				pass = pass && std::memcmp(reference.Heights() + i*reference.RowStride(), waves.Current().Data() + i*n, n*sizeof(float)) == 0;
+			}
+			std::printf("compute  %zu x %zu, 20 steps: matches Waves  %s\n", m, n, pass ? "ok" : "FAILED");
+			ok = ok && pass;
+		}
+		return ok;
+	}
+
+	// The GPU mode's algorithm on CPU threads against the CPU mode's solver,
+	// both with --threads T, a disturbance every --disturb-every steps.
+	int RunCompute(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		const size_t m = opt.Rows, n = opt.Cols;
+		if (m < 5 || n < 5)
+		{
+			std::fprintf(stderr, "--compute needs a grid of at least 5 x 5\n");
+			return 1;
+		}
+
+		ComputeWaves compute(opt.Threads);
+		compute.Init(uint32_t(n), uint32_t(m), dx, dt, speed, damping);
+
+		Waves waves;
+		waves.Init(m, n, dx, dt, speed, damping);
+		waves.SetThreadCount(opt.Threads);
+
+		auto time = [&](auto disturb, auto update)
+		{
+			std::mt19937 rng(11);
+			auto t0 = Clock::now();
+			for (size_t step = 0; step < opt.Steps; ++step)
+			{
+				if (opt.DisturbEvery != 0 && step % opt.DisturbEvery == 0)
+				{
+					disturb(2 + rng() % (m - 4), 2 + rng() % (n - 4));
+				}
+				update();
+			}
+			return std::chrono::duration<double>(Clock::now() - t0).count() / double(std::max<size_t>(opt.Steps, 1)) * 1e6;
+		};
+
+		const double computeUs = time([&](size_t i, size_t j) { compute.Disturb(int(j), int(i), 1.5f); }, [&]() { compute.Update(); });
+		const double wavesUs = time([&](size_t i, size_t j) { waves.Disturb(i, j, 1.5f); }, [&]() { waves.Advance(1); });
+
+		const double cells = double(m)*double(n);
+		std::printf("grid          %zu x %zu, %u x %u groups of 16 x 16\n", m, n, compute.GroupsX(), compute.GroupsY());
+		std::printf("threads       %zu\n", compute.ThreadCount());
+		std::printf("ComputeWaves  %.2f us/step, %.1f Mcells/s\n", computeUs, cells / computeUs);
+		std::printf("Waves         %.2f us/step, %.1f Mcells/s (%s kernel)\n", wavesUs, cells / wavesUs,
+			WaveKernelIsaName(waves.Kernel()));
+		return 0;
+	}
+
+	// Prints every phase of profiler and writes its trace to path.
+	bool ReportProfile(const WaveProfiler& profiler, const char* path)
+	{
+		std::printf("%-13s %8s %10s %10s %10s %10s\n", "phase", "count", "p50 us", "p95 us", "p99 us", "max us");
+		for (const WavePhaseStats& phase : profiler.Stats())
+		{
+			if (phase.Count != 0)
+			{
+				std::printf("%-13s %8llu %10.2f %10.2f %10.2f %10.2f\n", phase.Name.c_str(), (unsigned long long)phase.Count,
+					phase.P50, phase.P95, phase.P99, phase.Max);
+			}
+		}
+
+		if (!profiler.WriteChromeTrace(path))
+		{
+			std::fprintf(stderr, "could not write '%s'\n", path);
+			return false;
+		}
+		std::printf("trace         %s\n", path);
+		return true;
+	}
+
+	template<size_t S>
+	void CompareStatic(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		StaticWaves<S, S> fixed;
+		fixed.Init(dx, dt, speed, damping);
+
+		Waves waves;
+		waves.Init(S, S, dx, dt, speed, damping);
+		waves.SetThreadCount(opt.Threads);
+
+		Waves scalar;
+		scalar.Init(S, S, dx, dt, speed, damping);
+		scalar.SetKernel(WaveKernelIsa::Scalar);
+
+		fixed.Disturb(S/2, S/2, 1.5f);
+		waves.Disturb(S/2, S/2, 1.5f);
+		scalar.Disturb(S/2, S/2, 1.5f);
+
+		auto time = [&](auto& grid)
+		{
+			auto t0 = Clock::now();
+			for (size_t step = 0; step < opt.Steps; ++step)
+			{
+				grid.Update(dt);
+			}
+			return std::chrono::duration<double>(Clock::now() - t0).count() / double(std::max<size_t>(opt.Steps, 1)) * 1e6;
+		};
+
+		const double fixedUs = time(fixed);
+		const double wavesUs = time(waves);
+		const double scalarUs = time(scalar);
+
+		const bool same = SameHeights(fixed, waves);
+		std::printf("%6zu %14.2f %14.2f %14.2f %8.2fx  %s\n", S, fixedUs, wavesUs, scalarUs, scalarUs / fixedUs,
+			same ? "identical" : "DIFFERENT");
+	}
+
+	int RunStatic(const Options& opt)
+	{
+		std::printf("us/step; Waves uses the %s kernel\n", WaveKernelIsaName(DetectWaveKernelIsa()));
+		std::printf("%6s %14s %14s %14s %9s\n", "size", "StaticWaves", "Waves", "Waves scalar", "vs scalar");
+		CompareStatic<256>(opt);
+		CompareStatic<512>(opt);
+		CompareStatic<1024>(opt);
+		return 0;
+	}
+
+	// Size of grid g in a mixed batch: cycles through N, N/2 and N/4.
+	size_t BatchGridSize(size_t n, size_t g)
+	{
+		return std::max<size_t>(n >> (g % 3), 16);
+	}
+
+	// A WaveBatch must produce exactly what its grids would on their own.
+	bool VerifyBatch(const Options& opt)
+	{
+		const size_t grids = 5;
+		const size_t steps = 40;
+
+		WaveBatch batch(std::max<size_t>(opt.Threads, 4));
+		std::vector<std::unique_ptr<Waves>> single;
+
+		for (size_t g = 0; g < grids; ++g)
+		{
+			size_t m = BatchGridSize(opt.Rows, g) + g;
+			size_t n = BatchGridSize(opt.Cols, g + 1);
+
+			// Different damping per grid: constants must not leak between grids.
+			float gridDamping = damping * float(g + 1);
+
+			batch.Add(m, n, dx, dt, speed, gridDamping);
+			single.push_back(std::make_unique<Waves>());
+			single.back()->Init(m, n, dx, dt, speed, gridDamping);
+		}
+
+		for (size_t step = 0; step < steps; ++step)
+		{
+			if (step % 5 == 0)
+			{
+				for (size_t g = 0; g < grids; ++g)
+				{
+					size_t i = 3 + (step + g) % (single[g]->RowCount() - 6);
+					size_t j = 3 + (step * 3 + g) % (single[g]->ColumnCount() - 6);
+					batch[g].Disturb(i, j, 1.0f);
+					single[g]->Disturb(i, j, 1.0f);
+				}
+			}
+
+			// Uneven frame times exercise grids taking different substep counts.
+			float frame = (step % 3 == 0) ? 2.5f * dt : 0.5f * dt;
+			batch.Update(frame);
+			for (size_t g = 0; g < grids; ++g)
+			{
+				single[g]->Update(frame);
+			}
+		}
+
+		bool pass = true;
+		for (size_t g = 0; g < grids; ++g)
+		{
+			pass = pass && SameHeights(batch[g], *single[g]);
+		}
+
+		std::printf("batch    %zu grids, %zu threads vs separate Update  %s\n", grids, batch.ThreadCount(), pass ? "bit-identical" : "FAILED");
+		return pass;
+	}
+
+	int RunBatch(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		WaveBatch batch(opt.Threads);
+
+		double cells = 0.0;
+		for (size_t g = 0; g < opt.Grids; ++g)
+		{
+			size_t m = BatchGridSize(opt.Rows, g);
+			size_t n = BatchGridSize(opt.Cols, g);
+			batch.Add(m, n, dx, dt, speed, damping);
+			cells += double(m - 2) * double(n - 2);
+		}
+
+		std::mt19937 rng(1234);
+		double updateSeconds = 0.0;
+
+		for (size_t step = 0; step < opt.Steps; ++step)
+		{
+			if (opt.DisturbEvery != 0 && step % opt.DisturbEvery == 0)
+			{
+				for (size_t g = 0; g < batch.Count(); ++g)
+				{
+					size_t i = 5 + rng() % (batch[g].RowCount() - 10);
+					size_t j = 5 + rng() % (batch[g].ColumnCount() - 10);
+					batch[g].Disturb(i, j, 1.5f);
+				}
+			}
+
+			auto t0 = Clock::now();
+			batch.Update(dt);
+			updateSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+		}
+
+		const double steps = double(opt.Steps);
+
+		std::printf("grids         %zu (mixed %zu, %zu, %zu)\n", opt.Grids,
+			BatchGridSize(opt.Rows, 0), BatchGridSize(opt.Rows, 1), BatchGridSize(opt.Rows, 2));
+		std::printf("threads       %zu\n", batch.ThreadCount());
+		std::printf("steps         %zu\n", opt.Steps);
+		std::printf("update        %.3f us/step (all grids)\n", steps > 0 ? updateSeconds / steps * 1e6 : 0.0);
+		std::printf("throughput    %.1f Mcell/s\n", updateSeconds > 0 ? cells * steps / updateSeconds * 1e-6 : 0.0);
+
+		return 0;
+	}
+
+	// The solver runs flat out on its own thread; this thread plays the
+	// renderer, taking the newest snapshot opt.Async times a second.
+	int RunAsync(const Options& opt)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		WaveProfiler profiler;
+		const uint32_t fillPhase = profiler.AddPhase("fill");
+		profiler.SetThreadName("render");
+
+		WaveSimThread sim;
+		sim.SetTimeScale(0.0f);
+		sim.SetProfiler(opt.Profile ? &profiler : nullptr);
+		sim.Solver().SetThreadCount(opt.Threads);
+		sim.Solver().Init(opt.Rows, opt.Cols, dx, dt, speed, damping);
+
+		std::vector<BenchVertex> vertices(sim.Solver().VertexCount());
+		const WaveOutputSink sink = MakeSink(vertices);
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> rowDist(5.0f, float(opt.Rows - 6));
+		std::uniform_real_distribution<float> colDist(5.0f, float(opt.Cols - 6));
+
+		const auto frame = std::chrono::duration<double>(1.0 / double(opt.Async));
+
+		size_t frames = 0;
+		double fillSeconds = 0.0;
+		double ageSeconds = 0.0;
+		double ageSteps = 0.0;
+
+		// Ticks once per frame, like the demo's, for its frame time and jitter histograms.
+		DX::StepTimer timer;
+
+		auto start = Clock::now();
+		sim.Start();
+
+		while (sim.Stats().Steps < opt.Steps)
+		{
+			std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(frame * double(frames + 1)));
+
+			timer.Tick([&]()
+			{
+				if (opt.DisturbEvery != 0 && frames % opt.DisturbEvery == 0)
+				{
+					sim.QueueDisturbance(rowDist(rng), colDist(rng), 2.0f, 1.5f);
+				}
+
+				auto t0 = Clock::now();
+				const WaveSnapshot* snapshot = sim.AcquireSnapshot();
+				if (snapshot)
+				{
+					const WaveSnapshotAge age = sim.Age(*snapshot);
+					ageSeconds += age.Seconds;
+					ageSteps += double(age.Steps);
+
+					WaveProfileScope scope(opt.Profile ? &profiler : nullptr, fillPhase);
+					sim.WriteVertices(*snapshot, sink);
+				}
+				fillSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+			});
+			++frames;
+		}
+
+		sim.Stop();
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		const WaveSimStats stats = sim.Stats();
+
+		const double interior = double(opt.Rows - 2) * double(opt.Cols - 2);
+		const double n = frames > 0 ? double(frames) : 1.0;
+
+		std::printf("grid          %zu x %zu\n", opt.Rows, opt.Cols);
+		std::printf("threads       %zu + render\n", sim.Solver().ThreadCount());
+		std::printf("steps         %llu in %.3f s (%.0f steps/s)\n", (unsigned long long)stats.Steps, seconds, double(stats.Steps) / seconds);
+		std::printf("throughput    %.1f Mcell/s\n", interior * double(stats.Steps) / seconds * 1e-6);
+		std::printf("frames        %zu at %zu Hz\n", frames, opt.Async);
+		std::printf("snapshots     %llu published, %llu never read\n", (unsigned long long)stats.Snapshots, (unsigned long long)stats.SkippedSnapshots);
+		std::printf("snapshot age  %.3f ms, %.1f steps on average\n", ageSeconds / n * 1e3, ageSteps / n);
+		std::printf("frame fill    %.3f us\n", fillSeconds / n * 1e6);
+		timer.GetFrameTimes().Print(stdout, "frame ms", 1e6);
+		timer.GetFrameJitter().Print(stdout, "jitter ms", 1e6);
+
+		if (opt.Profile && !ReportProfile(profiler, opt.Profile))
+		{
+			return 1;
+		}
+		return 0;
+	}
+
+	double Checksum(const Waves& waves)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < waves.VertexCount(); ++i)
+		{
+			sum += waves.Height(i);
+		}
+		return sum;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!ParseOptions(argc, argv, opt))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (opt.Verify)
+	{
+		bool kernelsOk = VerifyKernels(opt);
+		bool threadsOk = VerifyThreads(opt);
+		bool clockOk = VerifyClock(opt);
+		bool advanceOk = VerifyAdvance(opt);
+		bool batchOk = VerifyBatch(opt);
+		bool halfOk = VerifyHalfKernels(opt);
+		bool sinkOk = VerifySink(opt);
+		bool gradientOk = VerifyGradients(opt);
+		bool sparseOk = VerifySparse(opt);
+		bool queueOk = VerifyDisturbances(opt);
+		bool staticOk = VerifyStatic(opt);
+		bool allocOk = VerifyAllocator(opt);
+		bool simThreadOk = VerifySimThread(opt);
+		bool checkpointOk = VerifyCheckpoint(opt);
+		bool recordOk = VerifyRecording(opt);
+		bool profileOk = VerifyProfiler(opt);
+		bool histogramOk = VerifyHistogram(opt);
+		bool meshOk = VerifyMesh(opt);
+		bool cacheOk = VerifyVertexCache(opt);
+		bool cullOk = VerifyCuller(opt);
+		bool computeOk = VerifyCompute(opt);
+		return kernelsOk && threadsOk && clockOk && advanceOk && batchOk && halfOk && sinkOk && gradientOk && sparseOk && queueOk && staticOk && allocOk
+			&& simThreadOk && checkpointOk && recordOk && profileOk && histogramOk && meshOk && cacheOk && cullOk && computeOk ? 0 : 1;
+	}
+
+	if (opt.Half)
+	{
+		return RunHalf(opt);
+	}
+
+	if (opt.Grids != 0)
+	{
+		return RunBatch(opt);
+	}
+
+	if (opt.Static)
+	{
+		return RunStatic(opt);
+	}
+
+	if (opt.Async != 0)
+	{
+		return RunAsync(opt);
+	}
+
+	if (opt.Cache != 0)
+	{
+		return RunCache(opt);
+	}
+
+	if (opt.Cull)
+	{
+		return RunCull(opt);
+	}
+
+	if (opt.Compute)
+	{
+		return RunCompute(opt);
+	}
+
+	if (opt.Lod != 0)
+	{
+		return RunLod(opt);
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	Waves waves;
+	WaveHeapAllocator allocator(opt.HugePages);
+	waves.SetAllocator(&allocator);
+
+	if (opt.Kernel)
+	{
+		WaveKernelIsa isa;
+		if (!FindKernel(opt.Kernel, isa) || !waves.SetKernel(isa))
+		{
+			std::fprintf(stderr, "kernel '%s' is not available on this machine\n", opt.Kernel);
+			return 1;
+		}
+	}
+
+	waves.SetThreadCount(opt.Threads);
+	waves.SetActivityTracking(opt.Sparse);
+
+	auto initStart = Clock::now();
+	waves.Init(opt.Rows, opt.Cols, dx, dt, speed, damping);
+	double initSeconds = std::chrono::duration<double>(Clock::now() - initStart).count();
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<size_t> rowDist(5, opt.Rows - 6);
+	std::uniform_int_distribution<size_t> colDist(5, opt.Cols - 6);
+	std::uniform_real_distribution<float> magDist(1.0f, 2.0f);
+	std::uniform_real_distribution<float> rainRow(1.0f, float(opt.Rows - 2));
+	std::uniform_real_distribution<float> rainCol(1.0f, float(opt.Cols - 2));
+	std::uniform_real_distribution<float> rainRadius(1.0f, 3.0f);
+
+	double disturbSeconds = 0.0;
+	double updateSeconds = 0.0;
+	double activeTiles = 0.0;
+
+	const bool copyFill = opt.Fill && std::strcmp(opt.Fill, "copy") == 0;
+	const bool sinkFill = opt.Fill && std::strcmp(opt.Fill, "sink") == 0;
+	std::vector<BenchVertex> vertices(opt.Fill ? waves.VertexCount() : 0);
+	const bool gradients = opt.Fill && opt.Gradients;
+	std::vector<float> gradientX(gradients ? waves.VertexCount() : 0);
+	std::vector<float> gradientZ(gradients ? waves.VertexCount() : 0);
+	WaveOutputSink sink = MakeSink(vertices);
+	if (gradients)
+	{
+		sink.GradientX = gradientX.data();
+		sink.GradientZ = gradientZ.data();
+	}
+
+	const size_t chunk = opt.Advance != 0 ? opt.Advance : 1;
+	size_t nextDisturb = 0;
+
+	WaveRecorder recorder;
+	if (opt.Record && !recorder.Open(opt.Record, waves, opt.RecordEvery))
+	{
+		std::fprintf(stderr, "could not create recording '%s'\n", opt.Record);
+		return 1;
+	}
+	double recordSeconds = 0.0;
+
+	WaveProfiler profiler;
+	WaveProfiler* profile = opt.Profile ? &profiler : nullptr;
+	const uint32_t disturbPhase = profiler.AddPhase("disturb");
+	const uint32_t updatePhase = profiler.AddPhase(copyFill ? "update+copy" : "update");
+	const uint32_t recordPhase = profiler.AddPhase("record");
+	profiler.SetThreadName("solver");
+
+	for (size_t step = 0; step < opt.Steps; step += chunk)
+	{
+		const size_t count = std::min(chunk, opt.Steps - step);
+
+		if (opt.DisturbEvery != 0 && step >= nextDisturb)
+		{
+			nextDisturb = step + opt.DisturbEvery;
+
+			size_t i = rowDist(rng);
+			size_t j = colDist(rng);
+			float r = magDist(rng);
+
+			WaveProfileScope scope(profile, disturbPhase);
+			auto t0 = Clock::now();
+			waves.Disturb(i, j, r);
+			disturbSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+		}
+
+		if (opt.Rain != 0)
+		{
+			WaveProfileScope scope(profile, disturbPhase);
+			auto t0 = Clock::now();
+			for (size_t k = 0; k < opt.Rain; ++k)
+			{
+				waves.QueueDisturbance(rainRow(rng), rainCol(rng), rainRadius(rng), 0.05f);
+			}
+			waves.ApplyDisturbances();
+			disturbSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+		}
+
+		auto t0 = Clock::now();
+		{
+			WaveProfileScope scope(profile, updatePhase);
+			if (opt.Advance != 0)
+			{
+				sinkFill ? waves.Advance(count, sink) : waves.Advance(count);
+			}
+			else
+			{
+				sinkFill ? (void)waves.Update(dt, sink) : (void)waves.Update(dt);
+			}
+			if (copyFill)
+			{
+				CopyVertices(waves, vertices);
+				if (gradients)
+				{
+					CopyGradients(waves, gradientX, gradientZ);
+				}
+			}
+		}
+		updateSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+		activeTiles += double(waves.ActiveTileCount()) * double(count);
+
+		if (opt.Record)
+		{
+			WaveProfileScope scope(profile, recordPhase);
+			t0 = Clock::now();
+			recorder.Record(waves, count);
+			recordSeconds += std::chrono::duration<double>(Clock::now() - t0).count();
+		}
+	}
+
+	const double interior = double(opt.Rows - 2) * double(opt.Cols - 2);
+	const double steps = double(opt.Steps);
+
+	std::printf("grid          %zu x %zu\n", opt.Rows, opt.Cols);
+	std::printf("kernel        %s\n", WaveKernelIsaName(waves.Kernel()));
+	std::printf("threads       %zu\n", waves.ThreadCount());
+	std::printf("steps         %zu%s\n", opt.Steps, opt.Advance != 0 ? " (Advance)" : "");
+	if (opt.Fill)
+	{
+		std::printf("vertex fill   %s%s (included in update)\n", opt.Fill, gradients ? " + gradients" : "");
+	}
+	if (waves.TileCount() != 0)
+	{
+		std::printf("active tiles  %.1f of %zu on average (eps %g)\n", steps > 0 ? activeTiles / steps : 0.0, waves.TileCount(), opt.Sparse);
+	}
+	std::printf("init          %.3f ms\n", initSeconds * 1e3);
+	std::printf("update        %.3f us/step\n", steps > 0 ? updateSeconds / steps * 1e6 : 0.0);
+	std::printf("throughput    %.1f Mcell/s\n", updateSeconds > 0 ? interior * steps / updateSeconds * 1e-6 : 0.0);
+	std::printf("disturb       %.3f ms total\n", disturbSeconds * 1e3);
+	std::printf("checksum      %.9g\n", Checksum(waves));
+
+	if (opt.Profile && !ReportProfile(profiler, opt.Profile))
+	{
+		return 1;
+	}
+
+	if (opt.Record)
+	{
+		recorder.Close();
+
+		// Decode it all back, as fast as possible.
+		WavePlayback playback;
+		size_t frames = 0;
+		auto t0 = Clock::now();
+		if (playback.Open(opt.Record))
+		{
+			while (playback.NextFrame())
+			{
+				++frames;
+			}
+		}
+		const double decodeSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+		const double raw = double(recorder.FramesRecorded()) * double(waves.VertexCount()) * sizeof(float);
+		std::printf("record        %llu frames (%llu dropped, %llu samples clipped), %.2f MB, %.1fx smaller than float\n",
+			(unsigned long long)recorder.FramesRecorded(), (unsigned long long)recorder.FramesDropped(),
+			(unsigned long long)recorder.ClippedSamples(), double(recorder.BytesWritten()) * 1e-6,
+			raw / double(recorder.BytesWritten()));
+		std::printf("record cost   %.3f us/step on the solver thread\n", steps > 0 ? recordSeconds / steps * 1e6 : 0.0);
+		std::printf("playback      %zu frames decoded, %.3f ms/frame\n", frames, frames ? decodeSeconds / double(frames) * 1e3 : 0.0);
+	}
+
+	if (opt.Checkpoint)
+	{
+		auto t0 = Clock::now();
+		const bool saved = waves.Save(opt.Checkpoint);
+		const double saveSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+		// Load, then one step, which faults in the mapped planes.
+		Waves restored;
+		restored.SetThreadCount(opt.Threads);
+		t0 = Clock::now();
+		const bool loaded = saved && restored.Load(opt.Checkpoint);
+		const double loadSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+		const double restoredChecksum = loaded ? Checksum(restored) : 0.0;
+
+		t0 = Clock::now();
+		if (loaded)
+		{
+			restored.Advance(1);
+		}
+		const double stepSeconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+		if (!loaded)
+		{
+			std::fprintf(stderr, "could not %s checkpoint '%s'\n", saved ? "load" : "save", opt.Checkpoint);
+			return 1;
+		}
+
+		std::printf("checkpoint    save %.3f ms, load %.3f ms, first step %.3f ms (%s)\n", saveSeconds * 1e3, loadSeconds * 1e3,
+			stepSeconds * 1e3, restoredChecksum == Checksum(waves) ? "checksum matches" : "CHECKSUM DIFFERS");
+	}
+
+	return 0;
+}
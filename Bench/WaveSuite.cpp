@@ -0,0 +1,631 @@
+//
+// WaveSuite.cpp
+// Benchmark suite for the wave solver.  Sweeps grid sizes through Init,
+// Update, Disturb bursts and the demo's vertex fill, times every case over
+// several repetitions after a warmup, and rates the throughput against the
+// memory bandwidth measured on this machine with STREAM-style loops.
+//
+
+#include "Waves.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Same simulation constants as Game.cpp.
+	const float dx = 0.8f;
+	const float dt = 0.03f;
+	const float speed = 3.25f;
+	const float damping = 0.4f;
+
+	// Each timed repetition covers at least this many cell updates (or vertex
+	// writes), so small grids run many steps and the largest grids one.
+	const double TargetCells = double(1 << 26);
+
+	// Disturb() calls per burst.
+	const size_t BurstSize = 4096;
+
+	const size_t DefaultSizes[] = { 200, 256, 512, 1024, 2048, 4096, 8192 };
+
+	struct Options
+	{
+		std::vector<size_t> Sizes;
+		size_t Reps = 5;
+		size_t Warmup = 1;
+		size_t Threads = 1;
+		size_t StreamMB = 64;
+		bool Cases[4] = { true, true, true, true };
+		const char* Kernel = nullptr;
+		const char* Json = nullptr;
+	};
+
+	enum Case
+	{
+		CaseInit,
+		CaseUpdate,
+		CaseDisturb,
+		CaseFill,
+		CaseCount,
+	};
+
+	const char* const CaseNames[CaseCount] = { "init", "update", "disturb", "fill" };
+
+	// Vertex layout of the demo's CPU path (VertexWave): position, then colour.
+	struct SuiteVertex
+	{
+		float Pos[3];
+		float Color[4];
+	};
+
+	const float SuiteColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	// Bytes each case must move per cell at the least: Init zeroes two planes,
+	// a step reads two planes and writes one, the fill reads a height and
+	// writes a vertex.  A Disturb touches one cell and is rated per call.
+	const double BytesPerCell[CaseCount] =
+	{
+		2.0 * sizeof(float),
+		3.0 * sizeof(float),
+		0.0,
+		sizeof(float) + sizeof(SuiteVertex),
+	};
+
+	void PrintUsage()
+	{
+		std::printf(
+			"usage: wave_suite [--sizes N,N,...] [--max-size N] [--cases LIST]\n"
+			"                  [--reps R] [--warmup W] [--threads T] [--kernel NAME]\n"
+			"                  [--stream-mb MB] [--json FILE]\n"
+			"  --sizes N,N,...  square grid sizes to sweep (default 200,256,512,1024,\n"
+			"                   2048,4096,8192)\n"
+			"  --max-size N     drop the sizes above N\n"
+			"  --cases LIST     any of init,update,disturb,fill (default all)\n"
+			"  --reps R         timed repetitions per case (default 5)\n"
+			"  --warmup W       untimed repetitions before them (default 1)\n"
+			"  --threads T      solver threads, 0 = all hardware threads (default 1)\n"
+			"  --kernel NAME    force a stencil kernel (default: best for this CPU)\n"
+			"  --stream-mb MB   size of each STREAM array (default 64)\n"
+			"  --json FILE      also write the results as JSON to FILE, - for stdout\n");
+	}
+
+	// Splits a comma separated list; false on an empty item.
+	bool SplitList(const char* list, std::vector<std::string>& items)
+	{
+		items.clear();
+		std::string item;
+		for (const char* c = list; ; ++c)
+		{
+			if (*c == ',' || *c == '\0')
+			{
+				if (item.empty())
+				{
+					return false;
+				}
+				items.push_back(item);
+				item.clear();
+				if (*c == '\0')
+				{
+					return true;
+				}
+			}
+			else
+			{
+				item += *c;
+			}
+		}
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& opt)
+	{
+		size_t maxSize = SIZE_MAX;
+		std::vector<std::string> items;
+
+		for (int a = 1; a < argc; ++a)
+		{
+			const char* arg = argv[a];
+			const char* value = a + 1 < argc ? argv[a + 1] : nullptr;
+
+			if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
+			{
+				return false;
+			}
+
+			if (!value)
+			{
+				std::fprintf(stderr, "missing value for %s\n", arg);
+				return false;
+			}
+			++a;
+
+			if (std::strcmp(arg, "--sizes") == 0)
+			{
+				if (!SplitList(value, items))
+				{
+					return false;
+				}
+				opt.Sizes.clear();
+				for (const std::string& item : items)
+				{
+					opt.Sizes.push_back(size_t(std::strtoull(item.c_str(), nullptr, 10)));
+				}
+			}
+			else if (std::strcmp(arg, "--max-size") == 0)
+			{
+				maxSize = size_t(std::strtoull(value, nullptr, 10));
+			}
+			else if (std::strcmp(arg, "--cases") == 0)
+			{
+				if (!SplitList(value, items))
+				{
+					return false;
+				}
+				std::fill(std::begin(opt.Cases), std::end(opt.Cases), false);
+				for (const std::string& item : items)
+				{
+					const char* const* name = std::find_if(std::begin(CaseNames), std::end(CaseNames),
+						[&](const char* n) { return item == n; });
+					if (name == std::end(CaseNames))
+					{
+						std::fprintf(stderr, "unknown case '%s'\n", item.c_str());
+						return false;
+					}
+					opt.Cases[name - std::begin(CaseNames)] = true;
+				}
+			}
+			else if (std::strcmp(arg, "--reps") == 0)
+			{
+				opt.Reps = size_t(std::strtoull(value, nullptr, 10));
+			}
+			else if (std::strcmp(arg, "--warmup") == 0)
+			{
+				opt.Warmup = size_t(std::strtoull(value, nullptr, 10));
+			}
+			else if (std::strcmp(arg, "--threads") == 0)
+			{
+				opt.Threads = size_t(std::strtoull(value, nullptr, 10));
+			}
+			else if (std::strcmp(arg, "--kernel") == 0)
+			{
+				opt.Kernel = value;
+			}
+			else if (std::strcmp(arg, "--stream-mb") == 0)
+			{
+				opt.StreamMB = size_t(std::strtoull(value, nullptr, 10));
+			}
+			else if (std::strcmp(arg, "--json") == 0)
+			{
+				opt.Json = value;
+			}
+			else
+			{
+				std::fprintf(stderr, "unknown option %s\n", arg);
+				return false;
+			}
+		}
+
+		if (opt.Sizes.empty())
+		{
+			opt.Sizes.assign(std::begin(DefaultSizes), std::end(DefaultSizes));
+		}
+		opt.Sizes.erase(std::remove_if(opt.Sizes.begin(), opt.Sizes.end(),
+			[=](size_t n) { return n > maxSize; }), opt.Sizes.end());
+
+		// Disturb() keeps a margin of two cells; the bursts need room inside it.
+		for (size_t n : opt.Sizes)
+		{
+			if (n < 16)
+			{
+				std::fprintf(stderr, "grid size %zu is below the minimum of 16\n", n);
+				return false;
+			}
+		}
+		return !opt.Sizes.empty() && opt.Reps >= 1 && opt.StreamMB >= 1;
+	}
+
+	bool FindKernel(const char* name, WaveKernelIsa& isa)
+	{
+		for (WaveKernelIsa k : { WaveKernelIsa::Scalar, WaveKernelIsa::SSE4, WaveKernelIsa::AVX2, WaveKernelIsa::AVX512 })
+		{
+			if (std::strcmp(name, WaveKernelIsaName(k)) == 0)
+			{
+				isa = k;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	double Seconds(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// Timings of the repetitions of one case, in seconds per repetition.
+	struct Sample
+	{
+		double Min = 0.0;
+		double Median = 0.0;
+		double Mean = 0.0;
+		double StdDev = 0.0;
+	};
+
+	Sample Summarize(std::vector<double> seconds)
+	{
+		Sample s;
+		std::sort(seconds.begin(), seconds.end());
+		const size_t n = seconds.size();
+
+		s.Min = seconds.front();
+		s.Median = n % 2 ? seconds[n / 2] : 0.5 * (seconds[n / 2 - 1] + seconds[n / 2]);
+
+		for (double x : seconds)
+		{
+			s.Mean += x;
+		}
+		s.Mean /= double(n);
+
+		for (double x : seconds)
+		{
+			s.StdDev += (x - s.Mean) * (x - s.Mean);
+		}
+		s.StdDev = n > 1 ? std::sqrt(s.StdDev / double(n - 1)) : 0.0;
+		return s;
+	}
+
+	// Best rates of the STREAM copy and triad loops over arrays of floats,
+	// counting the bytes each loop reads and writes as STREAM does.
+	struct StreamResult
+	{
+		double CopyGBs = 0.0;
+		double TriadGBs = 0.0;
+	};
+
+	StreamResult MeasureStream(const Options& opt)
+	{
+		const size_t n = opt.StreamMB * (size_t(1) << 20) / sizeof(float);
+		std::vector<float> a(n, 1.0f), b(n, 2.0f), c(n, 0.0f);
+		const float scalar = 3.0f;
+
+		StreamResult result;
+		for (size_t rep = 0; rep < opt.Warmup + opt.Reps; ++rep)
+		{
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < n; ++i)
+			{
+				c[i] = a[i];
+			}
+			const double copy = Seconds(start);
+
+			start = Clock::now();
+			for (size_t i = 0; i < n; ++i)
+			{
+				a[i] = b[i] + scalar * c[i];
+			}
+			const double triad = Seconds(start);
+
+			if (rep >= opt.Warmup)
+			{
+				result.CopyGBs = std::max(result.CopyGBs, 2.0 * sizeof(float) * double(n) / copy * 1e-9);
+				result.TriadGBs = std::max(result.TriadGBs, 3.0 * sizeof(float) * double(n) / triad * 1e-9);
+			}
+		}
+
+		// Keeps the loops from being dropped as dead code.
+		if (a[n / 2] == 0.0f)
+		{
+			std::printf("\n");
+		}
+		return result;
+	}
+
+	struct Result
+	{
+		Case Kind;
+		size_t Size;
+
+		// Steps (Update), calls (Disturb) or passes (Init, fill) per repetition.
+		size_t Ops;
+		Sample Time;
+
+		// Cell updates (or Disturb calls) per second and effective bandwidth,
+		// both from the median repetition.
+		double Rate;
+		double GBs;
+	};
+
+	class Suite
+	{
+	public:
+		explicit Suite(const Options& opt) : mOpt(opt) {}
+
+		bool Configure(Waves& waves)const
+		{
+			if (mOpt.Kernel)
+			{
+				WaveKernelIsa isa;
+				if (!FindKernel(mOpt.Kernel, isa) || !waves.SetKernel(isa))
+				{
+					std::fprintf(stderr, "kernel '%s' is not available on this machine\n", mOpt.Kernel);
+					return false;
+				}
+			}
+			waves.SetThreadCount(mOpt.Threads);
+			return true;
+		}
+
+		// Runs body warmup + reps times and records the timed repetitions.
+		template <typename Body>
+		Result Run(Case kind, size_t size, size_t ops, Body body)const
+		{
+			std::vector<double> seconds;
+			for (size_t rep = 0; rep < mOpt.Warmup + mOpt.Reps; ++rep)
+			{
+				const double s = body();
+				if (rep >= mOpt.Warmup)
+				{
+					seconds.push_back(s);
+				}
+			}
+
+			Result r;
+			r.Kind = kind;
+			r.Size = size;
+			r.Ops = ops;
+			r.Time = Summarize(seconds);
+
+			const double units = kind == CaseDisturb ? double(ops) : double(ops) * double(size) * double(size);
+			r.Rate = units / r.Time.Median;
+			r.GBs = BytesPerCell[kind] * units / r.Time.Median * 1e-9;
+			return r;
+		}
+
+		bool RunSize(size_t n, std::vector<Result>& results)const
+		{
+			const double cells = double(n) * double(n);
+
+			if (mOpt.Cases[CaseInit])
+			{
+				// A fresh grid every time, so allocation and first touch are timed too.
+				results.push_back(Run(CaseInit, n, 1, [&]()
+				{
+					std::unique_ptr<Waves> fresh(new Waves);
+					Clock::time_point start = Clock::now();
+					fresh->Init(n, n, dx, dt, speed, damping);
+					return Seconds(start);
+				}));
+				Print(results.back());
+			}
+
+			Waves waves;
+			if (!Configure(waves))
+			{
+				return false;
+			}
+			waves.Init(n, n, dx, dt, speed, damping);
+
+			std::mt19937 rng(1234);
+			std::uniform_int_distribution<size_t> cellDist(2, n - 3);
+			std::uniform_real_distribution<float> magDist(1.0f, 2.0f);
+
+			if (mOpt.Cases[CaseDisturb])
+			{
+				// Positions are drawn before the clock starts.
+				std::vector<size_t> rows(BurstSize), cols(BurstSize);
+				std::vector<float> mags(BurstSize);
+
+				results.push_back(Run(CaseDisturb, n, BurstSize, [&]()
+				{
+					for (size_t k = 0; k < BurstSize; ++k)
+					{
+						rows[k] = cellDist(rng);
+						cols[k] = cellDist(rng);
+						mags[k] = magDist(rng);
+					}
+
+					Clock::time_point start = Clock::now();
+					for (size_t k = 0; k < BurstSize; ++k)
+					{
+						waves.Disturb(rows[k], cols[k], mags[k]);
+					}
+					return Seconds(start);
+				}));
+				Print(results.back());
+			}
+
+			if (mOpt.Cases[CaseUpdate])
+			{
+				// The bursts above leave waves on the grid to step.
+				waves.Disturb(n / 2, n / 2, 2.0f);
+
+				const size_t steps = size_t(std::max(1.0, std::ceil(TargetCells / cells)));
+				bool exact = true;
+				results.push_back(Run(CaseUpdate, n, steps, [&]()
+				{
+					size_t ran = 0;
+					Clock::time_point start = Clock::now();
+					for (size_t s = 0; s < steps; ++s)
+					{
+						ran += waves.Update(dt).Steps;
+					}
+					const double seconds = Seconds(start);
+					exact = exact && ran == steps;
+					return seconds;
+				}));
+				Print(results.back());
+
+				if (!exact)
+				{
+					std::fprintf(stderr, "warning: Update(dt) did not run exactly one step per call\n");
+				}
+			}
+
+			if (mOpt.Cases[CaseFill])
+			{
+				// The demo's CPU path: every vertex of the newest heights into a vertex buffer.
+				std::vector<SuiteVertex> vertices(waves.VertexCount());
+				WaveOutputSink sink;
+				sink.Data = vertices.data();
+				sink.Stride = sizeof(SuiteVertex);
+				sink.Payload = SuiteColor;
+				sink.PayloadSize = sizeof(SuiteColor);
+
+				const size_t passes = size_t(std::max(1.0, std::ceil(TargetCells / cells)));
+				results.push_back(Run(CaseFill, n, passes, [&]()
+				{
+					Clock::time_point start = Clock::now();
+					for (size_t p = 0; p < passes; ++p)
+					{
+						waves.WriteVertices(waves.Heights(), waves.RowStride(), sink);
+					}
+					return Seconds(start);
+				}));
+				Print(results.back());
+			}
+
+			return true;
+		}
+
+		void PrintHeader()const
+		{
+			std::printf("%-8s %6s %7s %11s %11s %7s %13s %8s %6s\n",
+				"case", "size", "ops", "min ms", "median ms", "cv %", "rate", "GB/s", "% bw");
+		}
+
+		void Print(const Result& r)const
+		{
+			const double cv = r.Time.Mean > 0.0 ? 100.0 * r.Time.StdDev / r.Time.Mean : 0.0;
+			const char* unit = r.Kind == CaseDisturb ? "call/s" : "cell/s";
+
+			char bw[16] = "-";
+			char fraction[16] = "-";
+			if (r.Kind != CaseDisturb)
+			{
+				std::snprintf(bw, sizeof(bw), "%.2f", r.GBs);
+				if (mStream.TriadGBs > 0.0)
+				{
+					std::snprintf(fraction, sizeof(fraction), "%.0f", 100.0 * r.GBs / mStream.TriadGBs);
+				}
+			}
+
+			std::printf("%-8s %6zu %7zu %11.3f %11.3f %7.1f %7.3gG %s %8s %6s\n",
+				CaseNames[r.Kind], r.Size, r.Ops, r.Time.Min * 1e3, r.Time.Median * 1e3, cv,
+				r.Rate * 1e-9, unit, bw, fraction);
+			std::fflush(stdout);
+		}
+
+		void SetStream(const StreamResult& stream) { mStream = stream; }
+
+		bool WriteJson(const char* path, const std::vector<Result>& results)const
+		{
+			std::FILE* f = std::strcmp(path, "-") == 0 ? stdout : std::fopen(path, "w");
+			if (!f)
+			{
+				return false;
+			}
+
+			std::fprintf(f, "{\n");
+			std::fprintf(f, "  \"kernel\": \"%s\",\n", WaveKernelIsaName(mKernel));
+			std::fprintf(f, "  \"threads\": %zu,\n", mThreads);
+			std::fprintf(f, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+			std::fprintf(f, "  \"warmup\": %zu,\n", mOpt.Warmup);
+			std::fprintf(f, "  \"reps\": %zu,\n", mOpt.Reps);
+			std::fprintf(f, "  \"stream\": { \"array_mb\": %zu, \"copy_gbs\": %.4f, \"triad_gbs\": %.4f },\n",
+				mOpt.StreamMB, mStream.CopyGBs, mStream.TriadGBs);
+			std::fprintf(f, "  \"results\": [\n");
+
+			for (size_t i = 0; i < results.size(); ++i)
+			{
+				const Result& r = results[i];
+				std::fprintf(f,
+					"    { \"case\": \"%s\", \"rows\": %zu, \"cols\": %zu, \"ops\": %zu, "
+					"\"seconds\": { \"min\": %.9g, \"median\": %.9g, \"mean\": %.9g, \"stddev\": %.9g }, "
+					"\"%s\": %.6g, \"gbs\": %.6g, \"bandwidth_fraction\": %.4f }%s\n",
+					CaseNames[r.Kind], r.Size, r.Size, r.Ops,
+					r.Time.Min, r.Time.Median, r.Time.Mean, r.Time.StdDev,
+					r.Kind == CaseDisturb ? "calls_per_second" : "cells_per_second", r.Rate,
+					r.GBs, mStream.TriadGBs > 0.0 ? r.GBs / mStream.TriadGBs : 0.0,
+					i + 1 < results.size() ? "," : "");
+			}
+
+			std::fprintf(f, "  ]\n}\n");
+			return f == stdout ? std::fflush(f) == 0 : std::fclose(f) == 0;
+		}
+
+		// The kernel and thread count a configured grid actually uses.
+		bool Probe()
+		{
+			Waves waves;
+			if (!Configure(waves))
+			{
+				return false;
+			}
+			mKernel = waves.Kernel();
+			mThreads = waves.ThreadCount();
+			return true;
+		}
+
+		WaveKernelIsa Kernel()const { return mKernel; }
+		size_t Threads()const { return mThreads; }
+
+	private:
+		const Options& mOpt;
+		StreamResult mStream;
+		WaveKernelIsa mKernel = WaveKernelIsa::Scalar;
+		size_t mThreads = 1;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!ParseOptions(argc, argv, opt))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Suite suite(opt);
+	if (!suite.Probe())
+	{
+		return 1;
+	}
+
+	const StreamResult stream = MeasureStream(opt);
+	suite.SetStream(stream);
+
+	std::printf("kernel %s, %zu thread(s), %zu warmup + %zu timed repetitions\n",
+		WaveKernelIsaName(suite.Kernel()), suite.Threads(), opt.Warmup, opt.Reps);
+	std::printf("stream %zu MB arrays: copy %.2f GB/s, triad %.2f GB/s (%% bw is against triad)\n\n",
+		opt.StreamMB, stream.CopyGBs, stream.TriadGBs);
+
+	suite.PrintHeader();
+
+	std::vector<Result> results;
+	for (size_t n : opt.Sizes)
+	{
+		if (!suite.RunSize(n, results))
+		{
+			return 1;
+		}
+	}
+
+	if (opt.Json && !suite.WriteJson(opt.Json, results))
+	{
+		std::fprintf(stderr, "could not write '%s'\n", opt.Json);
+		return 1;
+	}
+	return 0;
+}
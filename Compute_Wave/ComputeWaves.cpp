@@ -0,0 +1,60 @@
+//
+// ComputeWaves.cpp
+//
+
+#include "ComputeWaves.h"
+
+#include <utility>
+
+// Dispatch binds the group sizes by reference; C++14 builds need the definitions.
+constexpr WaveGroupSize WaveUpdateShader::GroupSize;
+constexpr WaveGroupSize WaveDisturbShader::GroupSize;
+
+ComputeWaves::ComputeWaves(size_t threadCount)
+: mDevice(threadCount), mWidth(0), mHeight(0), mK()
+{
+}
+
+void ComputeWaves::Init(uint32_t width, uint32_t height, float dx, float dt, float speed, float damping)
+{
+	mWidth = width;
+	mHeight = height;
+
+	// As Game computes the update shader's constant buffer.
+	const float d = damping*dt + 2.0f;
+	const float e = (speed*speed)*(dt*dt)/(dx*dx);
+	mK.K1 = (damping*dt - 2.0f) / d;
+	mK.K2 = (4.0f - 8.0f*e) / d;
+	mK.K3 = (2.0f*e) / d;
+
+	const size_t texels = size_t(width)*height;
+	mPlanes.assign(3*texels, 0.0f);
+	mPrev = WaveTextureView(mPlanes.data(), width, height, width);
+	mCurr = WaveTextureView(mPlanes.data() + texels, width, height, width);
+	mNext = WaveTextureView(mPlanes.data() + 2*texels, width, height, width);
+}
+
+void ComputeWaves::Disturb(int x, int y, float magnitude)
+{
+	WaveDisturbShader shader;
+	shader.Magnitude = magnitude;
+	shader.X = x;
+	shader.Y = y;
+	shader.Output = mCurr;
+
+	mDevice.Dispatch(1, 1, 1, WaveDisturbShader::GroupSize, shader);
+}
+
+void ComputeWaves::Update()
+{
+	WaveUpdateShader shader;
+	shader.K = mK;
+	shader.Prev = mPrev;
+	shader.Curr = mCurr;
+	shader.Output = mNext;
+
+	mDevice.Dispatch(GroupsX(), GroupsY(), 1, WaveUpdateShader::GroupSize, shader);
+
+	std::swap(mPrev, mCurr);
+	std::swap(mCurr, mNext);
+}
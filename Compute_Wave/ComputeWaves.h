@@ -0,0 +1,117 @@
+//
+// ComputeWaves.h
+// The GPU mode's wave algorithm, CS_Wave_gpu.hlsl and CS_NewWave.hlsl, run
+// on CPU threads through a WaveComputeDevice.
+//
+// Three planes play the demo's prev, curr and next textures.  Update()
+// dispatches the update shader over the whole texture in 16 x 16 groups,
+// the group count rounded up, then rotates the planes as Game::UpdateGPU()
+// rotates its UAVs.  Unlike Waves, the edge texels are updated too, with
+// zero outside the texture, as on the GPU.  The shaders' expressions are
+// evaluated in their order without contraction, so this is a reference for
+// the algorithm; a GPU compiler may fuse multiplies and adds.
+//
+
+#pragma once
+
+#include "WaveCompute.h"
+#include "WaveKernels.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CS_Wave_gpu.hlsl.
+struct WaveUpdateShader
+{
+	static constexpr WaveGroupSize GroupSize = { 16, 16, 1 };
+
+	WaveConstants K;	// gWaveConstant0, 1 and 2
+	WaveTextureView Prev;
+	WaveTextureView Curr;
+	WaveTextureView Output;
+
+	void operator()(const WaveThreadIds& id)const
+	{
+		const int x = int(id.DispatchThread[0]);
+		const int y = int(id.DispatchThread[1]);
+
+		Output.Store(x, y,
+			K.K1*Prev.Load(x, y) +
+			K.K2*Curr.Load(x, y) +
+			K.K3*(
+				Curr.Load(x, y + 1) +
+				Curr.Load(x, y - 1) +
+				Curr.Load(x + 1, y) +
+				Curr.Load(x - 1, y)));
+	}
+};
+
+// CS_NewWave.hlsl, dispatched as a single thread.
+struct WaveDisturbShader
+{
+	static constexpr WaveGroupSize GroupSize = { 1, 1, 1 };
+
+	float Magnitude;	// gDisturbMag
+	int X;				// gDisturbIndex
+	int Y;
+	WaveTextureView Output;
+
+	void operator()(const WaveThreadIds&)const
+	{
+		const float halfMag = 0.5f*Magnitude;
+
+		Output.Store(X, Y, Output.Load(X, Y) + Magnitude);
+		Output.Store(X + 1, Y, Output.Load(X + 1, Y) + halfMag);
+		Output.Store(X - 1, Y, Output.Load(X - 1, Y) + halfMag);
+		Output.Store(X, Y + 1, Output.Load(X, Y + 1) + halfMag);
+		Output.Store(X, Y - 1, Output.Load(X, Y - 1) + halfMag);
+	}
+};
+
+class ComputeWaves
+{
+public:
+	// threadCount as for WaveThreadPool: 0 uses every hardware thread.
+	explicit ComputeWaves(size_t threadCount = 0);
+
+	ComputeWaves(const ComputeWaves&) = delete;
+	ComputeWaves& operator=(const ComputeWaves&) = delete;
+
+	// width x height texels (the demo's size_m x size_n), all zero, and the
+	// constants Game and Waves::Init() derive.
+	void Init(uint32_t width, uint32_t height, float dx, float dt, float speed, float damping);
+
+	uint32_t Width()const { return mWidth; }
+	uint32_t Height()const { return mHeight; }
+	const WaveConstants& Constants()const { return mK; }
+	size_t ThreadCount()const { return mDevice.ThreadCount(); }
+
+	// Groups of an Update() dispatch.
+	uint32_t GroupsX()const { return WaveComputeDevice::GroupCount(mWidth, WaveUpdateShader::GroupSize.X); }
+	uint32_t GroupsY()const { return WaveComputeDevice::GroupCount(mHeight, WaveUpdateShader::GroupSize.Y); }
+
+	// CS_NewWave on the current solution: magnitude at texel (x, y), half
+	// of it at the four neighbours inside the texture.
+	void Disturb(int x, int y, float magnitude);
+
+	// One CS_Wave_gpu dispatch into the next plane, then prev <- curr,
+	// curr <- next, next <- prev.
+	void Update();
+
+	// The newest solution and the one before it; texel (x, y) is row y,
+	// column x, Width() floats per row.
+	const WaveTextureView& Current()const { return mCurr; }
+	const WaveTextureView& Previous()const { return mPrev; }
+
+private:
+	WaveComputeDevice mDevice;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	WaveConstants mK;
+
+	std::vector<float> mPlanes;
+	WaveTextureView mPrev;
+	WaveTextureView mCurr;
+	WaveTextureView mNext;
+};
@@ -8,6 +8,7 @@
 #include "ReadData.h"
 #include "VertexTypes.h"
 #include "MathHelper.h"
+#include "ComputeWaves.h"
 #include <string>
 
 extern void ExitGame();
@@ -26,6 +27,17 @@ const float damping = 0.4f;
 
 const float DisturbPeriod = 0.25f;
 
+// Patches closer to the camera than this are drawn at full resolution; each
+// doubling of the distance halves the resolution.
+const size_t LodPatchQuads = 32;
+const float LodDetailDistance = 200.0f;
+
+// Written by ToggleRecording(), read by TogglePlayback().
+const char* const RecordingFile = "waves.rec";
+
+// Written by ExportProfile().
+const char* const ProfileFile = "profile.json";
+
 Game::Game() noexcept :
     m_window(nullptr),
     m_outputWidth(800),
@@ -45,7 +57,17 @@ void Game::Initialize(HWND window, int width, int height)
     m_outputWidth = std::max(width, 1);
     m_outputHeight = std::max(height, 1);
 
-	mWaves.Init(size_m, size_n, dx, dt, speed, damping);
+	mSimulation.Solver().Init(size_m, size_n, dx, dt, speed, damping);
+
+	mPhases.Frame = mProfiler.AddPhase("frame");
+	mPhases.Disturb = mProfiler.AddPhase("disturb");
+	mPhases.Update = mProfiler.AddPhase("update");
+	mPhases.Upload = mProfiler.AddPhase("upload");
+	mPhases.Constants = mProfiler.AddPhase("constants");
+	mPhases.Draw = mProfiler.AddPhase("draw");
+	mPhases.Present = mProfiler.AddPhase("present");
+	mProfiler.SetThreadName("render");
+	mSimulation.SetProfiler(&mProfiler);
 
     CreateDevice();
 
@@ -64,6 +86,8 @@ void Game::Initialize(HWND window, int width, int height)
 // Executes the basic game loop.
 void Game::Tick()
 {
+	WaveProfileScope scope(&mProfiler, mPhases.Frame);
+
     m_timer.Tick([&]()
     {
         Update(m_timer);
@@ -84,6 +108,9 @@ void Game::Update(DX::StepTimer const& timer)
 
 	m_view = Matrix::CreateLookAt(Vector3(x, y, z), Vector3::Zero, Vector3::UnitY);
 
+	// m_WaveWorld is the identity, so the eye is already in the grid's space.
+	mMesh.SelectLod(x, y, z, LodDetailDistance);
+
 	//
 	switch (m_WaveMode)
 	{
@@ -144,7 +171,11 @@ void Game::Present()
     // The first argument instructs DXGI to block until VSync, putting the application
     // to sleep until the next VSync. This ensures we don't waste any cycles rendering
     // frames that will never be displayed to the screen.
-    HRESULT hr = m_swapChain->Present(0, 0);
+    HRESULT hr;
+    {
+        WaveProfileScope scope(&mProfiler, mPhases.Present);
+        hr = m_swapChain->Present(0, 0);
+    }
 
     // If the device was reset we must completely reinitialize the renderer.
     if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
@@ -368,6 +399,7 @@ void Game::OnDeviceLost()
     // Add Direct3D resource cleanup here.
 	m_states.reset();
 	m_WaveVB.Reset();
+	m_WaveVBFilled = false;
 	m_WaveIB.Reset();
 	m_InputLayout_cpu.Reset();
 	m_VS_wave_cpu.Reset();
@@ -457,60 +489,59 @@ void Game::CreateDeviceDependentResources()
 
 void Game::BuildWavesGeometryBuffers()
 {
+	// Only the grid layout is read here, so the solver may keep running.
+	const Waves& waves = mSimulation.Solver();
+
 	// create vb for cpu
 	{
 		CD3D11_BUFFER_DESC vbd(
-			sizeof(VertexWave) * mWaves.VertexCount(),
+			sizeof(VertexWave) * waves.VertexCount(),
 			D3D11_BIND_VERTEX_BUFFER,
 			D3D11_USAGE_DYNAMIC,
 			D3D11_CPU_ACCESS_WRITE);
 
 		DX::ThrowIfFailed(
 			m_d3dDevice->CreateBuffer(&vbd, nullptr, m_WaveVB.ReleaseAndGetAddressOf()));
+		m_WaveVBFilled = false;
 	}
 
-	// create ib
-	std::vector<uint32_t> indices(3 * mWaves.TriangleCount());	// 3 indices per face
-
-	// Iterate over each quad.
-	size_t m = mWaves.RowCount();
-	size_t n = mWaves.ColumnCount();
-	int k = 0;
-	for (size_t i = 0; i < m - 1; ++i)
-	{
-		for (size_t j = 0; j < n - 1; ++j)
-		{
-			indices[k] = i * n + j;
-			indices[k + 1] = i * n + j + 1;
-			indices[k + 2] = (i + 1)*n + j;
+	// create ib: every level of every patch size, drawn patch by patch,
+	// in 16 bits unless the grid is too wide
+	mMesh.Init(waves.RowCount(), waves.ColumnCount(), waves.SpatialStep(), LodPatchQuads);
+	m_WaveIndexFormat = mMesh.IndexSize() == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	mVisiblePatches.assign(mMesh.PatchCount(), 1);
 
-			indices[k + 3] = (i + 1)*n + j;
-			indices[k + 4] = i * n + j + 1;
-			indices[k + 5] = (i + 1)*n + j + 1;
+	// Snapshots carry the height range of every patch for the culler; the
+	// next UpdateCPU() starts the solver again.
+	mSimulation.Stop();
+	mSimulation.SetHeightBounds(mMesh.PatchRowQuads(), mMesh.PatchQuads());
 
-			k += 6; // next quad
-		}
-	}
-
-	CD3D11_BUFFER_DESC ibd(sizeof(uint32_t) * indices.size(), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+	CD3D11_BUFFER_DESC ibd(UINT(mMesh.IndexSize() * mMesh.IndexCount()), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
 	D3D11_SUBRESOURCE_DATA iinitData = { 0 };
-	iinitData.pSysMem = indices.data();
+	iinitData.pSysMem = mMesh.IndexData();
 
 	DX::ThrowIfFailed(
 		m_d3dDevice->CreateBuffer(&ibd, &iinitData, m_WaveIB.ReleaseAndGetAddressOf()));
 
 	{	// create vertex buffer for gpu & initialize data
 		CD3D11_BUFFER_DESC vbd(
-			sizeof(VertexWave_GPU) * mWaves.VertexCount(),
+			sizeof(VertexWave_GPU) * waves.VertexCount(),
 			D3D11_BIND_VERTEX_BUFFER,
 			D3D11_USAGE_DEFAULT);
 
-		std::vector<VertexWave_GPU> gpuVBData(mWaves.VertexCount());
-		for (size_t i = 0; i < mWaves.VertexCount(); ++i)
+		std::vector<VertexWave_GPU> gpuVBData(waves.VertexCount());
+
+		// The GPU solution starts flat.
+		std::vector<float> flat(waves.VertexCount(), 0.0f);
+		WaveOutputSink sink;
+		sink.Data = gpuVBData.data();
+		sink.Stride = sizeof(VertexWave_GPU);
+		waves.WriteVertices(flat.data(), waves.ColumnCount(), sink);
+
+		for (size_t i = 0; i < waves.VertexCount(); ++i)
 		{
-			gpuVBData[i].Pos = mWaves[i];
 			gpuVBData[i].Color = Colors::Black;
-			gpuVBData[i].Tex = mWaves.GetTex(i);
+			gpuVBData[i].Tex = waves.GetTex(i);
 		}
 
 		D3D11_SUBRESOURCE_DATA initData = { 0 };
@@ -574,42 +605,161 @@ void Game::CreateShaders()
 
 void Game::UpdateCPU(DX::StepTimer const& timer)
 {
-	float elapsedTime = float(timer.GetElapsedSeconds());
+	const float* heights = nullptr;
+	size_t rowStride = 0;
+	const float* minHeights = nullptr;
+	const float* maxHeights = nullptr;
 
-	//
-	// Every quarter second, generate a random wave.
-	//
-	static double t_base = 0.0f;
-	if ((timer.GetTotalSeconds() - t_base) >= DisturbPeriod)
+	if (mPlayback.IsOpen())
 	{
-		t_base = timer.GetTotalSeconds();
+		// A recording replaces the solver, looping at its end.
+		mSimulation.Stop();
 
-		DWORD i = 5 + rand() % 190;
-		DWORD j = 5 + rand() % 190;
+		if (mPlayback.AtEnd())
+		{
+			mPlayback.Rewind();
+		}
+		mPlayback.Update(float(timer.GetElapsedSeconds()));
 
-		float r = MathHelper::RandF(1.0f, 2.0f);
+		heights = mPlayback.Heights();
+		rowStride = mPlayback.ColumnCount();
+	}
+	else
+	{
+		// The solver steps on its own thread, on its own clock.
+		mSimulation.Start();
+
+		//
+		// Every quarter second, generate a random wave.
+		//
+		static double t_base = 0.0f;
+		if ((timer.GetTotalSeconds() - t_base) >= DisturbPeriod)
+		{
+			t_base = timer.GetTotalSeconds();
+
+			float i = MathHelper::RandF(5.0f, float(size_m - 5));
+			float j = MathHelper::RandF(5.0f, float(size_n - 5));
+
+			float r = MathHelper::RandF(1.0f, 2.0f);
 
-		mWaves.Disturb(i, j, r);
+			// Applied before the solver's next step, with the default Gaussian brush.
+			// The solver thread times applying it.
+			mSimulation.QueueDisturbance(i, j, 2.0f, r);
+		}
+
+		// The newest finished solution.  This never waits for the solver; if
+		// it has not published anything new since the last frame the same
+		// heights are drawn again.
+		const WaveSnapshot* snapshot = mSimulation.AcquireSnapshot();
+		if (!snapshot)
+		{
+			return;
+		}
+
+		heights = snapshot->Heights.data();
+		rowStride = snapshot->RowStride;
+		if (snapshot->MinHeights.size() == mMesh.PatchCount())
+		{
+			minHeights = snapshot->MinHeights.data();
+			maxHeights = snapshot->MaxHeights.data();
+		}
+	}
+
+	//
+	// Cull the patches against the view frustum.  m_WaveWorld is the
+	// identity, so the boxes are already in world space.
+	//
+
+	const Waves& waves = mSimulation.Solver();
+	if (!minHeights)
+	{
+		mPatchMin.resize(mMesh.PatchCount());
+		mPatchMax.resize(mMesh.PatchCount());
+		waves.HeightBounds(heights, rowStride, mMesh.PatchRowQuads(), mMesh.PatchQuads(), mPatchMin.data(), mPatchMax.data());
+		minHeights = mPatchMin.data();
+		maxHeights = mPatchMax.data();
 	}
 
-	mWaves.Update(elapsedTime);
+	const Matrix viewProj = m_view * m_proj;
+	mCuller.SetPatchBoxes(mMesh, minHeights, maxHeights);
+	mCuller.Cull(WaveFrustum::FromViewProjection(&viewProj._11), mVisiblePatches.data());
 
 	//
-	// Update the wave vertex buffer with the new solution.
+	// Update the wave vertex buffer with the heights of the visible
+	// patches.  The discarded buffer's other vertices are undefined, but
+	// nothing draws them.
 	//
 
+	WaveProfileScope scope(&mProfiler, mPhases.Upload);
+
 	D3D11_MAPPED_SUBRESOURCE mappedData;
 	DX::ThrowIfFailed(
 		m_d3dContext->Map(m_WaveVB.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
 
-	VertexWave* v = reinterpret_cast<VertexWave*>(mappedData.pData);
-	for (size_t i = 0; i < mWaves.VertexCount(); ++i)
+	static const Vector4 color = Colors::Black;
+	static_assert(offsetof(VertexWave, Color) == sizeof(XMFLOAT3), "Color must follow Pos");
+
+	WaveOutputSink sink;
+	sink.Data = mappedData.pData;
+	sink.Stride = sizeof(VertexWave);
+	sink.Payload = &color;
+	sink.PayloadSize = sizeof(color);
+
+	for (size_t patch = 0; patch < mMesh.PatchCount(); ++patch)
 	{
-		v[i].Pos = mWaves[i];
-		v[i].Color = Colors::Black;
+		if (mVisiblePatches[patch])
+		{
+			const WaveMeshPatch p = mMesh.Patch(patch);
+			waves.WriteVertices(heights, rowStride, sink, p.Row, p.Row + p.Rows + 1, p.Column, p.Column + p.Columns + 1);
+		}
 	}
 
 	m_d3dContext->Unmap(m_WaveVB.Get(), 0);
+	m_WaveVBFilled = true;
+}
+
+void Game::ToggleRecording()
+{
+	// The solver thread only takes a recorder while stopped; the next
+	// UpdateCPU() starts it again.
+	mSimulation.Stop();
+
+	if (mRecorder.IsOpen())
+	{
+		mSimulation.SetRecorder(nullptr);
+		mRecorder.Close();
+	}
+	else if (mRecorder.Open(RecordingFile, mSimulation.Solver()))
+	{
+		mSimulation.SetRecorder(&mRecorder);
+	}
+}
+
+void Game::TogglePlayback()
+{
+	if (mPlayback.IsOpen())
+	{
+		mPlayback.Close();
+		return;
+	}
+
+	// Finish a recording in progress first, so all of it plays.
+	if (mRecorder.IsOpen())
+	{
+		ToggleRecording();
+	}
+
+	const Waves& waves = mSimulation.Solver();
+	if (mPlayback.Open(RecordingFile) &&
+		(mPlayback.RowCount() != waves.RowCount() || mPlayback.ColumnCount() != waves.ColumnCount()))
+	{
+		mPlayback.Close();
+	}
+}
+
+void Game::ExportProfile()
+{
+	mProfiler.WriteChromeTrace(ProfileFile);
 }
 
 void Game::DumpTexture(ComPtr<ID3D11Texture2D> src, const std::wstring& path)
@@ -642,12 +792,20 @@ void Game::DumpTexture(ComPtr<ID3D11Texture2D> src, const std::wstring& path)
 
 void Game::UpdateGPU(DX::StepTimer const& timer)
 {
+	// Nothing reads the CPU solution in this mode.
+	mSimulation.Stop();
+
+	// The heights live on the GPU, so there are no bounds to cull with.
+	std::fill(mVisiblePatches.begin(), mVisiblePatches.end(), uint8_t(1));
+
 	// create new wave using compute shader
 	static double t_base = 0.0f;
 	if ((timer.GetTotalSeconds() - t_base) >= DisturbPeriod)
 	{
 		t_base = timer.GetTotalSeconds();
 
+		WaveProfileScope scope(&mProfiler, mPhases.Disturb);
+
 		DWORD i = 5 + rand() % 190;
 		DWORD j = 5 + rand() % 190;
 		float r = MathHelper::RandF(1.0f, 2.0f);
@@ -678,6 +836,8 @@ void Game::UpdateGPU(DX::StepTimer const& timer)
 	}
 
 	{	// update wave
+		WaveProfileScope scope(&mProfiler, mPhases.Update);
+
 		m_d3dContext->CSSetShader(m_CS_wave_gpu.Get(), nullptr, 0);
 
 		// views
@@ -687,10 +847,11 @@ void Game::UpdateGPU(DX::StepTimer const& timer)
 		// cbuffer
 		m_d3dContext->CSSetConstantBuffers(0, 1, m_cbuffer_wave_constant.GetAddressOf());
 
-		// calculate how many thread groups 
+		// calculate how many thread groups, rounding up so that the last
+		// partial group covers the edge texels (writes past it are dropped)
 		// dispatch
-		UINT xgroups = size_m / 16;
-		UINT ygroups = size_n / 16;
+		UINT xgroups = WaveComputeDevice::GroupCount(UINT(size_m), WaveUpdateShader::GroupSize.X);
+		UINT ygroups = WaveComputeDevice::GroupCount(UINT(size_n), WaveUpdateShader::GroupSize.Y);
 		m_d3dContext->Dispatch(xgroups, ygroups, 1);
 
 		// unbound
@@ -710,6 +871,12 @@ void Game::UpdateGPU(DX::StepTimer const& timer)
 
 void Game::RenderCPU()
 {
+	// Nothing to draw before the solver's first snapshot reaches the buffer.
+	if (!m_WaveVBFilled)
+	{
+		return;
+	}
+
 	m_d3dContext->IASetInputLayout(m_InputLayout_cpu.Get());
 	m_d3dContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
@@ -721,17 +888,22 @@ void Game::RenderCPU()
 	UINT stride = sizeof(VertexWave);
 	UINT offset = 0;
 	m_d3dContext->IASetVertexBuffers(0, 1, m_WaveVB.GetAddressOf(), &stride, &offset);
-	m_d3dContext->IASetIndexBuffer(m_WaveIB.Get(), DXGI_FORMAT_R32_UINT, 0);
+	m_d3dContext->IASetIndexBuffer(m_WaveIB.Get(), m_WaveIndexFormat, 0);
 
 	// set constant buffer
-	ConstantBuffer_WaveCPU cbuffer;
-	cbuffer.WorldViewProj = (m_WaveWorld * m_view * m_proj).Transpose();
-	m_cbuffer_cpu.SetData(m_d3dContext.Get(), cbuffer);
+	{
+		WaveProfileScope scope(&mProfiler, mPhases.Constants);
+
+		ConstantBuffer_WaveCPU cbuffer;
+		cbuffer.WorldViewProj = (m_WaveWorld * m_view * m_proj).Transpose();
+		m_cbuffer_cpu.SetData(m_d3dContext.Get(), cbuffer);
+	}
 
 	ID3D11Buffer* buffers[1] = { m_cbuffer_cpu.GetBuffer() };
 	m_d3dContext->VSSetConstantBuffers(0, 1, buffers);
 
-	m_d3dContext->DrawIndexed(3 * mWaves.TriangleCount(), 0, 0);
+	WaveProfileScope scope(&mProfiler, mPhases.Draw);
+	DrawWaves();
 }
 
 void Game::RenderGPU()
@@ -747,13 +919,17 @@ void Game::RenderGPU()
 	UINT stride = sizeof(VertexWave_GPU);
 	UINT offset = 0;
 	m_d3dContext->IASetVertexBuffers(0, 1, m_WaveVB_GPU.GetAddressOf(), &stride, &offset);
-	m_d3dContext->IASetIndexBuffer(m_WaveIB.Get(), DXGI_FORMAT_R32_UINT, 0);
+	m_d3dContext->IASetIndexBuffer(m_WaveIB.Get(), m_WaveIndexFormat, 0);
 
 	// update constant buffer
-	CBuffer_WaveGPU_Frame cbuffer;
-	cbuffer.World = m_WaveWorld.Transpose();
-	cbuffer.ViewProj = (m_view * m_proj).Transpose();
-	m_cbuffer_frame_gpu.SetData(m_d3dContext.Get(), cbuffer);
+	{
+		WaveProfileScope scope(&mProfiler, mPhases.Constants);
+
+		CBuffer_WaveGPU_Frame cbuffer;
+		cbuffer.World = m_WaveWorld.Transpose();
+		cbuffer.ViewProj = (m_view * m_proj).Transpose();
+		m_cbuffer_frame_gpu.SetData(m_d3dContext.Get(), cbuffer);
+	}
 
 	m_d3dContext->VSSetConstantBuffers(0, 1, m_cbuffer_frame_gpu.GetAddressOf());
 	m_d3dContext->VSSetShaderResources(0, 1, m_displacement_SRV.GetAddressOf());
@@ -762,13 +938,28 @@ void Game::RenderGPU()
 	m_d3dContext->VSSetSamplers(0, 1, samplers);
 
 	// draw
-	m_d3dContext->DrawIndexed(3 * mWaves.TriangleCount(), 0, 0);
+	{
+		WaveProfileScope scope(&mProfiler, mPhases.Draw);
+		DrawWaves();
+	}
 
 	// unbound
 	ID3D11ShaderResourceView* nullViews[] = { nullptr };
 	m_d3dContext->VSSetShaderResources(0, 1, nullViews);
 }
 
+void Game::DrawWaves()
+{
+	const std::vector<WaveMeshDraw>& draws = mMesh.Draws();
+	for (size_t patch = 0; patch < draws.size(); ++patch)
+	{
+		if (mVisiblePatches[patch])
+		{
+			m_d3dContext->DrawIndexed(draws[patch].IndexCount, draws[patch].IndexStart, draws[patch].BaseVertex);
+		}
+	}
+}
+
 void Game::CalculateFrameStats(DX::StepTimer const& timer)
 {
 	const static float updateGap = 1.0f;
@@ -779,6 +970,35 @@ void Game::CalculateFrameStats(DX::StepTimer const& timer)
 	{
 		std::wstring fpstxt(L"FPS : ");
 		fpstxt += std::to_wstring(timer.GetFramesPerSecond());
+
+		// The spikes an FPS average hides: the slowest frames of the last
+		// second and how much frame times swing from one frame to the next.
+		{
+			wchar_t text[96];
+			swprintf_s(text, L"  frame p99 %.2f max %.2f jitter p99 %.2f",
+				double(timer.GetFrameTimes().ValueAtPercentile(99.0)) * 1e-6,
+				double(timer.GetFrameTimes().Max()) * 1e-6,
+				double(timer.GetFrameJitter().ValueAtPercentile(99.0)) * 1e-6);
+			fpstxt += text;
+		}
+		m_timer.ResetHistograms();
+
+		// p95 of every phase timed over the last second.
+		const uint64_t now = WaveProfiler::Now();
+		const uint64_t gap = uint64_t(updateGap * 1e9f);
+		const uint64_t since = now > gap ? now - gap : 0;
+		fpstxt += L"  p95";
+		for (const WavePhaseStats& phase : mProfiler.Stats(since))
+		{
+			if (phase.Count != 0)
+			{
+				wchar_t text[64];
+				swprintf_s(text, L"  %hs %.2f", phase.Name.c_str(), phase.P95 * 1e-3);
+				fpstxt += text;
+			}
+		}
+		fpstxt += L" (ms)";
+
 		::SetWindowText(m_window, fpstxt.c_str());
 		elapsedTime -= updateGap;
 	}
@@ -7,7 +7,11 @@
 #include "StepTimer.h"
 #include "SimpleMath.h"
 #include "CommonStates.h"
-#include "Waves.h"
+#include "WaveSimThread.h"
+#include "WaveRecording.h"
+#include "WaveProfiler.h"
+#include "WaveMesh.h"
+#include "WaveCuller.h"
 #include "Structures.h"
 #include "ConstantBuffer.h"
 
@@ -35,6 +39,13 @@ public:
 	void SetModeCPU() { m_WaveMode = WaveMode::CPU; }
 	void SetModeGPU() { m_WaveMode = WaveMode::GPU; }
 
+	// CPU mode: records the solver to a file, or draws that file instead of the solver.
+	void ToggleRecording();
+	void TogglePlayback();
+
+	// Writes the frame profile held so far to a Chrome trace file.
+	void ExportProfile();
+
     // Properties
     void GetDefaultSize( int& width, int& height ) const;
 
@@ -60,6 +71,7 @@ private:
 	void UpdateGPU(DX::StepTimer const& timer);
 	void RenderCPU();
 	void RenderGPU();
+	void DrawWaves();
 
 
 	void CalculateFrameStats(DX::StepTimer const& timer);
@@ -79,8 +91,29 @@ private:
     // Rendering loop timer.
     DX::StepTimer                                   m_timer;
 
-	//
-	Waves mWaves;
+	// Phase timers of the render thread and the solver thread; the window
+	// title shows their p95 every second.
+	WaveProfiler mProfiler;
+
+	struct ProfilePhases
+	{
+		uint32_t Frame;
+		uint32_t Disturb;
+		uint32_t Update;
+		uint32_t Upload;
+		uint32_t Constants;
+		uint32_t Draw;
+		uint32_t Present;
+	};
+	ProfilePhases mPhases;
+
+	// Recording and playback of the CPU solver.  Declared first so the
+	// solver thread, which writes to mRecorder, stops before it goes.
+	WaveRecorder mRecorder;
+	WavePlayback mPlayback;
+
+	// CPU solver, stepping on its own thread while the CPU mode is shown.
+	WaveSimThread mSimulation;
 
 	//
 	std::unique_ptr<DirectX::CommonStates> m_states;
@@ -88,7 +121,22 @@ private:
 	DirectX::SimpleMath::Matrix m_WaveWorld;
 
 	Microsoft::WRL::ComPtr<ID3D11Buffer> m_WaveVB;
+	// False until UpdateCPU() first writes m_WaveVB, which is created empty.
+	bool m_WaveVBFilled = false;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> m_WaveIB;
+	DXGI_FORMAT m_WaveIndexFormat = DXGI_FORMAT_R16_UINT;
+
+	// Patches of the grid and the index lists of their levels of detail,
+	// which m_WaveIB holds; both modes draw through it.
+	WaveLodMesh mMesh;
+
+	// Boxes of the patches, and which of them the last CPU upload wrote and
+	// the next draw shows.  mPatchMin/mPatchMax hold the height ranges when
+	// no snapshot carries them (playback).
+	WaveCuller mCuller;
+	std::vector<uint8_t> mVisiblePatches;
+	std::vector<float> mPatchMin;
+	std::vector<float> mPatchMax;
 
 	// cpu
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_VS_wave_cpu;
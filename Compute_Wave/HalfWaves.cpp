@@ -0,0 +1,222 @@
+//
+// HalfWaves.cpp
+//
+
+#include "HalfWaves.h"
+#include "WaveHalf.h"
+#include "WaveThreadPool.h"
+#include "Waves.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Same banding as Waves: 16 rows per task, serial below 128x128 cells.
+	const size_t RowsPerBand = 16;
+	const size_t MinParallelCells = 128*128;
+
+	WaveKernelIsa BestHalfKernel()
+	{
+		const WaveKernelIsa order[] = { WaveKernelIsa::AVX512, WaveKernelIsa::AVX2 };
+		for (WaveKernelIsa isa : order)
+		{
+			if (GetWaveRowKernelHalf(isa))
+			{
+				return isa;
+			}
+		}
+		return WaveKernelIsa::Scalar;
+	}
+}
+
+HalfWaves::HalfWaves()
+: mNumRows(0), mNumCols(0), mK1(0.0f), mK2(0.0f), mK3(0.0f),
+  mSpatialStep(0.0f), mHalfWidth(0.0f), mHalfDepth(0.0f),
+  mKernelIsa(BestHalfKernel()), mKernel(GetWaveRowKernelHalf(mKernelIsa))
+{
+}
+
+HalfWaves::~HalfWaves()
+{
+}
+
+XMFLOAT3 HalfWaves::operator[](int i)const
+{
+	size_t row = size_t(i) / mNumCols;
+	size_t col = size_t(i) % mNumCols;
+
+	float x = -mHalfWidth + col*mSpatialStep;
+	float z = mHalfDepth - row*mSpatialStep;
+
+	return XMFLOAT3(x, HalfToFloat(mCurrSolution[i]), z);
+}
+
+float HalfWaves::Height(size_t i)const
+{
+	return HalfToFloat(mCurrSolution[i]);
+}
+
+void HalfWaves::Init(size_t m, size_t n, float dx, float dt, float speed, float damping)
+{
+	mNumRows = m;
+	mNumCols = n;
+
+	mClock.TimeStep = dt;
+	mClock.Accumulator = 0.0f;
+	mSpatialStep = dx;
+
+	// Same constants as Waves::Init; they stay in float.
+	float d = damping*dt+2.0f;
+	float e = (speed*speed)*(dt*dt)/(dx*dx);
+	mK1     = (damping*dt-2.0f)/ d;
+	mK2     = (4.0f-8.0f*e) / d;
+	mK3     = (2.0f*e) / d;
+
+	mHalfWidth = (n-1)*dx*0.5f;
+	mHalfDepth = (m-1)*dx*0.5f;
+
+	// +0.0 is all zero bits in binary16 as well.
+	mPrevSolution.assign(m*n, 0);
+	mCurrSolution.assign(m*n, 0);
+}
+
+WaveStepReport HalfWaves::Update(float dt)
+{
+	WaveStepReport report = mClock.Consume(dt);
+
+	Advance(report.Steps);
+
+	return report;
+}
+
+void HalfWaves::SetMaxSubsteps(size_t steps)
+{
+	mClock.MaxSubsteps = std::max<size_t>(steps, 1);
+}
+
+void HalfWaves::Advance(size_t steps)
+{
+	for (size_t s = 0; s < steps; ++s)
+	{
+		Step();
+	}
+}
+
+void HalfWaves::StepRows(size_t firstRow, size_t lastRow)
+{
+	const WaveConstants k = { mK1, mK2, mK3 };
+
+	for (size_t i = firstRow; i < lastRow; ++i)
+	{
+		size_t row = i*mNumCols + 1;
+		mKernel(mPrevSolution.data() + row, mCurrSolution.data() + row, mNumCols, mNumCols - 2, k);
+	}
+}
+
+void HalfWaves::Step()
+{
+	const size_t interiorRows = mNumRows - 2;
+
+	if (mThreadPool && interiorRows*(mNumCols - 2) >= MinParallelCells)
+	{
+		const size_t bands = (interiorRows + RowsPerBand - 1) / RowsPerBand;
+
+		mThreadPool->Run(bands, [&](size_t band)
+		{
+			size_t first = 1 + band*RowsPerBand;
+			size_t last = std::min(first + RowsPerBand, mNumRows - 1);
+			StepRows(first, last);
+		});
+	}
+	else
+	{
+		StepRows(1, mNumRows - 1);
+	}
+
+	std::swap(mPrevSolution, mCurrSolution);
+}
+
+void HalfWaves::Disturb(size_t i, size_t j, float magnitude)
+{
+	// Don't disturb boundaries.
+	assert(i > 1 && i < mNumRows-2);
+	assert(j > 1 && j < mNumCols-2);
+
+	float halfMag = 0.5f*magnitude;
+
+	auto add = [&](size_t cell, float value)
+	{
+		mCurrSolution[cell] = FloatToHalf(HalfToFloat(mCurrSolution[cell]) + value);
+	};
+
+	// Disturb the ijth vertex height and its neighbors.
+	add(i*mNumCols+j,     magnitude);
+	add(i*mNumCols+j+1,   halfMag);
+	add(i*mNumCols+j-1,   halfMag);
+	add((i+1)*mNumCols+j, halfMag);
+	add((i-1)*mNumCols+j, halfMag);
+}
+
+bool HalfWaves::SetKernel(WaveKernelIsa isa)
+{
+	WaveRowKernelHalf kernel = GetWaveRowKernelHalf(isa);
+	if (!kernel)
+	{
+		return false;
+	}
+
+	mKernelIsa = isa;
+	mKernel = kernel;
+	return true;
+}
+
+void HalfWaves::SetThreadCount(size_t threads)
+{
+	if (threads == 1)
+	{
+		mThreadPool.reset();
+		return;
+	}
+
+	mThreadPool = std::make_unique<WaveThreadPool>(threads);
+	if (mThreadPool->ThreadCount() == 1)
+	{
+		mThreadPool.reset();
+	}
+}
+
+size_t HalfWaves::ThreadCount()const
+{
+	return mThreadPool ? mThreadPool->ThreadCount() : 1;
+}
+
+WaveDrift MeasureDrift(const Waves& reference, const HalfWaves& half)
+{
+	assert(reference.RowCount() == half.RowCount());
+	assert(reference.ColumnCount() == half.ColumnCount());
+
+	double maxError = 0.0;
+	double sumError2 = 0.0;
+	double sumReference2 = 0.0;
+
+	const size_t count = reference.VertexCount();
+	for (size_t i = 0; i < count; ++i)
+	{
+		double r = reference.Height(i);
+		double e = std::fabs(double(half.Height(i)) - r);
+
+		maxError = std::max(maxError, e);
+		sumError2 += e*e;
+		sumReference2 += r*r;
+	}
+
+	WaveDrift drift;
+	drift.MaxAbsError = float(maxError);
+	drift.RmsError = count ? float(std::sqrt(sumError2 / count)) : 0.0f;
+	drift.ReferenceRms = count ? float(std::sqrt(sumReference2 / count)) : 0.0f;
+	return drift;
+}
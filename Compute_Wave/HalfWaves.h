@@ -0,0 +1,99 @@
+//
+// HalfWaves.h
+// Wave solver with half precision height storage.
+//
+// Same scheme and interface as Waves, but the previous and current solutions
+// are kept as IEEE binary16.  Each step widens the heights to float, updates
+// them in float registers and rounds the result back to half, which halves the
+// memory footprint and the bandwidth of the sweep.  Use MeasureDrift() against
+// a float Waves run to decide whether the precision is acceptable.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "WaveTypes.h"
+#include "WaveKernels.h"
+#include "WaveClock.h"
+
+class Waves;
+class WaveThreadPool;
+
+class HalfWaves
+{
+public:
+	HalfWaves();
+	~HalfWaves();
+
+	size_t RowCount()const { return mNumRows; }
+	size_t ColumnCount()const { return mNumCols; }
+	size_t VertexCount()const { return mNumRows*mNumCols; }
+	size_t TriangleCount()const { return (mNumRows-1)*(mNumCols-1)*2; }
+
+	// Returns the solution at the ith grid point, widened to float.
+	DirectX::XMFLOAT3 operator[](int i)const;
+	float Height(size_t i)const;
+
+	// Raw half precision plane of the current solution.
+	const uint16_t* HalfHeights()const { return mCurrSolution.data(); }
+
+	void Init(size_t m, size_t n, float dx, float dt, float speed, float damping);
+
+	// Fixed-step update, as Waves::Update().
+	WaveStepReport Update(float dt);
+	void SetMaxSubsteps(size_t steps);
+
+	// Advances the simulation by steps time steps, independent of the clock.
+	void Advance(size_t steps);
+
+	void Disturb(size_t i, size_t j, float magnitude);
+
+	// As Waves: half kernels exist for scalar, AVX2 (F16C) and AVX-512.
+	bool SetKernel(WaveKernelIsa isa);
+	WaveKernelIsa Kernel()const { return mKernelIsa; }
+
+	void SetThreadCount(size_t threads);
+	size_t ThreadCount()const;
+
+private:
+	void StepRows(size_t firstRow, size_t lastRow);
+	void Step();
+
+	size_t mNumRows;
+	size_t mNumCols;
+
+	float mK1;
+	float mK2;
+	float mK3;
+
+	float mSpatialStep;
+	float mHalfWidth;
+	float mHalfDepth;
+
+	WaveClock mClock;
+
+	std::vector<uint16_t> mPrevSolution;
+	std::vector<uint16_t> mCurrSolution;
+
+	WaveKernelIsa mKernelIsa;
+	WaveRowKernelHalf mKernel;
+
+	std::unique_ptr<WaveThreadPool> mThreadPool;
+};
+
+// Difference between a half precision run and its float reference.
+struct WaveDrift
+{
+	float MaxAbsError;
+	float RmsError;
+
+	// RMS height of the reference, to put the errors in scale.
+	float ReferenceRms;
+};
+
+// Compares the current heights of two grids of the same size.
+WaveDrift MeasureDrift(const Waves& reference, const HalfWaves& half);
@@ -126,6 +126,18 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		{
 			g_game->SetModeGPU();
 		}
+		else if (wParam == '3')
+		{
+			g_game->ToggleRecording();
+		}
+		else if (wParam == '4')
+		{
+			g_game->TogglePlayback();
+		}
+		else if (wParam == '5')
+		{
+			g_game->ExportProfile();
+		}
 		break;
 
     case WM_PAINT:
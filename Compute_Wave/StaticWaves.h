@@ -0,0 +1,177 @@
+//
+// StaticWaves.h
+// Wave solver with grid dimensions fixed at compile time.
+//
+// Same scheme as Waves for grids whose size is known when the program is
+// built (the demo's 200x200 grid, for instance).  M, N and the row stride are
+// constants, so every index is a constant offset from the row pointer and the
+// loop trip counts are known, which lets the compiler unroll and vectorize
+// the sweep without runtime dispatch.  The two planes live in one 64-byte
+// aligned block allocated once.  Waves remains the solver for sizes chosen
+// at run time.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+#include "WaveTypes.h"
+#include "WaveKernels.h"
+#include "WaveClock.h"
+
+// The sweep is compiled in whatever translation unit instantiates it, so its
+// instruction set would be that unit's baseline.  Where the toolchain can,
+// build AVX-512 and AVX2 clones as well and let the loader pick one, the way
+// the runtime kernels are dispatched.
+#if WAVE_KERNELS_X86 && defined(__GNUC__) && !defined(__clang__) && defined(__linux__)
+#define STATIC_WAVES_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define STATIC_WAVES_TARGETS
+#endif
+
+template<size_t M, size_t N, typename T = float>
+class StaticWaves
+{
+	static_assert(M >= 3 && N >= 3, "the grid needs an interior");
+
+public:
+	static constexpr size_t Rows = M;
+	static constexpr size_t Cols = N;
+	static constexpr size_t Stride = N;
+	static constexpr size_t Cells = M*N;
+
+	StaticWaves()
+	: mK1(0), mK2(0), mK3(0), mSpatialStep(0), mHalfWidth(0), mHalfDepth(0),
+	  mPlanes(new Planes), mPrevSolution(mPlanes->A), mCurrSolution(mPlanes->B)
+	{
+		std::fill(mPrevSolution, mPrevSolution + Cells, T(0));
+		std::fill(mCurrSolution, mCurrSolution + Cells, T(0));
+	}
+
+	StaticWaves(const StaticWaves&) = delete;
+	StaticWaves& operator=(const StaticWaves&) = delete;
+
+	static constexpr size_t RowCount() { return M; }
+	static constexpr size_t ColumnCount() { return N; }
+	static constexpr size_t VertexCount() { return Cells; }
+	static constexpr size_t TriangleCount() { return (M-1)*(N-1)*2; }
+
+	DirectX::XMFLOAT3 operator[](int i)const
+	{
+		size_t row = size_t(i) / N;
+		size_t col = size_t(i) % N;
+
+		float x = -mHalfWidth + col*mSpatialStep;
+		float z = mHalfDepth - row*mSpatialStep;
+
+		return DirectX::XMFLOAT3(x, float(mCurrSolution[i]), z);
+	}
+
+	const T* Heights()const { return mCurrSolution; }
+	T Height(size_t i)const { return mCurrSolution[i]; }
+
+	// As Waves::Init(), without the dimensions.
+	void Init(float dx, float dt, float speed, float damping)
+	{
+		mClock.TimeStep = dt;
+		mClock.Accumulator = 0.0f;
+		mSpatialStep = dx;
+
+		float d = damping*dt+2.0f;
+		float e = (speed*speed)*(dt*dt)/(dx*dx);
+		mK1     = T((damping*dt-2.0f)/ d);
+		mK2     = T((4.0f-8.0f*e) / d);
+		mK3     = T((2.0f*e) / d);
+
+		mHalfWidth = (N-1)*dx*0.5f;
+		mHalfDepth = (M-1)*dx*0.5f;
+
+		std::fill(mPrevSolution, mPrevSolution + Cells, T(0));
+		std::fill(mCurrSolution, mCurrSolution + Cells, T(0));
+	}
+
+	// Fixed-step update, as Waves::Update().
+	WaveStepReport Update(float dt)
+	{
+		WaveStepReport report = mClock.Consume(dt);
+
+		Advance(report.Steps);
+
+		return report;
+	}
+
+	void SetMaxSubsteps(size_t steps) { mClock.MaxSubsteps = std::max<size_t>(steps, 1); }
+
+	void Advance(size_t steps)
+	{
+		for (size_t s = 0; s < steps; ++s)
+		{
+			Sweep(mPrevSolution, mCurrSolution, mK1, mK2, mK3);
+			std::swap(mPrevSolution, mCurrSolution);
+		}
+	}
+
+	void Disturb(size_t i, size_t j, T magnitude)
+	{
+		// Don't disturb boundaries.
+		assert(i > 1 && i < M-2);
+		assert(j > 1 && j < N-2);
+
+		T halfMag = T(0.5)*magnitude;
+
+		// Disturb the ijth vertex height and its neighbors.
+		mCurrSolution[i*N+j]     += magnitude;
+		mCurrSolution[i*N+j+1]   += halfMag;
+		mCurrSolution[i*N+j-1]   += halfMag;
+		mCurrSolution[(i+1)*N+j] += halfMag;
+		mCurrSolution[(i-1)*N+j] += halfMag;
+	}
+
+private:
+	// Overwrites the previous solution with the next one, in the same order of
+	// operations as WaveRowKernel_Scalar.  The planes never overlap, which
+	// __restrict tells the compiler so it can vectorize freely.
+	STATIC_WAVES_TARGETS static void Sweep(T* __restrict prev, const T* __restrict curr, T k1, T k2, T k3)
+	{
+		for (size_t i = 1; i < M-1; ++i)
+		{
+			T* p = prev + i*Stride;
+			const T* c = curr + i*Stride;
+
+			for (size_t j = 1; j < N-1; ++j)
+			{
+				p[j] =
+					k1*p[j] +
+					k2*c[j] +
+					k3*(c[j+Stride] +
+					    c[j-Stride] +
+					    c[j+1] +
+					    c[j-1]);
+			}
+		}
+	}
+
+	// Both planes in one cache line aligned block (C++17 aligned new).
+	struct Planes
+	{
+		alignas(64) T A[Cells];
+		alignas(64) T B[Cells];
+	};
+
+	T mK1;
+	T mK2;
+	T mK3;
+
+	float mSpatialStep;
+	float mHalfWidth;
+	float mHalfDepth;
+
+	WaveClock mClock;
+
+	std::unique_ptr<Planes> mPlanes;
+	T* mPrevSolution;
+	T* mCurrSolution;
+};
@@ -5,11 +5,89 @@
 #pragma once
 
 #include <cmath>
-#include <exception>
+#include <stdexcept>
 #include <stdint.h>
 
+#include "WaveHistogram.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#define STEP_TIMER_CLOCK_GETTIME 1
+#else
+#include <chrono>
+#endif
+
 namespace DX
 {
+    // Monotonic high-resolution counter: QueryPerformanceCounter on Windows,
+    // clock_gettime(CLOCK_MONOTONIC_RAW) on Linux and other POSIX systems
+    // (never slewed by NTP; CLOCK_MONOTONIC where it is missing), and
+    // std::chrono::steady_clock elsewhere.
+    class PerformanceClock
+    {
+    public:
+        // Counts per second.
+        static uint64_t Frequency() noexcept(false)
+        {
+#if defined(_WIN32)
+            static const uint64_t frequency = []()
+            {
+                LARGE_INTEGER f;
+                if (!QueryPerformanceFrequency(&f))
+                {
+                    throw std::runtime_error("QueryPerformanceFrequency");
+                }
+                return static_cast<uint64_t>(f.QuadPart);
+            }();
+            return frequency;
+#elif defined(STEP_TIMER_CLOCK_GETTIME)
+            return 1000000000;
+#else
+            return static_cast<uint64_t>(std::chrono::steady_clock::period::den / std::chrono::steady_clock::period::num);
+#endif
+        }
+
+        static uint64_t Now() noexcept(false)
+        {
+#if defined(_WIN32)
+            LARGE_INTEGER now;
+            if (!QueryPerformanceCounter(&now))
+            {
+                throw std::runtime_error("QueryPerformanceCounter");
+            }
+            return static_cast<uint64_t>(now.QuadPart);
+#elif defined(STEP_TIMER_CLOCK_GETTIME)
+            timespec now;
+#if defined(CLOCK_MONOTONIC_RAW)
+            if (clock_gettime(CLOCK_MONOTONIC_RAW, &now) != 0)
+#else
+            if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+#endif
+            {
+                throw std::runtime_error("clock_gettime");
+            }
+            return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+#else
+            return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+        }
+
+        // Converts a difference of counts to nanoseconds without overflow.
+        static uint64_t ToNanoseconds(uint64_t counts) noexcept(false)
+        {
+            const uint64_t frequency = Frequency();
+            return counts / frequency * 1000000000 + counts % frequency * 1000000000 / frequency;
+        }
+    };
+
     // Helper class for animation and simulation timing.
     class StepTimer
     {
@@ -23,20 +101,15 @@ namespace DX
             m_framesThisSecond(0),
             m_qpcSecondCounter(0),
             m_isFixedTimeStep(false),
-            m_targetElapsedTicks(TicksPerSecond / 60)
+            m_targetElapsedTicks(TicksPerSecond / 60),
+            m_timingFrames(false),
+            m_lastFrameNanoseconds(0)
         {
-            if (!QueryPerformanceFrequency(&m_qpcFrequency))
-            {
-                throw std::exception( "QueryPerformanceFrequency" );
-            }
-
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            m_qpcFrequency = PerformanceClock::Frequency();
+            m_qpcLastTime = PerformanceClock::Now();
 
             // Initialize max delta to 1/10 of a second.
-            m_qpcMaxDelta = static_cast<uint64_t>(m_qpcFrequency.QuadPart / 10);
+            m_qpcMaxDelta = m_qpcFrequency / 10;
         }
 
         // Get elapsed time since the previous Update call.
@@ -53,6 +126,22 @@ namespace DX
         // Get the current framerate.
         uint32_t GetFramesPerSecond() const					{ return m_framesPerSecond; }
 
+        // Distributions, in nanoseconds, of the wall-clock time between Tick
+        // calls (before the clamp), of every Update call, and of the jitter:
+        // the change in frame time from one Tick to the next.  They grow until
+        // ResetHistograms(), so a caller that reports once a second can reset
+        // after each report to see only the last second.
+        const WaveHistogram& GetFrameTimes() const			{ return m_frameTimes; }
+        const WaveHistogram& GetUpdateTimes() const			{ return m_updateTimes; }
+        const WaveHistogram& GetFrameJitter() const			{ return m_frameJitter; }
+
+        void ResetHistograms()
+        {
+            m_frameTimes.Reset();
+            m_updateTimes.Reset();
+            m_frameJitter.Reset();
+        }
+
         // Set whether to use fixed or variable timestep mode.
         void SetFixedTimeStep(bool isFixedTimestep)			{ m_isFixedTimeStep = isFixedTimestep; }
 
@@ -72,10 +161,9 @@ namespace DX
 
         void ResetElapsedTime()
         {
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception("QueryPerformanceCounter");
-            }
+            m_qpcLastTime = PerformanceClock::Now();
+            m_timingFrames = false;
+            m_lastFrameNanoseconds = 0;
 
             m_leftOverTicks = 0;
             m_framesPerSecond = 0;
@@ -88,18 +176,28 @@ namespace DX
         void Tick(const TUpdate& update)
         {
             // Query the current time.
-            LARGE_INTEGER currentTime;
-
-            if (!QueryPerformanceCounter(&currentTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            const uint64_t currentTime = PerformanceClock::Now();
 
-            uint64_t timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+            uint64_t timeDelta = currentTime - m_qpcLastTime;
 
             m_qpcLastTime = currentTime;
             m_qpcSecondCounter += timeDelta;
 
+            // The first Tick after construction or a reset ends no frame, and the
+            // second has no previous frame to compare with.
+            const uint64_t frameNanoseconds = PerformanceClock::ToNanoseconds(timeDelta);
+            if (m_timingFrames)
+            {
+                m_frameTimes.Record(frameNanoseconds);
+                if (m_lastFrameNanoseconds != 0)
+                {
+                    m_frameJitter.Record(frameNanoseconds > m_lastFrameNanoseconds
+                        ? frameNanoseconds - m_lastFrameNanoseconds : m_lastFrameNanoseconds - frameNanoseconds);
+                }
+                m_lastFrameNanoseconds = frameNanoseconds;
+            }
+            m_timingFrames = true;
+
             // Clamp excessively large time deltas (e.g. after paused in the debugger).
             if (timeDelta > m_qpcMaxDelta)
             {
@@ -108,7 +206,7 @@ namespace DX
 
             // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
             timeDelta *= TicksPerSecond;
-            timeDelta /= m_qpcFrequency.QuadPart;
+            timeDelta /= m_qpcFrequency;
 
             uint32_t lastFrameCount = m_frameCount;
 
@@ -137,7 +235,7 @@ namespace DX
                     m_leftOverTicks -= m_targetElapsedTicks;
                     m_frameCount++;
 
-                    update();
+                    TimedUpdate(update);
                 }
             }
             else
@@ -148,7 +246,7 @@ namespace DX
                 m_leftOverTicks = 0;
                 m_frameCount++;
 
-                update();
+                TimedUpdate(update);
             }
 
             // Track the current framerate.
@@ -157,18 +255,26 @@ namespace DX
                 m_framesThisSecond++;
             }
 
-            if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+            if (m_qpcSecondCounter >= m_qpcFrequency)
             {
                 m_framesPerSecond = m_framesThisSecond;
                 m_framesThisSecond = 0;
-                m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+                m_qpcSecondCounter %= m_qpcFrequency;
             }
         }
 
     private:
-        // Source timing data uses QPC units.
-        LARGE_INTEGER m_qpcFrequency;
-        LARGE_INTEGER m_qpcLastTime;
+        template<typename TUpdate>
+        void TimedUpdate(const TUpdate& update)
+        {
+            const uint64_t start = PerformanceClock::Now();
+            update();
+            m_updateTimes.Record(PerformanceClock::ToNanoseconds(PerformanceClock::Now() - start));
+        }
+
+        // Source timing data uses PerformanceClock units.
+        uint64_t m_qpcFrequency;
+        uint64_t m_qpcLastTime;
         uint64_t m_qpcMaxDelta;
 
         // Derived timing data uses a canonical tick format.
@@ -185,5 +291,12 @@ namespace DX
         // Members for configuring fixed timestep mode.
         bool m_isFixedTimeStep;
         uint64_t m_targetElapsedTicks;
+
+        // Members for tracking frame time distributions.
+        WaveHistogram m_frameTimes;
+        WaveHistogram m_updateTimes;
+        WaveHistogram m_frameJitter;
+        bool m_timingFrames;
+        uint64_t m_lastFrameNanoseconds;
     };
 }
@@ -0,0 +1,130 @@
+//
+// WaveAllocator.cpp
+//
+
+#include "WaveAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	const size_t HugePageSize = size_t(2) << 20;
+
+	void* AlignedAlloc(size_t bytes, size_t alignment)
+	{
+#if defined(_WIN32)
+		return _aligned_malloc(bytes, alignment);
+#else
+		void* p = nullptr;
+		if (posix_memalign(&p, std::max(alignment, sizeof(void*)), bytes) != 0)
+		{
+			return nullptr;
+		}
+		return p;
+#endif
+	}
+
+	void AlignedFree(void* p)
+	{
+#if defined(_WIN32)
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+}
+
+WaveHeapAllocator::WaveHeapAllocator(WaveHugePages hugePages)
+#if defined(__linux__)
+: mHugePages(hugePages)
+#else
+: mHugePages(WaveHugePages::Off)
+#endif
+{
+	(void)hugePages;
+}
+
+WaveHeapAllocator::~WaveHeapAllocator()
+{
+	// Every block should have been freed by its owner.
+}
+
+void* WaveHeapAllocator::Allocate(size_t bytes, size_t alignment)
+{
+	if (bytes == 0)
+	{
+		bytes = 1;
+	}
+
+#if defined(__linux__)
+	if (mHugePages != WaveHugePages::Off && bytes >= HugePageSize)
+	{
+		const size_t rounded = (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+
+		if (mHugePages == WaveHugePages::Explicit && alignment <= HugePageSize)
+		{
+			void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p != MAP_FAILED)
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mMapped.push_back(p);
+				return p;
+			}
+		}
+
+		// Whole, aligned huge pages so the kernel can back all of the block.
+		void* p = AlignedAlloc(rounded, std::max(alignment, HugePageSize));
+		if (p)
+		{
+			madvise(p, rounded, MADV_HUGEPAGE);
+		}
+		return p;
+	}
+#endif
+
+	return AlignedAlloc(bytes, alignment);
+}
+
+void WaveHeapAllocator::Free(void* p, size_t bytes)
+{
+	if (!p)
+	{
+		return;
+	}
+
+#if defined(__linux__)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = std::find(mMapped.begin(), mMapped.end(), p);
+		if (it != mMapped.end())
+		{
+			mMapped.erase(it);
+			munmap(p, (bytes + HugePageSize - 1) & ~(HugePageSize - 1));
+			return;
+		}
+	}
+#else
+	(void)bytes;
+#endif
+
+	AlignedFree(p);
+}
+
+size_t WaveHeapAllocator::ExplicitHugePageBlocks()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMapped.size();
+}
+
+WaveAllocator& DefaultWaveAllocator()
+{
+	static WaveHeapAllocator allocator;
+	return allocator;
+}
@@ -0,0 +1,69 @@
+//
+// WaveAllocator.h
+// Memory for the solver's height planes.
+//
+// Waves gets its planes from a WaveAllocator so that applications can place
+// them in their own arenas.  The default, WaveHeapAllocator, returns cache
+// line aligned heap memory and can back large blocks with huge pages on Linux
+// to cut TLB misses on big grids.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+class WaveAllocator
+{
+public:
+	virtual ~WaveAllocator() {}
+
+	// Returns at least bytes of memory aligned to alignment (a power of two),
+	// or nullptr on failure.
+	virtual void* Allocate(size_t bytes, size_t alignment) = 0;
+
+	// Releases a block returned by Allocate(bytes, ...).
+	virtual void Free(void* p, size_t bytes) = 0;
+};
+
+enum class WaveHugePages
+{
+	// Normal pages.
+	Off,
+
+	// Blocks of 2MB and more are 2MB aligned and marked with
+	// madvise(MADV_HUGEPAGE), so the kernel backs them with huge pages when
+	// transparent huge pages are enabled ("madvise" or "always").
+	Transparent,
+
+	// Blocks of 2MB and more are mapped with MAP_HUGETLB from the reserved
+	// huge page pool (vm.nr_hugepages), falling back to Transparent when the
+	// pool is empty.
+	Explicit,
+};
+
+class WaveHeapAllocator : public WaveAllocator
+{
+public:
+	// Huge pages are only available on Linux; elsewhere every mode is Off.
+	explicit WaveHeapAllocator(WaveHugePages hugePages = WaveHugePages::Off);
+	~WaveHeapAllocator();
+
+	void* Allocate(size_t bytes, size_t alignment) override;
+	void Free(void* p, size_t bytes) override;
+
+	WaveHugePages HugePages()const { return mHugePages; }
+
+	// Blocks currently mapped from the explicit huge page pool.
+	size_t ExplicitHugePageBlocks()const;
+
+private:
+	WaveHugePages mHugePages;
+
+	mutable std::mutex mMutex;
+	std::vector<void*> mMapped;
+};
+
+// Shared allocator with huge pages off, used by Waves unless told otherwise.
+WaveAllocator& DefaultWaveAllocator();
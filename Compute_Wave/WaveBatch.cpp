@@ -0,0 +1,64 @@
+//
+// WaveBatch.cpp
+//
+
+#include "WaveBatch.h"
+
+#include <algorithm>
+
+WaveBatch::WaveBatch(size_t threadCount)
+: mThreadPool(threadCount)
+{
+}
+
+size_t WaveBatch::Add(size_t m, size_t n, float dx, float dt, float speed, float damping)
+{
+	mGrids.push_back(std::make_unique<Waves>());
+	mGrids.back()->Init(m, n, dx, dt, speed, damping);
+
+	mReports.push_back(WaveStepReport{ 0, 0.0f });
+
+	return mGrids.size() - 1;
+}
+
+void WaveBatch::Update(float dt)
+{
+	size_t rounds = 0;
+	for (size_t g = 0; g < mGrids.size(); ++g)
+	{
+		mGrids[g]->ApplyDisturbances();
+		mReports[g] = mGrids[g]->ConsumeTime(dt);
+		rounds = std::max(rounds, mReports[g].Steps);
+	}
+
+	// Round r steps every grid that still has more than r steps due.  Grids
+	// with more substeps than others simply take part in more rounds.
+	for (size_t r = 0; r < rounds; ++r)
+	{
+		mTasks.clear();
+		for (size_t g = 0; g < mGrids.size(); ++g)
+		{
+			if (mReports[g].Steps > r)
+			{
+				const size_t bands = mGrids[g]->BandCount();
+				for (size_t b = 0; b < bands; ++b)
+				{
+					mTasks.emplace_back(g, b);
+				}
+			}
+		}
+
+		mThreadPool.Run(mTasks.size(), [&](size_t task)
+		{
+			mGrids[mTasks[task].first]->StepBand(mTasks[task].second);
+		});
+
+		for (size_t g = 0; g < mGrids.size(); ++g)
+		{
+			if (mReports[g].Steps > r)
+			{
+				mGrids[g]->EndStep();
+			}
+		}
+	}
+}
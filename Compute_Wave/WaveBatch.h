@@ -0,0 +1,57 @@
+//
+// WaveBatch.h
+// Many independent wave grids advanced together.
+//
+// Every grid keeps its own size, simulation constants and clock.  Update()
+// gathers the row bands of every grid that has a step due into one job, so a
+// batch of small grids fills the thread pool the way one large grid would.
+//
+
+#pragma once
+
+#include "Waves.h"
+#include "WaveThreadPool.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+class WaveBatch
+{
+public:
+	// threadCount as for WaveThreadPool: includes the caller, 0 = all hardware threads.
+	explicit WaveBatch(size_t threadCount = 0);
+
+	WaveBatch(const WaveBatch&) = delete;
+	WaveBatch& operator=(const WaveBatch&) = delete;
+
+	// Adds a grid initialized with Waves::Init(m, n, dx, dt, speed, damping)
+	// and returns its index.
+	size_t Add(size_t m, size_t n, float dx, float dt, float speed, float damping);
+
+	size_t Count()const { return mGrids.size(); }
+
+	// Direct access to one grid, e.g. for Disturb() or reading heights.  Its own
+	// Update() still works but bypasses the batch scheduling.
+	Waves& operator[](size_t i) { return *mGrids[i]; }
+	const Waves& operator[](size_t i)const { return *mGrids[i]; }
+
+	// Adds dt to every grid's clock and runs the steps that are due, each step
+	// of every grid being one set of parallel row bands.  Per grid results are
+	// identical to calling that grid's Update(dt).
+	void Update(float dt);
+
+	// What the last Update() did for grid i.
+	const WaveStepReport& Report(size_t i)const { return mReports[i]; }
+
+	size_t ThreadCount()const { return mThreadPool.ThreadCount(); }
+
+private:
+	WaveThreadPool mThreadPool;
+
+	std::vector<std::unique_ptr<Waves>> mGrids;
+	std::vector<WaveStepReport> mReports;
+
+	// (grid, band) pairs of the current round; kept to reuse its capacity.
+	std::vector<std::pair<size_t, size_t>> mTasks;
+};
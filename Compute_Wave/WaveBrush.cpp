@@ -0,0 +1,28 @@
+//
+// WaveBrush.cpp
+//
+
+#include "WaveBrush.h"
+
+#include <cmath>
+
+WaveBrush WaveBrush::Gaussian(float sigma)
+{
+	const float k = -0.5f / (sigma*sigma);
+	const float rim = std::exp(k);
+
+	return Custom([=](float t)
+	{
+		return (std::exp(k*t*t) - rim) / (1.0f - rim);
+	});
+}
+
+WaveBrush WaveBrush::Custom(const std::function<float(float)>& profile)
+{
+	WaveBrush brush;
+	for (size_t s = 0; s <= Samples; ++s)
+	{
+		brush.mTable[s] = profile(std::sqrt(float(s) / float(Samples)));
+	}
+	return brush;
+}
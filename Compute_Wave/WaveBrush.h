@@ -0,0 +1,62 @@
+//
+// WaveBrush.h
+// Radial disturbance shapes for Waves::QueueDisturbance().
+//
+// A brush is a radial profile p(t), t = distance / radius in [0, 1], sampled
+// once into a table.  The table is indexed by the squared normalized
+// distance, so stamping an impulse needs no square root per cell.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+class WaveBrush
+{
+public:
+	// Table resolution over the squared normalized distance.
+	static const size_t Samples = 64;
+
+	// Gaussian of standard deviation sigma (relative to the radius), shifted and
+	// rescaled so that it is 1 at the centre and falls to exactly 0 at the rim.
+	static WaveBrush Gaussian(float sigma = 0.4f);
+
+	// Samples profile(t) for t in [0, 1]; the value at t = 0 is the weight of
+	// an impulse's centre.
+	static WaveBrush Custom(const std::function<float(float)>& profile);
+
+	// Weight at squared normalized distance u in [0, 1), linearly interpolated.
+	float Weight(float u)const
+	{
+		const float x = u * float(Samples);
+		const size_t k = size_t(x);
+		const float f = x - float(k);
+		return mTable[k] + f*(mTable[k+1] - mTable[k]);
+	}
+
+private:
+	WaveBrush() {}
+
+	float mTable[Samples + 1];
+};
+
+// One queued disturbance: a brush stamped at a sub-cell position.
+struct WaveImpulse
+{
+	// Centre in cells: Row runs along i (z), Col along j (x).
+	float Row;
+	float Col;
+
+	// Radius in cells, at least 1.
+	float Radius;
+
+	// Height added at the centre, scaled by the brush elsewhere.
+	float Magnitude;
+
+	uint32_t Brush;
+
+	// Sort key: the tile the centre falls in.
+	uint32_t Tile;
+};
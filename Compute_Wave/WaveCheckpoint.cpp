@@ -0,0 +1,75 @@
+//
+// WaveCheckpoint.cpp
+//
+
+#include "WaveCheckpoint.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+WaveFileMapping::WaveFileMapping(const char* path)
+: mData(nullptr), mSize(0)
+{
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (mapping)
+		{
+			mData = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			mSize = mData ? size_t(size.QuadPart) : 0;
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* p = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			// Start reading ahead now; the pages are faulted in by the first steps.
+			madvise(p, size_t(st.st_size), MADV_WILLNEED);
+			mData = p;
+			mSize = size_t(st.st_size);
+		}
+	}
+	close(fd);
+#endif
+}
+
+WaveFileMapping::~WaveFileMapping()
+{
+	if (!mData)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(mData);
+#else
+	munmap(mData, mSize);
+#endif
+}
@@ -0,0 +1,73 @@
+//
+// WaveCheckpoint.h
+// On-disk layout of a Waves checkpoint (Waves::Save / Waves::Load).
+//
+// A checkpoint is one page of header followed by the height plane block
+// exactly as Waves keeps it in memory: the previous plane, then the current
+// one, each PlaneStride floats long with rows RowStride floats apart.  The
+// block starts on a page boundary, so Load() maps the file copy-on-write
+// and steps the mapped planes directly; nothing is parsed or copied.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+const char WaveCheckpointMagic[8] = { 'W', 'A', 'V', 'E', 'C', 'K', 'P', 'T' };
+
+// Bump on any change to the header or to the plane layout.
+const uint32_t WaveCheckpointVersion = 1;
+
+// Written as 0x01020304; reads back differently on a machine of the other byte order.
+const uint32_t WaveCheckpointByteOrder = 0x01020304;
+
+// Header size and plane alignment in the file.
+const size_t WaveCheckpointPageSize = 4096;
+
+struct WaveCheckpointHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t ByteOrder;
+
+	// Offset of the plane block; a whole number of pages.
+	uint64_t HeaderBytes;
+
+	// Grid size, and the plane layout in floats.
+	uint64_t Rows;
+	uint64_t Cols;
+	uint64_t RowStride;
+	uint64_t PlaneStride;
+
+	float SpatialStep;
+	float K1;
+	float K2;
+	float K3;
+
+	// Fixed-step clock.
+	float TimeStep;
+	float Accumulator;
+};
+
+static_assert(sizeof(WaveCheckpointHeader) <= WaveCheckpointPageSize, "header must fit its page");
+
+// A whole file mapped copy-on-write: writes through Data() stay private to
+// this process and never reach the file.  Data() is null if the file could
+// not be opened or mapped.
+class WaveFileMapping
+{
+public:
+	explicit WaveFileMapping(const char* path);
+	~WaveFileMapping();
+
+	WaveFileMapping(const WaveFileMapping&) = delete;
+	WaveFileMapping& operator=(const WaveFileMapping&) = delete;
+
+	void* Data()const { return mData; }
+	size_t Size()const { return mSize; }
+
+private:
+	void* mData;
+	size_t mSize;
+};
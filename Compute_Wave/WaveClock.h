@@ -0,0 +1,57 @@
+//
+// WaveClock.h
+// Fixed-step clock shared by the wave solvers.
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// What one call to Update() did.
+struct WaveStepReport
+{
+	// Fixed steps simulated.
+	size_t Steps;
+
+	// Elapsed time discarded because it exceeded the substep budget.
+	float DroppedTime;
+};
+
+// Accumulates elapsed time and turns it into a number of fixed steps, at most
+// MaxSubsteps per call.  Whole steps over the budget are dropped; the
+// fractional remainder carries over, so the phase of the clock is preserved.
+struct WaveClock
+{
+	float TimeStep = 0.0f;
+	float Accumulator = 0.0f;
+
+	// Enough to keep real time down to ~4 fps with the demo's 30ms step.
+	size_t MaxSubsteps = 8;
+
+	WaveStepReport Consume(float dt)
+	{
+		WaveStepReport report = { 0, 0.0f };
+
+		if (TimeStep <= 0.0f)
+		{
+			return report;
+		}
+
+		Accumulator += dt;
+
+		while (Accumulator >= TimeStep && report.Steps < MaxSubsteps)
+		{
+			Accumulator -= TimeStep;
+			++report.Steps;
+		}
+
+		if (Accumulator >= TimeStep)
+		{
+			report.DroppedTime = Accumulator - std::fmod(Accumulator, TimeStep);
+			Accumulator -= report.DroppedTime;
+		}
+
+		return report;
+	}
+};
@@ -0,0 +1,10 @@
+//
+// WaveCompute.cpp
+//
+
+#include "WaveCompute.h"
+
+WaveComputeDevice::WaveComputeDevice(size_t threadCount)
+: mPool(threadCount)
+{
+}
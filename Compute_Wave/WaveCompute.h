@@ -0,0 +1,128 @@
+//
+// WaveCompute.h
+// Runs compute-shader style kernels on CPU threads.
+//
+// Dispatch() follows the D3D11 model: a grid of thread groups of
+// numthreads(X, Y, Z) threads, every thread told its SV_DispatchThreadID,
+// SV_GroupID and SV_GroupThreadID.  Each group is one task on a
+// WaveThreadPool and runs its threads one after another, so, as on a GPU,
+// groups may run in any order and at the same time: a kernel must not read
+// what another group of the same dispatch writes.  Group shared memory and
+// barriers are not modelled.
+//
+// WaveTextureView stands in for RWTexture2D<float> over a float plane, with
+// the out-of-range rules D3D11 gives UAVs: reads return 0 and writes are
+// dropped.  The wave shaders rely on both at the edges of the grid.
+//
+
+#pragma once
+
+#include "WaveThreadPool.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// System values of one kernel invocation.
+struct WaveThreadIds
+{
+	uint32_t DispatchThread[3];	// SV_DispatchThreadID
+	uint32_t Group[3];			// SV_GroupID
+	uint32_t GroupThread[3];	// SV_GroupThreadID
+};
+
+// numthreads(X, Y, Z) of a kernel.
+struct WaveGroupSize
+{
+	uint32_t X;
+	uint32_t Y;
+	uint32_t Z;
+};
+
+class WaveTextureView
+{
+public:
+	WaveTextureView() : mData(nullptr), mWidth(0), mHeight(0), mPitch(0) {}
+
+	// width x height texels, rows pitch floats apart.  Does not own data.
+	WaveTextureView(float* data, uint32_t width, uint32_t height, size_t pitch)
+	: mData(data), mWidth(width), mHeight(height), mPitch(pitch) {}
+
+	bool Contains(int x, int y)const { return uint32_t(x) < mWidth && uint32_t(y) < mHeight; }
+
+	float Load(int x, int y)const { return Contains(x, y) ? mData[size_t(y)*mPitch + size_t(x)] : 0.0f; }
+
+	void Store(int x, int y, float value)const
+	{
+		if (Contains(x, y))
+		{
+			mData[size_t(y)*mPitch + size_t(x)] = value;
+		}
+	}
+
+	float* Data()const { return mData; }
+	uint32_t Width()const { return mWidth; }
+	uint32_t Height()const { return mHeight; }
+	size_t Pitch()const { return mPitch; }
+
+private:
+	float* mData;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	size_t mPitch;
+};
+
+class WaveComputeDevice
+{
+public:
+	// threadCount as for WaveThreadPool: 0 uses every hardware thread.
+	explicit WaveComputeDevice(size_t threadCount = 0);
+
+	size_t ThreadCount()const { return mPool.ThreadCount(); }
+
+	// Groups of groupSize threads that cover size threads.  Rounds up: the
+	// last group may run past the edge, where the views drop its writes.
+	static uint32_t GroupCount(uint32_t size, uint32_t groupSize) { return (size + groupSize - 1) / groupSize; }
+
+	// Calls kernel(const WaveThreadIds&) for every thread of groupsX x
+	// groupsY x groupsZ groups of groupSize threads, and returns when all
+	// have run.
+	template<typename Kernel>
+	void Dispatch(uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ, const WaveGroupSize& groupSize, const Kernel& kernel);
+
+private:
+	WaveThreadPool mPool;
+};
+
+template<typename Kernel>
+void WaveComputeDevice::Dispatch(uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ, const WaveGroupSize& groupSize, const Kernel& kernel)
+{
+	const size_t groups = size_t(groupsX)*groupsY*groupsZ;
+	if (groups == 0)
+	{
+		return;
+	}
+
+	mPool.Run(groups, [&](size_t group)
+	{
+		WaveThreadIds id;
+		id.Group[0] = uint32_t(group % groupsX);
+		id.Group[1] = uint32_t(group / groupsX % groupsY);
+		id.Group[2] = uint32_t(group / groupsX / groupsY);
+
+		const uint32_t size[3] = { groupSize.X, groupSize.Y, groupSize.Z };
+		for (id.GroupThread[2] = 0; id.GroupThread[2] < size[2]; ++id.GroupThread[2])
+		{
+			for (id.GroupThread[1] = 0; id.GroupThread[1] < size[1]; ++id.GroupThread[1])
+			{
+				for (id.GroupThread[0] = 0; id.GroupThread[0] < size[0]; ++id.GroupThread[0])
+				{
+					for (size_t k = 0; k < 3; ++k)
+					{
+						id.DispatchThread[k] = id.Group[k]*size[k] + id.GroupThread[k];
+					}
+					kernel(id);
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,183 @@
+//
+// WaveCuller.cpp
+//
+
+#include "WaveCuller.h"
+#include "WaveMesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define WAVE_CULLER_SSE 1
+#else
+#define WAVE_CULLER_SSE 0
+#endif
+
+namespace
+{
+	const size_t BoxesPerBatch = 4;
+
+	// Whether a box is wholly on the negative side of a plane.  The vector
+	// path evaluates the same expressions in the same order.
+	bool Outside(const float* plane, float cx, float cy, float cz, float ex, float ey, float ez)
+	{
+		const float d = plane[0]*cx + plane[1]*cy + plane[2]*cz + plane[3];
+		const float r = std::fabs(plane[0])*ex + std::fabs(plane[1])*ey + std::fabs(plane[2])*ez;
+		return d + r < 0.0f;
+	}
+}
+
+WaveFrustum WaveFrustum::FromViewProjection(const float* m)
+{
+	// Column k of m gives clip coordinate k; inside is -w <= x, y <= w and
+	// 0 <= z <= w.
+	auto column = [m](size_t k, size_t i) { return m[i*4 + k]; };
+
+	WaveFrustum frustum;
+	for (size_t i = 0; i < 4; ++i)
+	{
+		frustum.Planes[0][i] = column(3, i) + column(0, i);
+		frustum.Planes[1][i] = column(3, i) - column(0, i);
+		frustum.Planes[2][i] = column(3, i) + column(1, i);
+		frustum.Planes[3][i] = column(3, i) - column(1, i);
+		frustum.Planes[4][i] = column(2, i);
+		frustum.Planes[5][i] = column(3, i) - column(2, i);
+	}
+
+	for (float* plane : frustum.Planes)
+	{
+		const float length = std::sqrt(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+		if (length > 0.0f)
+		{
+			for (size_t i = 0; i < 4; ++i)
+			{
+				plane[i] /= length;
+			}
+		}
+	}
+	return frustum;
+}
+
+WaveCuller::WaveCuller()
+: mCount(0)
+{
+}
+
+void WaveCuller::Resize(size_t count)
+{
+	mCount = count;
+
+	const size_t padded = (count + BoxesPerBatch - 1) / BoxesPerBatch * BoxesPerBatch;
+	for (std::vector<float>* v : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ })
+	{
+		v->assign(padded, 0.0f);
+	}
+}
+
+void WaveCuller::SetBox(size_t box, const float minCorner[3], const float maxCorner[3])
+{
+	mCenterX[box] = 0.5f*(minCorner[0] + maxCorner[0]);
+	mCenterY[box] = 0.5f*(minCorner[1] + maxCorner[1]);
+	mCenterZ[box] = 0.5f*(minCorner[2] + maxCorner[2]);
+	mExtentX[box] = 0.5f*(maxCorner[0] - minCorner[0]);
+	mExtentY[box] = 0.5f*(maxCorner[1] - minCorner[1]);
+	mExtentZ[box] = 0.5f*(maxCorner[2] - minCorner[2]);
+}
+
+void WaveCuller::SetPatchBoxes(const WaveLodMesh& mesh, const float* minHeights, const float* maxHeights)
+{
+	if (mCount != mesh.PatchCount())
+	{
+		Resize(mesh.PatchCount());
+	}
+
+	const float step = mesh.SpatialStep();
+	const float halfWidth = 0.5f*float(mesh.ColumnCount() - 1)*step;
+	const float halfDepth = 0.5f*float(mesh.RowCount() - 1)*step;
+
+	for (size_t patch = 0; patch < mCount; ++patch)
+	{
+		const WaveMeshPatch p = mesh.Patch(patch);
+		const float minCorner[3] = { -halfWidth + float(p.Column)*step, minHeights[patch], halfDepth - float(p.Row + p.Rows)*step };
+		const float maxCorner[3] = { -halfWidth + float(p.Column + p.Columns)*step, maxHeights[patch], halfDepth - float(p.Row)*step };
+		SetBox(patch, minCorner, maxCorner);
+	}
+}
+
+size_t WaveCuller::Cull(const WaveFrustum& frustum, uint8_t* visible)const
+{
+#if WAVE_CULLER_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	__m128 planes[6][4];
+	__m128 absNormals[6][3];
+	for (size_t p = 0; p < 6; ++p)
+	{
+		for (size_t i = 0; i < 4; ++i)
+		{
+			planes[p][i] = _mm_set1_ps(frustum.Planes[p][i]);
+		}
+		for (size_t i = 0; i < 3; ++i)
+		{
+			absNormals[p][i] = _mm_andnot_ps(signBit, planes[p][i]);
+		}
+	}
+
+	// A local count: visible may alias the members as far as the compiler knows.
+	const size_t boxes = mCount;
+	size_t count = 0;
+	for (size_t b = 0; b < boxes; b += BoxesPerBatch)
+	{
+		const __m128 cx = _mm_loadu_ps(&mCenterX[b]);
+		const __m128 cy = _mm_loadu_ps(&mCenterY[b]);
+		const __m128 cz = _mm_loadu_ps(&mCenterZ[b]);
+		const __m128 ex = _mm_loadu_ps(&mExtentX[b]);
+		const __m128 ey = _mm_loadu_ps(&mExtentY[b]);
+		const __m128 ez = _mm_loadu_ps(&mExtentZ[b]);
+
+		// Most boxes outside are outside the first plane or two, as in the
+		// scalar test; stop once all four are.
+		__m128 outside = _mm_setzero_ps();
+		for (size_t p = 0; p < 6 && _mm_movemask_ps(outside) != 0xf; ++p)
+		{
+			__m128 d = _mm_add_ps(_mm_mul_ps(planes[p][0], cx), _mm_mul_ps(planes[p][1], cy));
+			d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(planes[p][2], cz)), planes[p][3]);
+
+			__m128 r = _mm_add_ps(_mm_mul_ps(absNormals[p][0], ex), _mm_mul_ps(absNormals[p][1], ey));
+			r = _mm_add_ps(r, _mm_mul_ps(absNormals[p][2], ez));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+		}
+
+		const int mask = _mm_movemask_ps(outside);
+		const size_t last = std::min(b + BoxesPerBatch, boxes);
+		for (size_t k = b; k < last; ++k)
+		{
+			visible[k] = (mask >> (k - b)) & 1 ? 0 : 1;
+			count += visible[k];
+		}
+	}
+	return count;
+#else
+	return CullScalar(frustum, visible);
+#endif
+}
+
+size_t WaveCuller::CullScalar(const WaveFrustum& frustum, uint8_t* visible)const
+{
+	size_t count = 0;
+	for (size_t b = 0; b < mCount; ++b)
+	{
+		bool outside = false;
+		for (size_t p = 0; p < 6 && !outside; ++p)
+		{
+			outside = Outside(frustum.Planes[p], mCenterX[b], mCenterY[b], mCenterZ[b], mExtentX[b], mExtentY[b], mExtentZ[b]);
+		}
+		visible[b] = outside ? 0 : 1;
+		count += visible[b];
+	}
+	return count;
+}
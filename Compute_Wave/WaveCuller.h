@@ -0,0 +1,65 @@
+//
+// WaveCuller.h
+// View frustum culling of axis-aligned boxes, such as the patches of a
+// WaveLodMesh.
+//
+// The boxes are kept as centres and half extents in separate arrays, so the
+// plane tests run on four boxes at a time with SSE.  A box is culled when it
+// lies wholly outside one of the six planes; a box outside the frustum but
+// across every plane (near an edge or corner) is kept, which costs a draw but
+// never drops a visible one.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WaveLodMesh;
+
+struct WaveFrustum
+{
+	// (a, b, c, d) of the left, right, bottom, top, near and far planes; a
+	// point is inside when a*x + b*y + c*z + d >= 0 for all six.  Normalized,
+	// so that is the distance to the plane.
+	float Planes[6][4];
+
+	// Planes of a view-projection matrix stored row-major for row vectors
+	// (clip = [x y z 1] * m, as DirectXMath and SimpleMath store it), with
+	// Direct3D's 0 <= z <= w depth range.
+	static WaveFrustum FromViewProjection(const float* m);
+};
+
+class WaveCuller
+{
+public:
+	WaveCuller();
+
+	// Count boxes, all empty at the origin until set.
+	void Resize(size_t count);
+	size_t Count()const { return mCount; }
+
+	void SetBox(size_t box, const float minCorner[3], const float maxCorner[3]);
+
+	// One box per patch of mesh, laid out as Waves lays out its grid, from
+	// x and z of the patch and its height range: minHeights and maxHeights
+	// hold a value per patch, as Waves::HeightBounds() writes them for
+	// blocks of mesh.PatchRowQuads() x mesh.PatchQuads().  Resizes to the
+	// patch count.
+	void SetPatchBoxes(const WaveLodMesh& mesh, const float* minHeights, const float* maxHeights);
+
+	// Writes 1 to visible[box] for every box that may be in the frustum and
+	// 0 for the others.  Returns the number visible.
+	size_t Cull(const WaveFrustum& frustum, uint8_t* visible)const;
+
+	// The same test a box at a time, without SIMD; gives the same answers.
+	size_t CullScalar(const WaveFrustum& frustum, uint8_t* visible)const;
+
+private:
+	size_t mCount;
+
+	// Padded with empty boxes to a multiple of 4.
+	std::vector<float> mCenterX, mCenterY, mCenterZ;
+	std::vector<float> mExtentX, mExtentY, mExtentZ;
+};
@@ -0,0 +1,93 @@
+//
+// WaveHalf.h
+// IEEE 754 binary16 conversions for the half precision height storage.
+//
+// These round to nearest even and keep subnormals, exactly like the F16C and
+// AVX-512 conversion instructions, so scalar and vector kernels agree bit for bit.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+inline uint16_t FloatToHalf(float f)
+{
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+
+	const uint16_t sign = uint16_t((x >> 16) & 0x8000);
+	const uint32_t absx = x & 0x7fffffff;
+
+	// Inf and NaN (kept quiet).
+	if (absx >= 0x7f800000)
+	{
+		return uint16_t(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 | ((absx >> 13) & 0x3ff) : 0));
+	}
+
+	// 65520 and above round to infinity.
+	if (absx >= 0x477ff000)
+	{
+		return uint16_t(sign | 0x7c00);
+	}
+
+	// Below the smallest normal half (2^-14): subnormal or zero.
+	if (absx < 0x38800000)
+	{
+		// At most half the smallest subnormal (2^-25) rounds to zero.
+		if (absx <= 0x33000000)
+		{
+			return sign;
+		}
+
+		const uint32_t mant = (absx & 0x7fffff) | 0x800000;
+		const uint32_t shift = 126 - (absx >> 23);
+		const uint32_t rem = mant & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+
+		uint32_t h = mant >> shift;
+		if (rem > halfway || (rem == halfway && (h & 1)))
+		{
+			++h;
+		}
+		return uint16_t(sign | h);
+	}
+
+	// Normal: rebias the exponent and round the mantissa; a carry correctly
+	// bumps the exponent.
+	uint32_t h = (absx - 0x38000000) >> 13;
+	const uint32_t rem = absx & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+	{
+		++h;
+	}
+	return uint16_t(sign | h);
+}
+
+inline float HalfToFloat(uint16_t h)
+{
+	const uint32_t sign = uint32_t(h & 0x8000) << 16;
+	const uint32_t exp = (h >> 10) & 0x1f;
+	const uint32_t mant = h & 0x3ff;
+
+	uint32_t x;
+	if (exp == 0)
+	{
+		// Zero or subnormal: mant * 2^-24 is exact in float.
+		float f = float(mant) * (1.0f / 16777216.0f);
+		std::memcpy(&x, &f, sizeof(x));
+		x |= sign;
+	}
+	else if (exp == 31)
+	{
+		x = sign | 0x7f800000 | (mant << 13);
+	}
+	else
+	{
+		x = sign | ((exp + 112) << 23) | (mant << 13);
+	}
+
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+}
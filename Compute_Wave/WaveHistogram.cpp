@@ -0,0 +1,180 @@
+//
+// WaveHistogram.cpp
+//
+
+#include "WaveHistogram.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// Index of the highest set bit; value must not be 0.
+	unsigned HighestBit(uint64_t value)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return unsigned(index);
+#elif defined(__GNUC__) || defined(__clang__)
+		return 63u - unsigned(__builtin_clzll(value));
+#else
+		unsigned index = 0;
+		while (value >>= 1)
+		{
+			++index;
+		}
+		return index;
+#endif
+	}
+}
+
+WaveHistogram::WaveHistogram(uint64_t maxValue, unsigned precisionBits)
+: mPrecisionBits(std::min(std::max(precisionBits, 4u), 16u)), mMaxValue(std::max<uint64_t>(maxValue, 1)),
+  mCount(0), mMin(UINT64_MAX), mMax(0), mClamped(0)
+{
+	mCounts.assign(BucketOf(mMaxValue) + 1, 0);
+}
+
+// Below 2^bits a bucket per value; above, value >> e lands in the upper half
+// of the exact range, offset by e half-ranges.
+size_t WaveHistogram::BucketOf(uint64_t value)const
+{
+	const uint64_t exact = uint64_t(1) << mPrecisionBits;
+	if (value < exact)
+	{
+		return size_t(value);
+	}
+
+	const unsigned e = HighestBit(value) - mPrecisionBits + 1;
+	return size_t(e) * size_t(exact / 2) + size_t(value >> e);
+}
+
+uint64_t WaveHistogram::LowestOf(size_t bucket)const
+{
+	const size_t exact = size_t(1) << mPrecisionBits;
+	if (bucket < exact)
+	{
+		return bucket;
+	}
+
+	const size_t half = exact / 2;
+	const unsigned e = unsigned(bucket / half - 1);
+	return uint64_t(bucket - e * half) << e;
+}
+
+uint64_t WaveHistogram::HighestOf(size_t bucket)const
+{
+	return bucket + 1 < mCounts.size() ? LowestOf(bucket + 1) - 1 : mMaxValue;
+}
+
+void WaveHistogram::Record(uint64_t value)
+{
+	if (value > mMaxValue)
+	{
+		value = mMaxValue;
+		++mClamped;
+	}
+
+	++mCounts[BucketOf(value)];
+	++mCount;
+	mMin = std::min(mMin, value);
+	mMax = std::max(mMax, value);
+}
+
+void WaveHistogram::Reset()
+{
+	std::fill(mCounts.begin(), mCounts.end(), 0);
+	mCount = 0;
+	mMin = UINT64_MAX;
+	mMax = 0;
+	mClamped = 0;
+}
+
+void WaveHistogram::Merge(const WaveHistogram& other)
+{
+	assert(other.mPrecisionBits == mPrecisionBits && other.mMaxValue == mMaxValue);
+
+	for (size_t b = 0; b < mCounts.size(); ++b)
+	{
+		mCounts[b] += other.mCounts[b];
+	}
+	mCount += other.mCount;
+	mMin = std::min(mMin, other.mMin);
+	mMax = std::max(mMax, other.mMax);
+	mClamped += other.mClamped;
+}
+
+double WaveHistogram::Mean()const
+{
+	if (mCount == 0)
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (size_t b = 0; b < mCounts.size(); ++b)
+	{
+		if (mCounts[b] != 0)
+		{
+			sum += double(mCounts[b]) * 0.5 * (double(LowestOf(b)) + double(HighestOf(b)));
+		}
+	}
+	return sum / double(mCount);
+}
+
+double WaveHistogram::StdDev()const
+{
+	if (mCount < 2)
+	{
+		return 0.0;
+	}
+
+	const double mean = Mean();
+	double sum = 0.0;
+	for (size_t b = 0; b < mCounts.size(); ++b)
+	{
+		if (mCounts[b] != 0)
+		{
+			const double d = 0.5 * (double(LowestOf(b)) + double(HighestOf(b))) - mean;
+			sum += double(mCounts[b]) * d * d;
+		}
+	}
+	return std::sqrt(sum / double(mCount - 1));
+}
+
+uint64_t WaveHistogram::ValueAtPercentile(double percent)const
+{
+	if (mCount == 0)
+	{
+		return 0;
+	}
+
+	const double p = std::min(std::max(percent, 0.0), 100.0);
+	const uint64_t rank = std::max<uint64_t>(uint64_t(std::ceil(p / 100.0 * double(mCount))), 1);
+
+	uint64_t seen = 0;
+	for (size_t b = 0; b < mCounts.size(); ++b)
+	{
+		seen += mCounts[b];
+		if (seen >= rank)
+		{
+			return std::min(HighestOf(b), mMax);
+		}
+	}
+	return mMax;
+}
+
+void WaveHistogram::Print(std::FILE* out, const char* title, double scale)const
+{
+	std::fprintf(out, "%-13s n %llu  mean %.3f  sd %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  p99.99 %.3f  max %.3f\n",
+		title, (unsigned long long)mCount, Mean() / scale, StdDev() / scale,
+		double(ValueAtPercentile(50.0)) / scale, double(ValueAtPercentile(90.0)) / scale,
+		double(ValueAtPercentile(99.0)) / scale, double(ValueAtPercentile(99.9)) / scale,
+		double(ValueAtPercentile(99.99)) / scale, double(Max()) / scale);
+}
@@ -0,0 +1,66 @@
+//
+// WaveHistogram.h
+// Fixed-memory histogram of durations with bounded relative error, in the
+// style of HdrHistogram.
+//
+// Values below 2^precisionBits are counted exactly.  Above that, every
+// power-of-two range is split into 2^(precisionBits-1) equal buckets, so a
+// value is known to within 1 part in 2^(precisionBits-1) whatever its size,
+// and Record() is a bit scan, a shift and an increment.  Tail percentiles of
+// millions of frames cost a few kilobytes.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class WaveHistogram
+{
+public:
+	// Values above maxValue are counted as maxValue.  precisionBits is 4..16.
+	explicit WaveHistogram(uint64_t maxValue = uint64_t(3600) * 1000000000, unsigned precisionBits = 8);
+
+	void Record(uint64_t value);
+	void Reset();
+
+	// Adds every value of other, which must have the same maxValue and precision.
+	void Merge(const WaveHistogram& other);
+
+	uint64_t Count()const { return mCount; }
+
+	// Exact, as recorded; 0 when empty.
+	uint64_t Min()const { return mCount ? mMin : 0; }
+	uint64_t Max()const { return mMax; }
+
+	// From the bucket midpoints.
+	double Mean()const;
+	double StdDev()const;
+
+	// Smallest value that percent (0..100) of the recorded values are at or
+	// below, rounded up to the top of its bucket but never above Max().
+	uint64_t ValueAtPercentile(double percent)const;
+
+	// Values above maxValue that were clamped to it.
+	uint64_t Clamped()const { return mClamped; }
+
+	// Prints ValueAtPercentile() at 50, 90, 99, 99.9, 99.99 and 100 percent,
+	// divided by scale (e.g. 1e6 to print nanoseconds as milliseconds).
+	void Print(std::FILE* out, const char* title, double scale)const;
+
+private:
+	size_t BucketOf(uint64_t value)const;
+	uint64_t LowestOf(size_t bucket)const;
+	uint64_t HighestOf(size_t bucket)const;
+
+	unsigned mPrecisionBits;
+	uint64_t mMaxValue;
+	std::vector<uint64_t> mCounts;
+
+	uint64_t mCount;
+	uint64_t mMin;
+	uint64_t mMax;
+	uint64_t mClamped;
+};
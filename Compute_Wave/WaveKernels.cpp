@@ -0,0 +1,184 @@
+//
+// WaveKernels.cpp
+// Scalar stencil kernel and cpuid based kernel selection.
+//
+
+#include "WaveKernels.h"
+#include "WaveHalf.h"
+
+#if WAVE_KERNELS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+void WaveRowKernel_Scalar(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	for(size_t j = 0; j < count; ++j)
+	{
+		// Overwriting prev in place is fine: prev_ij is not needed again and
+		// the assignment happens last.
+		prev[j] =
+			k.K1*prev[j] +
+			k.K2*curr[j] +
+			k.K3*(curr[j+stride] +
+			      curr[j-stride] +
+			      curr[j+1] +
+			      curr[j-1]);
+	}
+}
+
+void WaveRowKernelHalf_Scalar(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	for(size_t j = 0; j < count; ++j)
+	{
+		float p = HalfToFloat(prev[j]);
+		float c = HalfToFloat(curr[j]);
+
+		float n = HalfToFloat(curr[j+stride]) + HalfToFloat(curr[j-stride]);
+		n = n + HalfToFloat(curr[j+1]);
+		n = n + HalfToFloat(curr[j-1]);
+
+		prev[j] = FloatToHalf(k.K1*p + k.K2*c + k.K3*n);
+	}
+}
+
+namespace
+{
+#if WAVE_KERNELS_X86
+	bool CpuHasF16C()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 29)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("f16c") != 0;
+#endif
+	}
+
+	bool CpuSupports(WaveKernelIsa isa)
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		const bool sse41   = (info[2] & (1 << 19)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+
+		// The OS must save the upper vector state for AVX and AVX-512.
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		const bool ymmState = (xcr0 & 0x06) == 0x06;
+		const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+		int leaf7[4] = {};
+		if (maxLeaf >= 7)
+		{
+			__cpuidex(leaf7, 7, 0);
+		}
+		const bool avx2    = (leaf7[1] & (1 << 5)) != 0;
+		const bool avx512f = (leaf7[1] & (1 << 16)) != 0;
+
+		switch (isa)
+		{
+		case WaveKernelIsa::Scalar: return true;
+		case WaveKernelIsa::SSE4:   return sse41;
+		case WaveKernelIsa::AVX2:   return avx && avx2 && ymmState;
+		case WaveKernelIsa::AVX512: return avx512f && zmmState;
+		}
+		return false;
+#else
+		__builtin_cpu_init();
+
+		switch (isa)
+		{
+		case WaveKernelIsa::Scalar: return true;
+		case WaveKernelIsa::SSE4:   return __builtin_cpu_supports("sse4.1");
+		case WaveKernelIsa::AVX2:   return __builtin_cpu_supports("avx2");
+		case WaveKernelIsa::AVX512: return __builtin_cpu_supports("avx512f");
+		}
+		return false;
+#endif
+	}
+#else
+	bool CpuSupports(WaveKernelIsa isa)
+	{
+		return isa == WaveKernelIsa::Scalar;
+	}
+
+	bool CpuHasF16C()
+	{
+		return false;
+	}
+#endif
+}
+
+WaveKernelIsa DetectWaveKernelIsa()
+{
+	static const WaveKernelIsa best = []()
+	{
+		const WaveKernelIsa order[] = { WaveKernelIsa::AVX512, WaveKernelIsa::AVX2, WaveKernelIsa::SSE4 };
+		for (WaveKernelIsa isa : order)
+		{
+			if (CpuSupports(isa))
+			{
+				return isa;
+			}
+		}
+		return WaveKernelIsa::Scalar;
+	}();
+
+	return best;
+}
+
+WaveRowKernel GetWaveRowKernel(WaveKernelIsa isa)
+{
+	if (!CpuSupports(isa))
+	{
+		return nullptr;
+	}
+
+	switch (isa)
+	{
+	case WaveKernelIsa::Scalar: return &WaveRowKernel_Scalar;
+#if WAVE_KERNELS_X86
+	case WaveKernelIsa::SSE4:   return &WaveRowKernel_SSE4;
+	case WaveKernelIsa::AVX2:   return &WaveRowKernel_AVX2;
+	case WaveKernelIsa::AVX512: return &WaveRowKernel_AVX512;
+#endif
+	default:                    return nullptr;
+	}
+}
+
+WaveRowKernelHalf GetWaveRowKernelHalf(WaveKernelIsa isa)
+{
+	if (!CpuSupports(isa))
+	{
+		return nullptr;
+	}
+
+	switch (isa)
+	{
+	case WaveKernelIsa::Scalar: return &WaveRowKernelHalf_Scalar;
+#if WAVE_KERNELS_X86
+	case WaveKernelIsa::AVX2:   return CpuHasF16C() ? &WaveRowKernelHalf_AVX2 : nullptr;
+	case WaveKernelIsa::AVX512: return &WaveRowKernelHalf_AVX512;
+#endif
+	default:                    return nullptr;
+	}
+}
+
+const char* WaveKernelIsaName(WaveKernelIsa isa)
+{
+	switch (isa)
+	{
+	case WaveKernelIsa::Scalar: return "scalar";
+	case WaveKernelIsa::SSE4:   return "sse4";
+	case WaveKernelIsa::AVX2:   return "avx2";
+	case WaveKernelIsa::AVX512: return "avx512";
+	}
+	return "unknown";
+}
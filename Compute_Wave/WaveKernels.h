@@ -0,0 +1,77 @@
+//
+// WaveKernels.h
+// Row kernels for the 5-point wave stencil and runtime selection between them.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WAVE_KERNELS_X86 1
+#else
+#define WAVE_KERNELS_X86 0
+#endif
+
+// Simulation constants of the finite difference scheme (see Waves::Init).
+struct WaveConstants
+{
+	float K1;
+	float K2;
+	float K3;
+};
+
+// Updates count consecutive cells of one row in place:
+//
+//   prev[j] = K1*prev[j] + K2*curr[j] + K3*(curr[j+stride] + curr[j-stride] + curr[j+1] + curr[j-1])
+//
+// prev and curr point at the first cell to update; stride is the distance in
+// floats between two rows.  The neighbours at j-1, j+count, and the rows above
+// and below must be readable.
+typedef void (*WaveRowKernel)(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k);
+
+// Same stencil over IEEE half heights: each cell is widened to float, updated
+// in float and rounded back to half (round to nearest even).
+typedef void (*WaveRowKernelHalf)(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k);
+
+enum class WaveKernelIsa
+{
+	Scalar,
+	SSE4,
+	AVX2,
+	AVX512,
+};
+
+// Every kernel evaluates the stencil with separate multiplies and adds in the
+// same order as the scalar kernel, so results are normally bit-identical.  A
+// compiler that contracts the scalar expression into FMAs may round
+// differently; one application of any kernel must stay within this many ULP of
+// the scalar kernel for the same inputs.
+const unsigned WaveKernelUlpTolerance = 2;
+
+// Best kernel supported by this CPU and OS.  Detected once with cpuid.
+WaveKernelIsa DetectWaveKernelIsa();
+
+// Returns the kernel for isa, or nullptr if it was not built or the CPU cannot run it.
+WaveRowKernel GetWaveRowKernel(WaveKernelIsa isa);
+
+// Half precision kernels exist for scalar, AVX2 (with F16C) and AVX-512;
+// returns nullptr for any other isa or if the CPU cannot run it.
+WaveRowKernelHalf GetWaveRowKernelHalf(WaveKernelIsa isa);
+
+const char* WaveKernelIsaName(WaveKernelIsa isa);
+
+// Per-ISA entry points.  Only call these through GetWaveRowKernel*().
+void WaveRowKernel_Scalar(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k);
+#if WAVE_KERNELS_X86
+void WaveRowKernel_SSE4(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k);
+void WaveRowKernel_AVX2(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k);
+void WaveRowKernel_AVX512(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k);
+#endif
+
+void WaveRowKernelHalf_Scalar(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k);
+#if WAVE_KERNELS_X86
+void WaveRowKernelHalf_AVX2(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k);
+void WaveRowKernelHalf_AVX512(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k);
+#endif
@@ -0,0 +1,69 @@
+//
+// WaveKernels_AVX2.cpp
+// 8-wide stencil kernels.  Built with AVX2 and F16C code generation enabled.
+//
+
+#include "WaveKernels.h"
+
+#if WAVE_KERNELS_X86
+
+#include <immintrin.h>
+
+void WaveRowKernel_AVX2(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	const __m256 k1 = _mm256_set1_ps(k.K1);
+	const __m256 k2 = _mm256_set1_ps(k.K2);
+	const __m256 k3 = _mm256_set1_ps(k.K3);
+
+	size_t j = 0;
+	for(; j + 8 <= count; j += 8)
+	{
+		__m256 p = _mm256_loadu_ps(prev + j);
+		__m256 c = _mm256_loadu_ps(curr + j);
+
+		// Same association as the scalar kernel: ((down + up) + right) + left.
+		// Multiplies and adds are kept separate (no FMA) to match its rounding.
+		__m256 n = _mm256_add_ps(_mm256_loadu_ps(curr + j + stride), _mm256_loadu_ps(curr + j - stride));
+		n = _mm256_add_ps(n, _mm256_loadu_ps(curr + j + 1));
+		n = _mm256_add_ps(n, _mm256_loadu_ps(curr + j - 1));
+
+		__m256 r = _mm256_add_ps(_mm256_mul_ps(k1, p), _mm256_mul_ps(k2, c));
+		r = _mm256_add_ps(r, _mm256_mul_ps(k3, n));
+
+		_mm256_storeu_ps(prev + j, r);
+	}
+
+	WaveRowKernel_Scalar(prev + j, curr + j, stride, count - j, k);
+}
+
+namespace
+{
+	inline __m256 LoadHalf8(const uint16_t* p)
+	{
+		return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+	}
+}
+
+void WaveRowKernelHalf_AVX2(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	const __m256 k1 = _mm256_set1_ps(k.K1);
+	const __m256 k2 = _mm256_set1_ps(k.K2);
+	const __m256 k3 = _mm256_set1_ps(k.K3);
+
+	size_t j = 0;
+	for(; j + 8 <= count; j += 8)
+	{
+		__m256 n = _mm256_add_ps(LoadHalf8(curr + j + stride), LoadHalf8(curr + j - stride));
+		n = _mm256_add_ps(n, LoadHalf8(curr + j + 1));
+		n = _mm256_add_ps(n, LoadHalf8(curr + j - 1));
+
+		__m256 r = _mm256_add_ps(_mm256_mul_ps(k1, LoadHalf8(prev + j)), _mm256_mul_ps(k2, LoadHalf8(curr + j)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(k3, n));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(prev + j), _mm256_cvtps_ph(r, _MM_FROUND_TO_NEAREST_INT));
+	}
+
+	WaveRowKernelHalf_Scalar(prev + j, curr + j, stride, count - j, k);
+}
+
+#endif
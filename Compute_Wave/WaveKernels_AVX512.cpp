@@ -0,0 +1,104 @@
+//
+// WaveKernels_AVX512.cpp
+// 16-wide stencil kernels.  Built with AVX-512F code generation enabled.
+//
+
+#include "WaveKernels.h"
+
+#if WAVE_KERNELS_X86
+
+#include <immintrin.h>
+
+namespace
+{
+	inline __m512 Stencil(__m512 p, __m512 c, __m512 down, __m512 up, __m512 right, __m512 left,
+		__m512 k1, __m512 k2, __m512 k3)
+	{
+		// Same association as the scalar kernel: ((down + up) + right) + left.
+		// Multiplies and adds are kept separate (no FMA) to match its rounding.
+		__m512 n = _mm512_add_ps(down, up);
+		n = _mm512_add_ps(n, right);
+		n = _mm512_add_ps(n, left);
+
+		__m512 r = _mm512_add_ps(_mm512_mul_ps(k1, p), _mm512_mul_ps(k2, c));
+		return _mm512_add_ps(r, _mm512_mul_ps(k3, n));
+	}
+}
+
+void WaveRowKernel_AVX512(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	const __m512 k1 = _mm512_set1_ps(k.K1);
+	const __m512 k2 = _mm512_set1_ps(k.K2);
+	const __m512 k3 = _mm512_set1_ps(k.K3);
+
+	size_t j = 0;
+	for(; j + 16 <= count; j += 16)
+	{
+		__m512 r = Stencil(
+			_mm512_loadu_ps(prev + j),
+			_mm512_loadu_ps(curr + j),
+			_mm512_loadu_ps(curr + j + stride),
+			_mm512_loadu_ps(curr + j - stride),
+			_mm512_loadu_ps(curr + j + 1),
+			_mm512_loadu_ps(curr + j - 1),
+			k1, k2, k3);
+
+		_mm512_storeu_ps(prev + j, r);
+	}
+
+	// Masked tail; masked-off lanes are neither loaded nor stored.
+	if (j < count)
+	{
+		const __mmask16 m = __mmask16((1u << (count - j)) - 1u);
+		const __m512 z = _mm512_setzero_ps();
+
+		__m512 r = Stencil(
+			_mm512_mask_loadu_ps(z, m, prev + j),
+			_mm512_mask_loadu_ps(z, m, curr + j),
+			_mm512_mask_loadu_ps(z, m, curr + j + stride),
+			_mm512_mask_loadu_ps(z, m, curr + j - stride),
+			_mm512_mask_loadu_ps(z, m, curr + j + 1),
+			_mm512_mask_loadu_ps(z, m, curr + j - 1),
+			k1, k2, k3);
+
+		_mm512_mask_storeu_ps(prev + j, m, r);
+	}
+}
+
+namespace
+{
+	// The all-ones zero-masking forms convert exactly like the plain ones but
+	// avoid GCC's bogus maybe-uninitialized warnings in its intrinsic headers.
+	inline __m512 LoadHalf16(const uint16_t* p)
+	{
+		return _mm512_maskz_cvtph_ps(0xffff, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+	}
+}
+
+void WaveRowKernelHalf_AVX512(uint16_t* prev, const uint16_t* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	const __m512 k1 = _mm512_set1_ps(k.K1);
+	const __m512 k2 = _mm512_set1_ps(k.K2);
+	const __m512 k3 = _mm512_set1_ps(k.K3);
+
+	size_t j = 0;
+	for(; j + 16 <= count; j += 16)
+	{
+		__m512 r = Stencil(
+			LoadHalf16(prev + j),
+			LoadHalf16(curr + j),
+			LoadHalf16(curr + j + stride),
+			LoadHalf16(curr + j - stride),
+			LoadHalf16(curr + j + 1),
+			LoadHalf16(curr + j - 1),
+			k1, k2, k3);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(prev + j),
+			_mm512_maskz_cvtps_ph(0xffff, r, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	}
+
+	// Masked 16-bit loads need AVX-512BW; the tail is short, finish it in scalar.
+	WaveRowKernelHalf_Scalar(prev + j, curr + j, stride, count - j, k);
+}
+
+#endif
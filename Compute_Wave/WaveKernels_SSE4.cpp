@@ -0,0 +1,38 @@
+//
+// WaveKernels_SSE4.cpp
+// 4-wide stencil kernel.  Built with SSE4.1 code generation enabled.
+//
+
+#include "WaveKernels.h"
+
+#if WAVE_KERNELS_X86
+
+#include <smmintrin.h>
+
+void WaveRowKernel_SSE4(float* prev, const float* curr, size_t stride, size_t count, const WaveConstants& k)
+{
+	const __m128 k1 = _mm_set1_ps(k.K1);
+	const __m128 k2 = _mm_set1_ps(k.K2);
+	const __m128 k3 = _mm_set1_ps(k.K3);
+
+	size_t j = 0;
+	for(; j + 4 <= count; j += 4)
+	{
+		__m128 p = _mm_loadu_ps(prev + j);
+		__m128 c = _mm_loadu_ps(curr + j);
+
+		// Same association as the scalar kernel: ((down + up) + right) + left.
+		__m128 n = _mm_add_ps(_mm_loadu_ps(curr + j + stride), _mm_loadu_ps(curr + j - stride));
+		n = _mm_add_ps(n, _mm_loadu_ps(curr + j + 1));
+		n = _mm_add_ps(n, _mm_loadu_ps(curr + j - 1));
+
+		__m128 r = _mm_add_ps(_mm_mul_ps(k1, p), _mm_mul_ps(k2, c));
+		r = _mm_add_ps(r, _mm_mul_ps(k3, n));
+
+		_mm_storeu_ps(prev + j, r);
+	}
+
+	WaveRowKernel_Scalar(prev + j, curr + j, stride, count - j, k);
+}
+
+#endif
@@ -0,0 +1,308 @@
+//
+// WaveMesh.cpp
+//
+
+#include "WaveMesh.h"
+#include "WaveVertexCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Edges of a patch whose neighbour is a level coarser.
+	const unsigned EdgeTop = 1;		// row 0 of the patch
+	const unsigned EdgeBottom = 2;
+	const unsigned EdgeLeft = 4;	// column 0 of the patch
+	const unsigned EdgeRight = 8;
+	const unsigned EdgeMasks = 16;
+
+	// Samples [0, step, 2*step, ...] below size, then size itself, so the
+	// last span may be short but neighbours at the same level always agree.
+	void Samples(size_t size, size_t step, std::vector<size_t>& out)
+	{
+		out.clear();
+		for (size_t k = 0; k < size; k += step)
+		{
+			out.push_back(k);
+		}
+		out.push_back(size);
+	}
+
+	// Moves a sample that the coarser level does not keep onto the one
+	// before it, which the coarser level does keep.
+	size_t Snap(size_t k, size_t size, size_t step)
+	{
+		return k == size || k % (2*step) == 0 ? k : k - step;
+	}
+}
+
+WaveLodMesh::WaveLodMesh()
+: mNumRows(0), mNumCols(0), mSpatialStep(0.0f), mPatchQuads(0), mPatchRowQuads(0), mLevels(0), mOrder(WaveMeshOrder::Strips),
+  mCacheSize(16), mPatchRows(0), mPatchCols(0),
+  mDrawnIndices(0)
+{
+}
+
+bool WaveLodMesh::Init(size_t rows, size_t cols, float spatialStep, size_t patchQuads, size_t levels)
+{
+	mIndices.clear();
+	mShortIndices.clear();
+	mLists.clear();
+	mPatchLevels.clear();
+	mDraws.clear();
+	mDrawnIndices = 0;
+	mNumRows = mNumCols = mPatchRows = mPatchCols = 0;
+
+	if (rows < 2 || cols < 2 || patchQuads == 0 || (patchQuads & (patchQuads - 1)) != 0 || levels == 0)
+	{
+		return false;
+	}
+
+	mNumRows = rows;
+	mNumCols = cols;
+	mSpatialStep = spatialStep;
+	mPatchQuads = patchQuads;
+
+	// As many rows as keep the patch's last vertex within 16 bits of its
+	// first, but no more than it has columns.
+	const size_t shortRows = cols <= 65535 - patchQuads ? (65535 - patchQuads) / cols : 0;
+	mPatchRowQuads = shortRows != 0 ? std::min(patchQuads, shortRows) : patchQuads;
+
+	// No level coarser than one quad per patch.
+	mLevels = 1;
+	while (mLevels < levels && (size_t(1) << mLevels) <= patchQuads)
+	{
+		++mLevels;
+	}
+
+	mPatchRows = (rows - 2) / mPatchRowQuads + 1;
+	mPatchCols = (cols - 2) / patchQuads + 1;
+
+	// A list for every (full or last) patch height and width, level and
+	// set of coarser neighbours.
+	const size_t lastRows = (rows - 1) - (mPatchRows - 1)*mPatchRowQuads;
+	const size_t lastCols = (cols - 1) - (mPatchCols - 1)*patchQuads;
+	for (size_t patchRows : { mPatchRowQuads, lastRows })
+	{
+		for (size_t patchCols : { patchQuads, lastCols })
+		{
+			for (size_t level = 0; level < mLevels; ++level)
+			{
+				for (unsigned coarser = 0; coarser < EdgeMasks; ++coarser)
+				{
+					BuildList(patchRows, patchCols, level, coarser);
+				}
+			}
+		}
+	}
+
+	if (shortRows != 0)
+	{
+		mShortIndices.assign(mIndices.begin(), mIndices.end());
+		mIndices = std::vector<uint32_t>();
+	}
+
+	mPatchLevels.assign(PatchCount(), 0);
+	Stitch();
+	return true;
+}
+
+void WaveLodMesh::SetIndexOrder(WaveMeshOrder order, size_t cacheSize)
+{
+	mOrder = order;
+	mCacheSize = cacheSize;
+}
+
+WaveMeshPatch WaveLodMesh::Patch(size_t patch)const
+{
+	WaveMeshPatch p;
+	p.Row = patch / mPatchCols * mPatchRowQuads;
+	p.Column = patch % mPatchCols * mPatchQuads;
+	p.Rows = std::min(mPatchRowQuads, mNumRows - 1 - p.Row);
+	p.Columns = std::min(mPatchQuads, mNumCols - 1 - p.Column);
+	return p;
+}
+
+size_t WaveLodMesh::ListIndex(size_t patch, size_t level, unsigned coarser)const
+{
+	const size_t lastRow = patch / mPatchCols == mPatchRows - 1 ? 1 : 0;
+	const size_t lastCol = patch % mPatchCols == mPatchCols - 1 ? 1 : 0;
+	return ((lastRow*2 + lastCol)*mLevels + level)*EdgeMasks + coarser;
+}
+
+void WaveLodMesh::BuildList(size_t rows, size_t cols, size_t level, unsigned coarser)
+{
+	const size_t step = size_t(1) << level;
+
+	std::vector<size_t> rowSamples, colSamples;
+	Samples(rows, step, rowSamples);
+	Samples(cols, step, colSamples);
+
+	// Vertex (r, c) of the patch, with the odd vertices of edges next to a
+	// coarser patch collapsed onto their even neighbours.
+	auto vertex = [&](size_t r, size_t c)
+	{
+		if ((r == 0 && (coarser & EdgeTop)) || (r == rows && (coarser & EdgeBottom)))
+		{
+			c = Snap(c, cols, step);
+		}
+		if ((c == 0 && (coarser & EdgeLeft)) || (c == cols && (coarser & EdgeRight)))
+		{
+			r = Snap(r, rows, step);
+		}
+		return uint32_t(r*mNumCols + c);
+	};
+
+	auto triangle = [&](uint32_t a, uint32_t b, uint32_t c)
+	{
+		// Collapsed edges leave triangles with no area.
+		if (a != b && b != c && a != c)
+		{
+			mIndices.push_back(a);
+			mIndices.push_back(b);
+			mIndices.push_back(c);
+		}
+	};
+
+	Range range;
+	range.Start = uint32_t(mIndices.size());
+
+	// Two triangles per quad, split as the full-resolution grid always was.
+	// The bottom right quad is split the other way when both of its outer
+	// edges collapse, which would otherwise leave a triangle with its three
+	// corners on one line.
+	const bool flipCorner = (coarser & EdgeBottom) && (coarser & EdgeRight);
+
+	// A FIFO cache still holds the row above a quad if both rows of the
+	// strip fit: the first row of a strip loads them interleaved, and a hit
+	// does not refresh an entry.  Whole rows are one strip.
+	const size_t quadRows = rowSamples.size() - 1;
+	const size_t quadCols = colSamples.size() - 1;
+	const size_t stripQuads = mOrder == WaveMeshOrder::Strips ? std::max<size_t>(mCacheSize / 2, 2) - 1 : quadCols;
+
+	for (size_t strip = 0; strip < quadCols; strip += stripQuads)
+	{
+		for (size_t i = 0; i < quadRows; ++i)
+		{
+			for (size_t j = strip; j < std::min(strip + stripQuads, quadCols); ++j)
+			{
+				const size_t r0 = rowSamples[i], r1 = rowSamples[i + 1];
+				const size_t c0 = colSamples[j], c1 = colSamples[j + 1];
+
+				if (flipCorner && r1 == rows && c1 == cols)
+				{
+					triangle(vertex(r0, c0), vertex(r0, c1), vertex(r1, c1));
+					triangle(vertex(r0, c0), vertex(r1, c1), vertex(r1, c0));
+				}
+				else
+				{
+					triangle(vertex(r0, c0), vertex(r0, c1), vertex(r1, c0));
+					triangle(vertex(r1, c0), vertex(r0, c1), vertex(r1, c1));
+				}
+			}
+		}
+	}
+
+	range.Count = uint32_t(mIndices.size()) - range.Start;
+	if (mOrder == WaveMeshOrder::Optimized)
+	{
+		OptimizeVertexCache(&mIndices[range.Start], range.Count, mCacheSize);
+	}
+	mLists.push_back(range);
+}
+
+void WaveLodMesh::SelectLod(float eyeX, float eyeY, float eyeZ, float detailDistance)
+{
+	const float halfWidth = 0.5f*float(mNumCols - 1)*mSpatialStep;
+	const float halfDepth = 0.5f*float(mNumRows - 1)*mSpatialStep;
+
+	for (size_t patch = 0; patch < PatchCount(); ++patch)
+	{
+		const WaveMeshPatch p = Patch(patch);
+
+		// Nearest point of the patch, taken as flat at height 0.
+		const float x0 = -halfWidth + float(p.Column)*mSpatialStep;
+		const float x1 = -halfWidth + float(p.Column + p.Columns)*mSpatialStep;
+		const float z0 = halfDepth - float(p.Row + p.Rows)*mSpatialStep;
+		const float z1 = halfDepth - float(p.Row)*mSpatialStep;
+
+		const float dx = eyeX - std::min(std::max(eyeX, x0), x1);
+		const float dz = eyeZ - std::min(std::max(eyeZ, z0), z1);
+		const float distance = std::sqrt(dx*dx + eyeY*eyeY + dz*dz);
+
+		size_t level = 0;
+		for (float reach = detailDistance; level + 1 < mLevels && !(distance < reach); reach *= 2.0f)
+		{
+			++level;
+		}
+		mPatchLevels[patch] = uint8_t(level);
+	}
+
+	Stitch();
+}
+
+void WaveLodMesh::SetLevel(size_t level)
+{
+	std::fill(mPatchLevels.begin(), mPatchLevels.end(), uint8_t(std::min(level, mLevels - 1)));
+	Stitch();
+}
+
+void WaveLodMesh::Stitch()
+{
+	// Level of the patch at (pr + dr, pc + dc), or outside if there is none.
+	auto neighbour = [&](size_t pr, size_t pc, int dr, int dc, uint8_t outside)
+	{
+		const size_t r = pr + size_t(dr);
+		const size_t c = pc + size_t(dc);
+		return r < mPatchRows && c < mPatchCols ? mPatchLevels[r*mPatchCols + c] : outside;
+	};
+
+	// Levels only go down, so this ends; a detailed patch refines a ring
+	// around it per pass.
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+		for (size_t pr = 0; pr < mPatchRows; ++pr)
+		{
+			for (size_t pc = 0; pc < mPatchCols; ++pc)
+			{
+				uint8_t& level = mPatchLevels[pr*mPatchCols + pc];
+				const uint8_t finest = std::min(
+					std::min(neighbour(pr, pc, -1, 0, level), neighbour(pr, pc, 1, 0, level)),
+					std::min(neighbour(pr, pc, 0, -1, level), neighbour(pr, pc, 0, 1, level)));
+
+				if (level > finest + 1)
+				{
+					level = uint8_t(finest + 1);
+					changed = true;
+				}
+			}
+		}
+	}
+
+	mDraws.clear();
+	mDrawnIndices = 0;
+	for (size_t patch = 0; patch < PatchCount(); ++patch)
+	{
+		const size_t pr = patch / mPatchCols;
+		const size_t pc = patch % mPatchCols;
+		const uint8_t level = mPatchLevels[patch];
+
+		unsigned coarser = 0;
+		coarser |= neighbour(pr, pc, -1, 0, 0) > level ? EdgeTop : 0;
+		coarser |= neighbour(pr, pc, 1, 0, 0) > level ? EdgeBottom : 0;
+		coarser |= neighbour(pr, pc, 0, -1, 0) > level ? EdgeLeft : 0;
+		coarser |= neighbour(pr, pc, 0, 1, 0) > level ? EdgeRight : 0;
+
+		const Range& range = mLists[ListIndex(patch, level, coarser)];
+		const WaveMeshPatch p = Patch(patch);
+
+		WaveMeshDraw draw;
+		draw.IndexStart = range.Start;
+		draw.IndexCount = range.Count;
+		draw.BaseVertex = int32_t(p.Row*mNumCols + p.Column);
+		mDraws.push_back(draw);
+		mDrawnIndices += range.Count;
+	}
+}
@@ -0,0 +1,148 @@
+//
+// WaveMesh.h
+// Level-of-detail index lists for drawing a wave grid.
+//
+// The grid is cut into patches of PatchRowQuads() x PatchQuads() quads
+// (smaller along the far edges).  Every patch can be drawn at a level l that
+// keeps every 2^l-th row and column, so each level has a quarter of the
+// triangles of the one before.  Neighbouring patches differ by at most one
+// level, and a patch next to a coarser one drops the odd vertices of that
+// edge, so the two meet without cracks or T-junctions.
+//
+// Indices are relative to a patch's first vertex in the grid's own row-major
+// vertex order, so patches of the same size share their index lists and a
+// draw only needs a base vertex.  Nothing here touches the heights: the
+// vertex buffer the sink fills stays as it is.
+//
+// Patches are square unless that would put a patch's last vertex more than
+// 65535 after its first: then they are cut shorter, so every index fits in
+// 16 bits, which halves the index buffer and the index fetches.  Only grids
+// too wide for even one row of patches under that limit use 32-bit indices.
+//
+// Within a list the triangles are ordered for the post-transform vertex
+// cache (see WaveVertexCache.h): row by row across a strip of columns narrow
+// enough that the previous row is still cached, or by a general optimizer.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One DrawIndexed(IndexCount, IndexStart, BaseVertex) call.
+struct WaveMeshDraw
+{
+	uint32_t IndexStart;
+	uint32_t IndexCount;
+	int32_t BaseVertex;
+};
+
+// The quads [Row, Row + Rows) x [Column, Column + Columns) of the grid.
+struct WaveMeshPatch
+{
+	size_t Row;
+	size_t Column;
+	size_t Rows;
+	size_t Columns;
+};
+
+// Order of the triangles within an index list.
+enum class WaveMeshOrder
+{
+	RowMajor,	// quad by quad along whole rows, as the grid was always drawn
+	Strips,		// along rows of column strips sized to the cache
+	Optimized,	// OptimizeVertexCache()
+};
+
+class WaveLodMesh
+{
+public:
+	WaveLodMesh();
+
+	// Builds the index lists of every patch size, level and stitching for a
+	// rows x cols grid laid out as Waves lays it out, with vertex (i, j) at
+	// x = -halfWidth + j*spatialStep, z = halfDepth - i*spatialStep.
+	// patchQuads, the patch width in quads, must be a power of 2.  Every
+	// patch starts at level 0.
+	// Returns false, and leaves the mesh empty, if the arguments are invalid.
+	bool Init(size_t rows, size_t cols, float spatialStep, size_t patchQuads = 32, size_t levels = 4);
+
+	// How Init() orders the triangles of its lists, for a FIFO vertex cache
+	// of cacheSize entries.  Strips for 16 entries by default.
+	void SetIndexOrder(WaveMeshOrder order, size_t cacheSize);
+	WaveMeshOrder IndexOrder()const { return mOrder; }
+	size_t CacheSize()const { return mCacheSize; }
+
+	size_t RowCount()const { return mNumRows; }
+	size_t ColumnCount()const { return mNumCols; }
+	float SpatialStep()const { return mSpatialStep; }
+	size_t PatchQuads()const { return mPatchQuads; }
+	size_t PatchRowQuads()const { return mPatchRowQuads; }
+	size_t LevelCount()const { return mLevels; }
+
+	size_t PatchRowCount()const { return mPatchRows; }
+	size_t PatchColumnCount()const { return mPatchCols; }
+	size_t PatchCount()const { return mPatchRows*mPatchCols; }
+	WaveMeshPatch Patch(size_t patch)const;
+
+	// Every index list, for one index buffer of IndexCount() indices of
+	// IndexSize() bytes: 2 (uint16_t) or 4 (uint32_t).
+	size_t IndexSize()const { return mShortIndices.empty() && !mIndices.empty() ? 4 : 2; }
+	size_t IndexCount()const { return mShortIndices.size() + mIndices.size(); }
+	const void* IndexData()const { return mShortIndices.empty() ? (const void*)mIndices.data() : mShortIndices.data(); }
+	uint32_t Index(size_t k)const { return mShortIndices.empty() ? mIndices[k] : mShortIndices[k]; }
+
+	// Picks each patch's level from the distance between eye (in the grid's
+	// space) and the nearest point of the patch: level 0 within
+	// detailDistance, then one level coarser every time the distance
+	// doubles.  Patches are then refined until no two neighbours are more
+	// than a level apart, and the draw list is rebuilt.
+	void SelectLod(float eyeX, float eyeY, float eyeZ, float detailDistance);
+
+	// Draws every patch at level (clamped to LevelCount() - 1).
+	void SetLevel(size_t level);
+
+	size_t PatchLevel(size_t patch)const { return mPatchLevels[patch]; }
+
+	// One draw per patch, for the levels last selected.
+	const std::vector<WaveMeshDraw>& Draws()const { return mDraws; }
+	size_t DrawnTriangleCount()const { return mDrawnIndices / 3; }
+
+private:
+	// An index list in mIndices.
+	struct Range
+	{
+		uint32_t Start;
+		uint32_t Count;
+	};
+
+	// Index of the list for a patch of the given size, level and set of
+	// coarser neighbours (bits of the Edge* constants in WaveMesh.cpp).
+	size_t ListIndex(size_t patch, size_t level, unsigned coarser)const;
+
+	void BuildList(size_t rows, size_t cols, size_t level, unsigned coarser);
+
+	// Makes neighbours at most one level apart, then fills mDraws.
+	void Stitch();
+
+	size_t mNumRows;
+	size_t mNumCols;
+	float mSpatialStep;
+	size_t mPatchQuads;
+	size_t mPatchRowQuads;
+	size_t mLevels;
+	WaveMeshOrder mOrder;
+	size_t mCacheSize;
+	size_t mPatchRows;
+	size_t mPatchCols;
+
+	// The lists are built in mIndices, then moved to mShortIndices if they fit.
+	std::vector<uint32_t> mIndices;
+	std::vector<uint16_t> mShortIndices;
+	std::vector<Range> mLists;
+
+	std::vector<uint8_t> mPatchLevels;
+	std::vector<WaveMeshDraw> mDraws;
+	size_t mDrawnIndices;
+};
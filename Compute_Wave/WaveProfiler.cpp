@@ -0,0 +1,304 @@
+//
+// WaveProfiler.cpp
+//
+
+#include "WaveProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+	std::atomic<uint64_t> NextProfilerId(1);
+
+	// The ring the calling thread last used, and the profiler it belongs to.
+	// Profiler ids are never reused, so a stale entry never matches.
+	struct RingCache
+	{
+		uint64_t ProfilerId = 0;
+		void* Ring = nullptr;
+	};
+
+	thread_local RingCache CachedRing;
+
+	// Nearest-rank percentile of sorted durations, in microseconds.
+	double Percentile(const std::vector<uint64_t>& sorted, double p)
+	{
+		size_t rank = size_t(p * double(sorted.size()) + 0.999999);
+		rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+		return double(sorted[rank - 1]) * 1e-3;
+	}
+
+	void WriteJsonString(std::FILE* f, const std::string& s)
+	{
+		std::fputc('"', f);
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+			{
+				std::fputc('\\', f);
+			}
+			std::fputc(uint8_t(c) < 0x20 ? ' ' : c, f);
+		}
+		std::fputc('"', f);
+	}
+}
+
+// Written only by its thread.  Every field of a slot is atomic so that a
+// reader racing the writer reads a torn sample rather than undefined
+// behaviour; Head tells it which slots may have been torn.
+struct WaveProfiler::Ring
+{
+	struct Slot
+	{
+		std::atomic<uint32_t> Phase;
+		std::atomic<uint64_t> Start;
+		std::atomic<uint64_t> End;
+	};
+
+	explicit Ring(size_t capacity, uint32_t track)
+	: Slots(new Slot[capacity]), Mask(capacity - 1), Head(0), Track(track)
+	{
+	}
+
+	std::unique_ptr<Slot[]> Slots;
+	const size_t Mask;
+
+	// Samples written so far; slot i & Mask holds sample i.
+	std::atomic<uint64_t> Head;
+
+	// Trace thread id, and the name set by SetThreadName() (under mMutex).
+	const uint32_t Track;
+	std::string Name;
+
+	// Thread that writes the ring.  A later thread given the same id takes it over.
+	std::thread::id Owner;
+};
+
+WaveProfiler::WaveProfiler(size_t samplesPerThread)
+: mId(NextProfilerId.fetch_add(1, std::memory_order_relaxed)),
+  mCapacity(std::max<size_t>(samplesPerThread, 1)),
+  mOrigin(Now()), mEnabled(true)
+{
+}
+
+WaveProfiler::~WaveProfiler()
+{
+}
+
+uint64_t WaveProfiler::Now()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint32_t WaveProfiler::AddPhase(const char* name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto it = std::find(mPhases.begin(), mPhases.end(), name);
+	if (it != mPhases.end())
+	{
+		return uint32_t(it - mPhases.begin());
+	}
+	mPhases.push_back(name);
+	return uint32_t(mPhases.size() - 1);
+}
+
+void WaveProfiler::SetThreadName(const char* name)
+{
+	Ring* ring = ThreadRing();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	ring->Name = name;
+}
+
+WaveProfiler::Ring* WaveProfiler::ThreadRing()
+{
+	if (CachedRing.ProfilerId == mId)
+	{
+		return static_cast<Ring*>(CachedRing.Ring);
+	}
+
+	// First sample of this thread since it last used another profiler: find
+	// its ring, or make one.
+	const std::thread::id self = std::this_thread::get_id();
+	Ring* ring = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const std::unique_ptr<Ring>& r : mRings)
+		{
+			if (r->Owner == self)
+			{
+				ring = r.get();
+				break;
+			}
+		}
+		if (!ring)
+		{
+			// More slots than samples held, so the slot being written is never
+			// one a reader wants.
+			size_t slots = 2;
+			while (slots <= mCapacity)
+			{
+				slots <<= 1;
+			}
+			mRings.emplace_back(new Ring(slots, uint32_t(mRings.size() + 1)));
+			ring = mRings.back().get();
+			ring->Owner = self;
+		}
+	}
+
+	CachedRing.ProfilerId = mId;
+	CachedRing.Ring = ring;
+	return ring;
+}
+
+void WaveProfiler::Record(uint32_t phase, uint64_t start, uint64_t end)
+{
+	Ring* ring = ThreadRing();
+
+	const uint64_t head = ring->Head.load(std::memory_order_relaxed);
+	Ring::Slot& slot = ring->Slots[head & ring->Mask];
+	slot.Phase.store(phase, std::memory_order_relaxed);
+	slot.Start.store(start, std::memory_order_relaxed);
+	slot.End.store(end, std::memory_order_relaxed);
+
+	// Publishes the slot; readers that see the new head see its fields.
+	ring->Head.store(head + 1, std::memory_order_release);
+}
+
+void WaveProfiler::ReadRing(const Ring& ring, uint64_t since, std::vector<Sample>& out)const
+{
+	const uint64_t capacity = uint64_t(mCapacity);
+	const uint64_t slots = uint64_t(ring.Mask) + 1;
+	const uint64_t head = ring.Head.load(std::memory_order_acquire);
+	const uint64_t first = head > capacity ? head - capacity : 0;
+	const size_t base = out.size();
+
+	for (uint64_t i = first; i < head; ++i)
+	{
+		const Ring::Slot& slot = ring.Slots[i & ring.Mask];
+		Sample s;
+		s.Phase = slot.Phase.load(std::memory_order_relaxed);
+		s.Start = slot.Start.load(std::memory_order_relaxed);
+		s.End = slot.End.load(std::memory_order_relaxed);
+		out.push_back(s);
+	}
+
+	// The writer may have lapped the oldest slots while they were read: the
+	// sample at head2 may be half written over sample head2 - slots.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t head2 = ring.Head.load(std::memory_order_relaxed);
+	const uint64_t valid = head2 + 1 > slots ? head2 + 1 - slots : 0;
+	const size_t torn = size_t(std::min(head, std::max(valid, first)) - first);
+
+	out.erase(out.begin() + base, out.begin() + base + torn);
+	out.erase(std::remove_if(out.begin() + base, out.end(),
+		[=](const Sample& s) { return s.Start < since; }), out.end());
+}
+
+std::vector<WavePhaseStats> WaveProfiler::Stats(uint64_t since)const
+{
+	std::vector<Sample> samples;
+	std::vector<WavePhaseStats> stats;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const std::unique_ptr<Ring>& ring : mRings)
+		{
+			ReadRing(*ring, since, samples);
+		}
+		for (const std::string& name : mPhases)
+		{
+			WavePhaseStats s = {};
+			s.Name = name;
+			stats.push_back(s);
+		}
+	}
+
+	std::vector<std::vector<uint64_t>> durations(stats.size());
+	for (const Sample& s : samples)
+	{
+		if (s.Phase < durations.size())
+		{
+			durations[s.Phase].push_back(s.End - s.Start);
+		}
+	}
+
+	for (size_t p = 0; p < stats.size(); ++p)
+	{
+		std::vector<uint64_t>& d = durations[p];
+		if (d.empty())
+		{
+			continue;
+		}
+		std::sort(d.begin(), d.end());
+
+		double total = 0.0;
+		for (uint64_t x : d)
+		{
+			total += double(x);
+		}
+
+		WavePhaseStats& s = stats[p];
+		s.Count = d.size();
+		s.Mean = total / double(d.size()) * 1e-3;
+		s.P50 = Percentile(d, 0.50);
+		s.P95 = Percentile(d, 0.95);
+		s.P99 = Percentile(d, 0.99);
+		s.Max = double(d.back()) * 1e-3;
+	}
+	return stats;
+}
+
+bool WaveProfiler::WriteChromeTrace(const char* path)const
+{
+	std::FILE* f = std::fopen(path, "w");
+	if (!f)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+
+	std::vector<Sample> samples;
+	for (const std::unique_ptr<Ring>& ring : mRings)
+	{
+		if (!ring->Name.empty())
+		{
+			std::fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+				first ? "" : ",\n", ring->Track);
+			WriteJsonString(f, ring->Name);
+			std::fprintf(f, "}}");
+			first = false;
+		}
+
+		samples.clear();
+		ReadRing(*ring, 0, samples);
+
+		for (const Sample& s : samples)
+		{
+			if (s.Phase >= mPhases.size())
+			{
+				continue;
+			}
+
+			// Microseconds since the profiler was created.
+			const double ts = (double(s.Start) - double(mOrigin)) * 1e-3;
+			const double dur = double(s.End - s.Start) * 1e-3;
+
+			std::fprintf(f, "%s{\"ph\":\"X\",\"name\":", first ? "" : ",\n");
+			WriteJsonString(f, mPhases[s.Phase]);
+			std::fprintf(f, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ring->Track, ts, dur);
+			first = false;
+		}
+	}
+
+	std::fprintf(f, "\n]}\n");
+	return std::fclose(f) == 0;
+}
@@ -0,0 +1,122 @@
+//
+// WaveProfiler.h
+// Scoped phase timers for the frame loop and the solver thread.
+//
+// Each thread that records gets its own fixed-size ring of samples, written
+// with relaxed stores and one release store per sample, so a timer costs two
+// clock reads and never takes a lock.  Once a ring is full the oldest
+// samples are overwritten.  Stats() and WriteChromeTrace() read every ring
+// from any thread while recording goes on, skipping samples that were
+// overwritten during the read.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Durations of one phase, in microseconds.
+struct WavePhaseStats
+{
+	std::string Name;
+	uint64_t Count;
+	double Mean;
+	double P50;
+	double P95;
+	double P99;
+	double Max;
+};
+
+class WaveProfiler
+{
+public:
+	// Every thread's ring holds its newest samplesPerThread samples.
+	explicit WaveProfiler(size_t samplesPerThread = 16384);
+	~WaveProfiler();
+
+	WaveProfiler(const WaveProfiler&) = delete;
+	WaveProfiler& operator=(const WaveProfiler&) = delete;
+
+	// Returns the id of the phase called name, adding it if it is new.
+	uint32_t AddPhase(const char* name);
+
+	// Names the calling thread in the trace.
+	void SetThreadName(const char* name);
+
+	// While disabled, scopes record nothing.  Enabled on construction.
+	void SetEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+	bool Enabled()const { return mEnabled.load(std::memory_order_relaxed); }
+
+	// Nanoseconds on a steady clock.
+	static uint64_t Now();
+
+	// Adds a sample of phase to the calling thread's ring.
+	void Record(uint32_t phase, uint64_t start, uint64_t end);
+
+	// Percentiles of every phase over the samples still held that started
+	// at or after since (a Now() value).  Phases without samples are listed
+	// with a Count of 0.
+	std::vector<WavePhaseStats> Stats(uint64_t since = 0)const;
+
+	// Writes every sample still held as a Chrome trace (chrome://tracing or
+	// https://ui.perfetto.dev), one track per thread.  Returns false if the
+	// file cannot be written.
+	bool WriteChromeTrace(const char* path)const;
+
+private:
+	struct Sample
+	{
+		uint32_t Phase;
+		uint64_t Start;
+		uint64_t End;
+	};
+
+	struct Ring;
+
+	Ring* ThreadRing();
+
+	// Copies the samples of a ring that started at or after since.
+	void ReadRing(const Ring& ring, uint64_t since, std::vector<Sample>& out)const;
+
+	const uint64_t mId;
+	const size_t mCapacity;
+	const uint64_t mOrigin;
+	std::atomic<bool> mEnabled;
+
+	// Guards the phase names and the list of rings, not the rings' samples.
+	mutable std::mutex mMutex;
+	std::vector<std::string> mPhases;
+	std::vector<std::unique_ptr<Ring>> mRings;
+};
+
+// Times the enclosing scope as one sample of phase.  profiler may be null.
+class WaveProfileScope
+{
+public:
+	WaveProfileScope(WaveProfiler* profiler, uint32_t phase)
+	: mProfiler(profiler && profiler->Enabled() ? profiler : nullptr), mPhase(phase),
+	  mStart(mProfiler ? WaveProfiler::Now() : 0)
+	{
+	}
+
+	~WaveProfileScope()
+	{
+		if (mProfiler)
+		{
+			mProfiler->Record(mPhase, mStart, WaveProfiler::Now());
+		}
+	}
+
+	WaveProfileScope(const WaveProfileScope&) = delete;
+	WaveProfileScope& operator=(const WaveProfileScope&) = delete;
+
+private:
+	WaveProfiler* mProfiler;
+	uint32_t mPhase;
+	uint64_t mStart;
+};
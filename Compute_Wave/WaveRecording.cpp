@@ -0,0 +1,434 @@
+//
+// WaveRecording.cpp
+//
+
+#include "WaveRecording.h"
+#include "Waves.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const uint32_t ByteOrderMark = 0x01020304;
+
+	// Largest sample magnitude; -32768 is left unused so the range is symmetric.
+	const float MaxSample = 32767.0f;
+
+	uint8_t* PutVarint(uint8_t* out, uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			*out++ = uint8_t(v | 0x80);
+			v >>= 7;
+		}
+		*out++ = uint8_t(v);
+		return out;
+	}
+
+	bool GetVarint(const uint8_t* in, size_t bytes, size_t& p, uint64_t& v)
+	{
+		v = 0;
+		for (unsigned shift = 0; shift < 64 && p < bytes; shift += 7)
+		{
+			const uint8_t b = in[p++];
+			v |= uint64_t(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Differences to previous, which is updated to samples.  A zero byte
+	// starts a run of unchanged samples (its length - 1 follows as a varint);
+	// any other varint is a zigzag-coded difference, which is never zero.
+	void Pack(const int16_t* samples, int16_t* previous, size_t count, std::vector<uint8_t>& out)
+	{
+		// At most 3 bytes per sample, or a zero and a varint per run.
+		out.resize(3*count + 16);
+		uint8_t* p = out.data();
+
+		size_t i = 0;
+		while (i < count)
+		{
+			const uint16_t d = uint16_t(uint16_t(samples[i]) - uint16_t(previous[i]));
+			if (d == 0)
+			{
+				size_t run = 1;
+				while (i + run < count && samples[i + run] == previous[i + run])
+				{
+					++run;
+				}
+				*p++ = 0;
+				p = PutVarint(p, run - 1);
+				i += run;
+			}
+			else
+			{
+				const uint16_t zigzag = uint16_t(d << 1) ^ ((d & 0x8000) ? 0xffff : 0);
+				p = PutVarint(p, zigzag);
+				previous[i] = samples[i];
+				++i;
+			}
+		}
+
+		out.resize(size_t(p - out.data()));
+	}
+
+	// Applies a packed frame to samples.  False if in is not exactly one
+	// frame of count samples.
+	bool Unpack(const uint8_t* in, size_t bytes, int16_t* samples, size_t count)
+	{
+		size_t p = 0;
+		size_t i = 0;
+		while (i < count)
+		{
+			if (p >= bytes)
+			{
+				return false;
+			}
+
+			uint64_t v;
+			if (in[p] == 0)
+			{
+				++p;
+				if (!GetVarint(in, bytes, p, v) || v >= count - i)
+				{
+					return false;
+				}
+				i += size_t(v) + 1;
+			}
+			else
+			{
+				if (!GetVarint(in, bytes, p, v) || v > 0xffff)
+				{
+					return false;
+				}
+				const uint16_t zigzag = uint16_t(v);
+				const uint16_t d = uint16_t(zigzag >> 1) ^ ((zigzag & 1) ? 0xffff : 0);
+				samples[i] = int16_t(uint16_t(uint16_t(samples[i]) + d));
+				++i;
+			}
+		}
+		return p == bytes;
+	}
+}
+
+WaveRecorder::WaveRecorder()
+: mFile(nullptr), mRows(0), mCols(0), mEvery(1), mQuantum(1.0f), mStep(0),
+  mQuit(false), mFailed(false), mRecorded(0), mDropped(0), mBytes(0), mClipped(0)
+{
+}
+
+WaveRecorder::~WaveRecorder()
+{
+	Close();
+}
+
+bool WaveRecorder::Open(const char* path, const Waves& waves, size_t every, float quantum, size_t queueFrames)
+{
+	Close();
+
+	if (waves.VertexCount() == 0 || !(quantum > 0.0f))
+	{
+		return false;
+	}
+
+	mFile = std::fopen(path, "wb");
+	if (!mFile)
+	{
+		return false;
+	}
+
+	mRows = waves.RowCount();
+	mCols = waves.ColumnCount();
+	mEvery = std::max<size_t>(every, 1);
+	mQuantum = quantum;
+	mStep = 0;
+
+	WaveRecordingHeader header = {};
+	std::memcpy(header.Magic, WaveRecordingMagic, sizeof(header.Magic));
+	header.Version = WaveRecordingVersion;
+	header.ByteOrder = ByteOrderMark;
+	header.Rows = mRows;
+	header.Cols = mCols;
+	header.Every = uint32_t(mEvery);
+	header.Quantum = mQuantum;
+	header.TimeStep = waves.TimeStep();
+	header.SpatialStep = waves.SpatialStep();
+
+	mQuit = false;
+	mFailed = std::fwrite(&header, sizeof(header), 1, mFile) != 1;
+	mRecorded = mDropped = mClipped = 0;
+	mBytes = sizeof(header);
+
+	// Every slot is sized here; recording never allocates.
+	mSlots.resize(std::max<size_t>(queueFrames, 1));
+	mFree.clear();
+	for (size_t s = 0; s < mSlots.size(); ++s)
+	{
+		mSlots[s].Samples.resize(mRows*mCols);
+		mFree.push_back(s);
+	}
+	mQueue.clear();
+	mPrevious.assign(mRows*mCols, 0);
+	mPacked.reserve(3*mRows*mCols + 16);
+
+	mWriter = std::thread(&WaveRecorder::WriterMain, this);
+	return true;
+}
+
+bool WaveRecorder::Close()
+{
+	if (!mFile)
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_one();
+	mWriter.join();
+
+	const bool closed = std::fclose(mFile) == 0;
+	mFile = nullptr;
+	return closed && !mFailed;
+}
+
+bool WaveRecorder::Record(const Waves& waves, size_t steps)
+{
+	if (!mFile || steps == 0)
+	{
+		return false;
+	}
+
+	const uint64_t before = mStep;
+	mStep += steps;
+	if (mStep / mEvery == before / mEvery)
+	{
+		return false;
+	}
+
+	size_t slot;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mFree.empty())
+		{
+			++mDropped;
+			return false;
+		}
+		slot = mFree.back();
+		mFree.pop_back();
+	}
+
+	// Only the quantization happens here; packing and writing are left to the writer.
+	const float scale = 1.0f / mQuantum;
+	uint64_t clipped = 0;
+	int16_t* out = mSlots[slot].Samples.data();
+	for (size_t i = 0; i < mRows; ++i)
+	{
+		const float* row = waves.Heights() + i*waves.RowStride();
+		for (size_t j = 0; j < mCols; ++j)
+		{
+			// Shifted to be positive so truncation rounds to nearest, which
+			// keeps the loop branch-free and vectorizable; NaN goes to +MaxSample.
+			const float x = row[j]*scale + (MaxSample + 1.5f);
+			const float q = std::max(1.0f, std::min(2.0f*MaxSample + 1.0f, x));
+			clipped += q != x;
+			*out++ = int16_t(int32_t(q) - int32_t(MaxSample + 1.0f));
+		}
+	}
+	mSlots[slot].Step = mStep;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(slot);
+		++mRecorded;
+		mClipped += clipped;
+	}
+	mWake.notify_one();
+	return true;
+}
+
+uint64_t WaveRecorder::FramesRecorded()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mRecorded;
+}
+
+uint64_t WaveRecorder::FramesDropped()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mDropped;
+}
+
+uint64_t WaveRecorder::BytesWritten()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBytes;
+}
+
+uint64_t WaveRecorder::ClippedSamples()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mClipped;
+}
+
+void WaveRecorder::WriterMain()
+{
+	for (;;)
+	{
+		size_t slot;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]() { return mQuit || !mQueue.empty(); });
+
+			// Quit only once every queued frame is written.
+			if (mQueue.empty())
+			{
+				return;
+			}
+			slot = mQueue.front();
+			mQueue.pop_front();
+		}
+
+		Pack(mSlots[slot].Samples.data(), mPrevious.data(), mPrevious.size(), mPacked);
+
+		WaveRecordingFrame frame = {};
+		frame.Step = mSlots[slot].Step;
+		frame.Bytes = uint32_t(mPacked.size());
+
+		bool ok = std::fwrite(&frame, sizeof(frame), 1, mFile) == 1;
+		ok = ok && std::fwrite(mPacked.data(), 1, mPacked.size(), mFile) == mPacked.size();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFree.push_back(slot);
+		mBytes += sizeof(frame) + mPacked.size();
+		mFailed = mFailed || !ok;
+	}
+}
+
+WavePlayback::WavePlayback()
+: mFile(nullptr), mHeader(), mRows(0), mCols(0), mStep(0), mNext(), mAtEnd(true), mTime(0.0)
+{
+}
+
+WavePlayback::~WavePlayback()
+{
+	Close();
+}
+
+bool WavePlayback::Open(const char* path)
+{
+	Close();
+
+	std::FILE* file = std::fopen(path, "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	WaveRecordingHeader header;
+	const uint64_t MaxSide = uint64_t(1) << 24;
+
+	const bool valid = std::fread(&header, sizeof(header), 1, file) == 1 &&
+		std::memcmp(header.Magic, WaveRecordingMagic, sizeof(header.Magic)) == 0 &&
+		header.Version == WaveRecordingVersion &&
+		header.ByteOrder == ByteOrderMark &&
+		header.Rows >= 1 && header.Rows <= MaxSide &&
+		header.Cols >= 1 && header.Cols <= MaxSide &&
+		header.Every >= 1 && header.Quantum > 0.0f;
+
+	if (!valid)
+	{
+		std::fclose(file);
+		return false;
+	}
+
+	mFile = file;
+	mHeader = header;
+	mRows = size_t(header.Rows);
+	mCols = size_t(header.Cols);
+
+	Rewind();
+	return true;
+}
+
+void WavePlayback::Close()
+{
+	if (mFile)
+	{
+		std::fclose(mFile);
+		mFile = nullptr;
+	}
+	mAtEnd = true;
+}
+
+void WavePlayback::Rewind()
+{
+	if (!mFile)
+	{
+		return;
+	}
+
+	std::fseek(mFile, long(sizeof(WaveRecordingHeader)), SEEK_SET);
+
+	mSamples.assign(mRows*mCols, 0);
+	mHeights.assign(mRows*mCols, 0.0f);
+	mStep = 0;
+	mTime = 0.0;
+	mAtEnd = !ReadFrameHeader();
+}
+
+bool WavePlayback::ReadFrameHeader()
+{
+	// A packed sample takes at most 3 bytes; anything longer is damaged.
+	return std::fread(&mNext, sizeof(mNext), 1, mFile) == 1 && mNext.Bytes <= 3*mSamples.size() + 16;
+}
+
+bool WavePlayback::NextFrame()
+{
+	if (mAtEnd)
+	{
+		return false;
+	}
+
+	mPacked.resize(mNext.Bytes);
+	if (std::fread(mPacked.data(), 1, mPacked.size(), mFile) != mPacked.size() ||
+		!Unpack(mPacked.data(), mPacked.size(), mSamples.data(), mSamples.size()))
+	{
+		mAtEnd = true;
+		return false;
+	}
+
+	const float quantum = mHeader.Quantum;
+	for (size_t i = 0; i < mSamples.size(); ++i)
+	{
+		mHeights[i] = float(mSamples[i])*quantum;
+	}
+
+	mStep = mNext.Step;
+	mAtEnd = !ReadFrameHeader();
+	return true;
+}
+
+size_t WavePlayback::Update(float dt)
+{
+	mTime += dt;
+
+	size_t frames = 0;
+	while (!mAtEnd && double(mNext.Step)*double(mHeader.TimeStep) <= mTime)
+	{
+		if (!NextFrame())
+		{
+			break;
+		}
+		++frames;
+	}
+	return frames;
+}
@@ -0,0 +1,184 @@
+//
+// WaveRecording.h
+// Streams height fields of a running grid to a file, and plays them back.
+//
+// A recording is a header followed by one frame per recorded step.  Heights
+// are quantized to 16 bits, each sample is stored as the zigzag-coded
+// difference to the same sample of the previous frame, and the differences
+// are packed as varints with runs of zeros collapsed, so calm water and
+// quiet regions cost next to nothing.  WaveRecorder does the packing and
+// the writing on its own thread; the solver only quantizes into a free
+// slot of a bounded queue and never waits for the disk.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Waves;
+
+const char WaveRecordingMagic[8] = { 'W', 'A', 'V', 'E', 'R', 'E', 'C', 'S' };
+const uint32_t WaveRecordingVersion = 1;
+
+struct WaveRecordingHeader
+{
+	char Magic[8];
+	uint32_t Version;
+
+	// Written as 0x01020304.
+	uint32_t ByteOrder;
+
+	uint64_t Rows;
+	uint64_t Cols;
+
+	// Steps between recorded frames, and the height of one quantization unit.
+	uint32_t Every;
+	float Quantum;
+
+	// The grid's fixed time step and spacing, for playback at recorded speed.
+	float TimeStep;
+	float SpatialStep;
+};
+
+// Precedes the Bytes of packed samples of every frame.
+struct WaveRecordingFrame
+{
+	// Steps since the recorder was opened.
+	uint64_t Step;
+	uint32_t Bytes;
+	uint32_t Reserved;
+};
+
+class WaveRecorder
+{
+public:
+	WaveRecorder();
+	~WaveRecorder();
+
+	WaveRecorder(const WaveRecorder&) = delete;
+	WaveRecorder& operator=(const WaveRecorder&) = delete;
+
+	// Starts a recording of a grid of waves' size.  Every every-th step is
+	// recorded, with heights rounded to multiples of quantum (to within
+	// 1/256 quantum of nearest; out of range heights are clamped to +-32767
+	// quanta).  queueFrames frames may wait
+	// for the writer; a frame that finds the queue full is dropped.
+	bool Open(const char* path, const Waves& waves, size_t every = 1, float quantum = 1.0f/1024.0f, size_t queueFrames = 8);
+
+	// Writes the frames still queued and closes the file.  Returns false if
+	// any write failed.
+	bool Close();
+	bool IsOpen()const { return mFile != nullptr; }
+
+	// Tells the recorder waves has run steps more steps.  If that reaches the
+	// next multiple of Every(), the current heights are queued and true is
+	// returned.  Call from one thread, right after stepping; several frames
+	// due within one call are recorded as one.
+	bool Record(const Waves& waves, size_t steps);
+
+	size_t Every()const { return mEvery; }
+
+	// Frames queued, and frames dropped because the queue was full.
+	uint64_t FramesRecorded()const;
+	uint64_t FramesDropped()const;
+
+	// File size so far, header included, and samples clamped by quantization.
+	uint64_t BytesWritten()const;
+	uint64_t ClippedSamples()const;
+
+private:
+	struct Slot
+	{
+		std::vector<int16_t> Samples;
+		uint64_t Step;
+	};
+
+	void WriterMain();
+
+	std::FILE* mFile;
+	size_t mRows;
+	size_t mCols;
+	size_t mEvery;
+	float mQuantum;
+	uint64_t mStep;
+
+	std::thread mWriter;
+	std::vector<Slot> mSlots;
+
+	// Writer thread only: the last frame written, and the packed frame.
+	std::vector<int16_t> mPrevious;
+	std::vector<uint8_t> mPacked;
+
+	// Guard everything below.  mFree and mQueue hold slot indices.
+	mutable std::mutex mMutex;
+	std::condition_variable mWake;
+	std::vector<size_t> mFree;
+	std::deque<size_t> mQueue;
+	bool mQuit;
+	bool mFailed;
+	uint64_t mRecorded;
+	uint64_t mDropped;
+	uint64_t mBytes;
+	uint64_t mClipped;
+};
+
+class WavePlayback
+{
+public:
+	WavePlayback();
+	~WavePlayback();
+
+	WavePlayback(const WavePlayback&) = delete;
+	WavePlayback& operator=(const WavePlayback&) = delete;
+
+	// Returns false if the file is missing or is not a recording.
+	bool Open(const char* path);
+	void Close();
+	bool IsOpen()const { return mFile != nullptr; }
+
+	size_t RowCount()const { return mRows; }
+	size_t ColumnCount()const { return mCols; }
+	const WaveRecordingHeader& Header()const { return mHeader; }
+
+	// Decodes the next frame.  Returns false at the end of the recording or
+	// at a damaged frame.
+	bool NextFrame();
+
+	// Plays at the recorded speed: adds dt to the playback clock and decodes
+	// every frame it has reached.  Returns the number of frames decoded.
+	size_t Update(float dt);
+
+	// Back to before the first frame; heights read zero.
+	void Rewind();
+	bool AtEnd()const { return mAtEnd; }
+
+	// Heights of the last decoded frame, ColumnCount() floats per row, and
+	// the step it was recorded at.
+	const float* Heights()const { return mHeights.data(); }
+	uint64_t Step()const { return mStep; }
+
+private:
+	bool ReadFrameHeader();
+
+	std::FILE* mFile;
+	WaveRecordingHeader mHeader;
+	size_t mRows;
+	size_t mCols;
+
+	std::vector<uint8_t> mPacked;
+	std::vector<int16_t> mSamples;
+	std::vector<float> mHeights;
+	uint64_t mStep;
+
+	// Header of the frame NextFrame() decodes, read ahead for Update().
+	WaveRecordingFrame mNext;
+	bool mAtEnd;
+	double mTime;
+};
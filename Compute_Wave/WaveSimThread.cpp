@@ -0,0 +1,239 @@
+//
+// WaveSimThread.cpp
+//
+
+#include "WaveSimThread.h"
+#include "WaveRecording.h"
+#include "WaveProfiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+WaveSimThread::WaveSimThread()
+: mTimeScale(1.0f), mRecorder(nullptr), mBoundsRows(0), mBoundsCols(0),
+  mProfiler(nullptr), mDisturbPhase(0), mUpdatePhase(0), mSnapshotPhase(0), mRecordPhase(0),
+  mHaveSnapshot(false), mQuit(false),
+  mSteps(0), mDroppedSteps(0), mPublished(0), mSkipped(0)
+{
+}
+
+WaveSimThread::~WaveSimThread()
+{
+	Stop();
+}
+
+void WaveSimThread::SetTimeScale(float scale)
+{
+	assert(!Running());
+	mTimeScale = std::max(scale, 0.0f);
+}
+
+void WaveSimThread::SetRecorder(WaveRecorder* recorder)
+{
+	assert(!Running());
+	mRecorder = recorder;
+}
+
+void WaveSimThread::SetHeightBounds(size_t blockRows, size_t blockCols)
+{
+	assert(!Running());
+	mBoundsRows = blockRows;
+	mBoundsCols = blockCols;
+}
+
+void WaveSimThread::SetProfiler(WaveProfiler* profiler)
+{
+	assert(!Running());
+	mProfiler = profiler;
+
+	if (mProfiler)
+	{
+		mDisturbPhase = mProfiler->AddPhase("disturb");
+		mUpdatePhase = mProfiler->AddPhase("update");
+		mSnapshotPhase = mProfiler->AddPhase("snapshot");
+		mRecordPhase = mProfiler->AddPhase("record");
+	}
+}
+
+void WaveSimThread::Start()
+{
+	assert(mWaves.VertexCount() != 0 && mWaves.TimeStep() > 0.0f);
+
+	if (!Running())
+	{
+		mThread = std::thread(&WaveSimThread::ThreadMain, this);
+	}
+}
+
+void WaveSimThread::Stop()
+{
+	if (!Running())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_one();
+
+	mThread.join();
+	mQuit = false;
+}
+
+void WaveSimThread::QueueDisturbance(float row, float col, float radius, float magnitude, size_t brush)
+{
+	WaveImpulse impulse = {};
+	impulse.Row = row;
+	impulse.Col = col;
+	impulse.Radius = radius;
+	impulse.Magnitude = magnitude;
+	impulse.Brush = uint32_t(brush);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPending.push_back(impulse);
+}
+
+const WaveSnapshot* WaveSimThread::AcquireSnapshot()
+{
+	if (mSnapshots.Acquire())
+	{
+		mHaveSnapshot = true;
+	}
+	return mHaveSnapshot ? &mSnapshots.Front() : nullptr;
+}
+
+WaveSnapshotAge WaveSimThread::Age(const WaveSnapshot& snapshot)const
+{
+	WaveSnapshotAge age;
+	age.Seconds = std::chrono::duration<double>(Clock::now() - snapshot.Time).count();
+	age.Steps = mSteps.load(std::memory_order_relaxed) - snapshot.Step;
+	return age;
+}
+
+WaveSimStats WaveSimThread::Stats()const
+{
+	WaveSimStats stats;
+	stats.Steps = mSteps.load(std::memory_order_relaxed);
+	stats.DroppedSteps = mDroppedSteps.load(std::memory_order_relaxed);
+	stats.Snapshots = mPublished.load(std::memory_order_relaxed);
+	stats.SkippedSnapshots = mSkipped.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void WaveSimThread::WriteVertices(const WaveSnapshot& snapshot, const WaveOutputSink& sink)const
+{
+	mWaves.WriteVertices(snapshot.Heights.data(), snapshot.RowStride, sink);
+}
+
+void WaveSimThread::Publish()
+{
+	// Each slot is sized once; after that a snapshot is a single copy.
+	WaveSnapshot& snapshot = mSnapshots.Back();
+	const size_t floats = mWaves.RowCount()*mWaves.RowStride();
+	snapshot.Heights.resize(floats);
+	std::memcpy(snapshot.Heights.data(), mWaves.Heights(), floats*sizeof(float));
+
+	snapshot.RowStride = mWaves.RowStride();
+
+	// Read back while the copy is still in cache.
+	if (mBoundsRows != 0 && mBoundsCols != 0 && mWaves.RowCount() >= 2 && mWaves.ColumnCount() >= 2)
+	{
+		const size_t blocks = ((mWaves.RowCount() - 2) / mBoundsRows + 1)*((mWaves.ColumnCount() - 2) / mBoundsCols + 1);
+		snapshot.MinHeights.resize(blocks);
+		snapshot.MaxHeights.resize(blocks);
+		mWaves.HeightBounds(snapshot.Heights.data(), snapshot.RowStride, mBoundsRows, mBoundsCols,
+			snapshot.MinHeights.data(), snapshot.MaxHeights.data());
+	}
+	else
+	{
+		snapshot.MinHeights.clear();
+		snapshot.MaxHeights.clear();
+	}
+	snapshot.Step = mSteps.load(std::memory_order_relaxed);
+	snapshot.Time = Clock::now();
+
+	if (!mSnapshots.Publish())
+	{
+		mSkipped.fetch_add(1, std::memory_order_relaxed);
+	}
+	mPublished.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WaveSimThread::ThreadMain()
+{
+	if (mProfiler)
+	{
+		mProfiler->SetThreadName("solver");
+	}
+
+	Publish();
+
+	Clock::time_point last = Clock::now();
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mQuit)
+	{
+		mQueued.swap(mPending);
+		lock.unlock();
+
+		if (!mQueued.empty())
+		{
+			WaveProfileScope scope(mProfiler, mDisturbPhase);
+			for (const WaveImpulse& impulse : mQueued)
+			{
+				mWaves.QueueDisturbance(impulse.Row, impulse.Col, impulse.Radius, impulse.Magnitude, impulse.Brush);
+			}
+			mWaves.ApplyDisturbances();
+			mQueued.clear();
+		}
+
+		size_t steps = 1;
+		{
+			WaveProfileScope scope(mProfiler, mUpdatePhase);
+			if (mTimeScale > 0.0f)
+			{
+				const Clock::time_point now = Clock::now();
+				const float elapsed = std::chrono::duration<float>(now - last).count()*mTimeScale;
+				last = now;
+
+				const WaveStepReport report = mWaves.Update(elapsed);
+				steps = report.Steps;
+				mDroppedSteps.fetch_add(uint64_t(std::lround(report.DroppedTime / mWaves.TimeStep())), std::memory_order_relaxed);
+			}
+			else
+			{
+				mWaves.Advance(1);
+			}
+		}
+
+		if (steps != 0)
+		{
+			mSteps.fetch_add(steps, std::memory_order_relaxed);
+			{
+				WaveProfileScope scope(mProfiler, mSnapshotPhase);
+				Publish();
+			}
+
+			if (mRecorder)
+			{
+				WaveProfileScope scope(mProfiler, mRecordPhase);
+				mRecorder->Record(mWaves, steps);
+			}
+		}
+
+		lock.lock();
+
+		// Sleep until the next step falls due; Stop() cuts the wait short.
+		if (mTimeScale > 0.0f && !mQuit)
+		{
+			const float wait = (mWaves.TimeStep() - mWaves.Accumulator()) / mTimeScale;
+			mWake.wait_for(lock, std::chrono::duration<float>(wait), [this]() { return mQuit; });
+		}
+	}
+}
@@ -0,0 +1,154 @@
+//
+// WaveSimThread.h
+// Runs a Waves grid on its own thread and publishes snapshots of its heights.
+//
+// The solver thread steps the grid on its fixed-step clock and, after every
+// step run, copies the height plane into a WaveTripleBuffer.  The render
+// thread takes the newest finished snapshot with AcquireSnapshot(), which
+// never blocks, so solver steps no longer add to frame latency and the two
+// sides can run at unrelated rates.
+//
+
+#pragma once
+
+#include "Waves.h"
+#include "WaveTripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WaveRecorder;
+class WaveProfiler;
+
+// Heights of one completed step, laid out like the grid's own plane.
+struct WaveSnapshot
+{
+	std::vector<float> Heights;
+	size_t RowStride = 0;
+
+	// Height range of every block, if SetHeightBounds() asked for them (see
+	// Waves::HeightBounds()); empty otherwise.
+	std::vector<float> MinHeights;
+	std::vector<float> MaxHeights;
+
+	// Steps the grid had run when the snapshot was taken, and when it was published.
+	uint64_t Step = 0;
+	std::chrono::steady_clock::time_point Time;
+};
+
+struct WaveSimStats
+{
+	// Fixed steps run so far, over every Start().
+	uint64_t Steps;
+
+	// Whole steps the clock discarded because a wake-up came too late to
+	// run them within the substep budget.
+	uint64_t DroppedSteps;
+
+	// Snapshots published, and those replaced before the reader took them.
+	uint64_t Snapshots;
+	uint64_t SkippedSnapshots;
+};
+
+// How far a snapshot lags the solver.
+struct WaveSnapshotAge
+{
+	double Seconds;
+	uint64_t Steps;
+};
+
+class WaveSimThread
+{
+public:
+	WaveSimThread();
+	~WaveSimThread();
+
+	WaveSimThread(const WaveSimThread&) = delete;
+	WaveSimThread& operator=(const WaveSimThread&) = delete;
+
+	// The grid.  Init, configure and disturb it only while stopped.  While
+	// running, the layout accessors (RowCount(), VertexCount(), GetTex(), ...)
+	// and WriteVertices() stay safe to call; the heights do not.
+	Waves& Solver() { return mWaves; }
+	const Waves& Solver()const { return mWaves; }
+
+	// Simulated seconds per wall-clock second.  0 runs the solver flat out,
+	// one step after another without consulting its clock.  Set while stopped.
+	void SetTimeScale(float scale);
+	float TimeScale()const { return mTimeScale; }
+
+	// Recorder told about every step run (see WaveRecorder::Record()), or
+	// nullptr.  Not owned.  Set while stopped.
+	void SetRecorder(WaveRecorder* recorder);
+	WaveRecorder* Recorder()const { return mRecorder; }
+
+	// Profiler the solver thread times its phases with (disturb, update,
+	// snapshot, record), or nullptr.  Not owned.  Set while stopped.
+	void SetProfiler(WaveProfiler* profiler);
+	WaveProfiler* Profiler()const { return mProfiler; }
+
+	// Blocks of blockRows x blockCols quads whose height ranges every
+	// snapshot carries, computed on the solver thread as it publishes; 0
+	// for none.  Set while stopped.
+	void SetHeightBounds(size_t blockRows, size_t blockCols);
+
+	// Starts the solver thread, which publishes the current heights first.
+	// Stop() joins it; the last snapshot stays available.
+	void Start();
+	void Stop();
+	bool Running()const { return mThread.joinable(); }
+
+	// Queues an impulse as Waves::QueueDisturbance() does; safe from any
+	// thread.  The solver applies it before its next step.
+	void QueueDisturbance(float row, float col, float radius, float magnitude, size_t brush = 0);
+
+	// Reader side, from one thread.  Returns the newest published snapshot,
+	// or nullptr before the first.  The snapshot is not touched by the
+	// solver until the next call.
+	const WaveSnapshot* AcquireSnapshot();
+
+	WaveSnapshotAge Age(const WaveSnapshot& snapshot)const;
+	WaveSimStats Stats()const;
+
+	// Writes the vertices of a snapshot to sink, as Waves::Update(dt, sink) would.
+	void WriteVertices(const WaveSnapshot& snapshot, const WaveOutputSink& sink)const;
+
+private:
+	void ThreadMain();
+	void Publish();
+
+	Waves mWaves;
+	float mTimeScale;
+	WaveRecorder* mRecorder;
+	size_t mBoundsRows;
+	size_t mBoundsCols;
+
+	WaveProfiler* mProfiler;
+	uint32_t mDisturbPhase;
+	uint32_t mUpdatePhase;
+	uint32_t mSnapshotPhase;
+	uint32_t mRecordPhase;
+
+	std::thread mThread;
+	WaveTripleBuffer<WaveSnapshot> mSnapshots;
+	bool mHaveSnapshot;
+
+	// Guards the two below; the solver sleeps on mWake between steps.
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mQuit;
+	std::vector<WaveImpulse> mPending;
+
+	// Solver thread only; mQueued is swapped with mPending to keep both capacities.
+	std::vector<WaveImpulse> mQueued;
+
+	std::atomic<uint64_t> mSteps;
+	std::atomic<uint64_t> mDroppedSteps;
+	std::atomic<uint64_t> mPublished;
+	std::atomic<uint64_t> mSkipped;
+};
@@ -0,0 +1,124 @@
+//
+// WaveThreadPool.cpp
+//
+
+#include "WaveThreadPool.h"
+
+WaveThreadPool::WaveThreadPool(size_t threadCount)
+: mTask(nullptr), mTaskCount(0), mNextTask(0), mActiveWorkers(0), mGeneration(0), mQuit(false)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0)
+	{
+		threadCount = 1;
+	}
+
+	mWorkers.reserve(threadCount - 1);
+	for (size_t i = 1; i < threadCount; ++i)
+	{
+		mWorkers.emplace_back(&WaveThreadPool::WorkerMain, this);
+	}
+}
+
+WaveThreadPool::~WaveThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for (std::thread& worker : mWorkers)
+	{
+		worker.join();
+	}
+}
+
+void WaveThreadPool::Run(size_t count, const std::function<void(size_t)>& task)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Nothing to share: skip the wake-up round trip.
+	if (mWorkers.empty() || count == 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTaskCount = count;
+		mNextTask.store(0, std::memory_order_relaxed);
+		++mGeneration;
+	}
+	mWake.notify_all();
+
+	Drain(task, count);
+
+	// Every index has been handed out; wait for the workers still running one.
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [&]() { return mActiveWorkers == 0; });
+	mTask = nullptr;
+}
+
+void WaveThreadPool::WorkerMain()
+{
+	size_t seenGeneration = 0;
+
+	for (;;)
+	{
+		const std::function<void(size_t)>* task;
+		size_t count;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [&]() { return mQuit || mGeneration != seenGeneration; });
+			if (mQuit)
+			{
+				return;
+			}
+			seenGeneration = mGeneration;
+
+			// Woke up after the job was already closed.
+			if (!mTask)
+			{
+				continue;
+			}
+
+			task = mTask;
+			count = mTaskCount;
+			++mActiveWorkers;
+		}
+
+		Drain(*task, count);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mActiveWorkers == 0)
+		{
+			mDone.notify_one();
+		}
+	}
+}
+
+void WaveThreadPool::Drain(const std::function<void(size_t)>& task, size_t count)
+{
+	for (;;)
+	{
+		size_t index = mNextTask.fetch_add(1, std::memory_order_relaxed);
+		if (index >= count)
+		{
+			break;
+		}
+
+		task(index);
+	}
+}
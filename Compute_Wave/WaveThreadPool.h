@@ -0,0 +1,54 @@
+//
+// WaveThreadPool.h
+// Persistent worker threads for the solver.  Workers are created once and
+// sleep between jobs, so running a step in parallel never spawns threads.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WaveThreadPool
+{
+public:
+	// threadCount includes the calling thread, which always takes part in Run().
+	// 0 uses one thread per hardware thread.
+	explicit WaveThreadPool(size_t threadCount = 0);
+	~WaveThreadPool();
+
+	WaveThreadPool(const WaveThreadPool&) = delete;
+	WaveThreadPool& operator=(const WaveThreadPool&) = delete;
+
+	size_t ThreadCount()const { return mWorkers.size() + 1; }
+
+	// Calls task(index) once for every index in [0, count) and returns when all
+	// calls have finished.  Indices are handed out dynamically, so uneven tasks
+	// balance across threads.  Not reentrant: do not call Run() from a task.
+	void Run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+	void WorkerMain();
+	void Drain(const std::function<void(size_t)>& task, size_t count);
+
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+
+	// Current job.  mTask is null while no job is open; workers only join a
+	// job under mMutex and Run() does not return until they have all left it.
+	const std::function<void(size_t)>* mTask;
+	size_t mTaskCount;
+	std::atomic<size_t> mNextTask;
+
+	size_t mActiveWorkers;
+	size_t mGeneration;
+	bool mQuit;
+};
@@ -0,0 +1,68 @@
+//
+// WaveTripleBuffer.h
+// Lock-free hand-off of whole values from one writer thread to one reader.
+//
+// Three slots: the writer fills its back slot and swaps it with the middle
+// one; the reader swaps its front slot with the middle one when the middle
+// holds something newer.  Neither side ever waits for the other, and each
+// owns its slot exclusively between swaps.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+template<typename T>
+class WaveTripleBuffer
+{
+public:
+	WaveTripleBuffer()
+	: mMiddle(1), mBack(0), mFront(2)
+	{
+	}
+
+	WaveTripleBuffer(const WaveTripleBuffer&) = delete;
+	WaveTripleBuffer& operator=(const WaveTripleBuffer&) = delete;
+
+	// Writer side.  The slot to fill next; it keeps whatever it held before.
+	T& Back() { return mSlots[mBack]; }
+
+	// Makes the back slot the newest value.  Returns false if the value it
+	// replaces was never acquired by the reader.
+	bool Publish()
+	{
+		const uint32_t old = mMiddle.exchange(mBack | Fresh, std::memory_order_acq_rel);
+		mBack = old & IndexMask;
+		return (old & Fresh) == 0;
+	}
+
+	// Reader side.  Takes the newest published value if there is one the
+	// reader has not seen yet, and returns whether it did.
+	bool Acquire()
+	{
+		if ((mMiddle.load(std::memory_order_relaxed) & Fresh) == 0)
+		{
+			return false;
+		}
+
+		mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+
+	// The value last acquired; unchanged until the next Acquire().
+	const T& Front()const { return mSlots[mFront]; }
+
+private:
+	static const uint32_t IndexMask = 3;
+	static const uint32_t Fresh = 4;
+
+	T mSlots[3];
+
+	// Index of the middle slot, plus Fresh while the reader has not taken it.
+	std::atomic<uint32_t> mMiddle;
+
+	// Owned by the writer and the reader respectively.
+	uint32_t mBack;
+	uint32_t mFront;
+};
@@ -0,0 +1,39 @@
+//
+// WaveTypes.h
+// Vector storage types shared by the wave solver and the renderer.
+//
+// On Windows these are the DirectXMath storage types. Elsewhere a layout
+// compatible subset is declared so the solver builds without the Windows SDK.
+//
+
+#pragma once
+
+#if defined(_WIN32)
+
+#include <DirectXMath.h>
+
+#else
+
+namespace DirectX
+{
+	struct XMFLOAT2
+	{
+		float x;
+		float y;
+
+		XMFLOAT2() = default;
+		constexpr XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+	};
+
+	struct XMFLOAT3
+	{
+		float x;
+		float y;
+		float z;
+
+		XMFLOAT3() = default;
+		constexpr XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	};
+}
+
+#endif
@@ -0,0 +1,234 @@
+//
+// WaveVertexCache.cpp
+//
+
+#include "WaveVertexCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	const size_t MaxCacheSize = 64;
+
+	// Scoring from Forsyth, "Linear-Speed Vertex Cache Optimisation" (2006).
+	const float CacheDecayPower = 1.5f;
+	const float LastTriangleScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	// Score of a vertex at cachePosition (-1 when not cached) that
+	// remaining unemitted triangles still use.
+	float VertexScore(int cachePosition, size_t cacheSize, uint32_t remaining)
+	{
+		if (remaining == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices score the same, so that the next
+			// triangle does not simply favour the newest of them.
+			if (cachePosition < 3)
+			{
+				score = LastTriangleScore;
+			}
+			else
+			{
+				const float scale = 1.0f / float(cacheSize - 3);
+				score = std::pow(1.0f - float(cachePosition - 3)*scale, CacheDecayPower);
+			}
+		}
+
+		// Finish off vertices that few triangles still need.
+		return score + ValenceBoostScale * std::pow(float(remaining), -ValenceBoostPower);
+	}
+}
+
+WaveCacheStats SimulateVertexCache(const uint32_t* indices, size_t indexCount, size_t cacheSize, WaveCacheModel model)
+{
+	WaveCacheStats stats = { indexCount / 3, 0, 0 };
+
+	std::vector<uint32_t> distinct(indices, indices + indexCount);
+	std::sort(distinct.begin(), distinct.end());
+	stats.Vertices = size_t(std::unique(distinct.begin(), distinct.end()) - distinct.begin());
+
+	if (cacheSize == 0)
+	{
+		stats.Misses = indexCount;
+		return stats;
+	}
+
+	// Entry 0 is the newest; a FIFO cache only reorders on a miss.
+	std::vector<uint32_t> cache;
+	cache.reserve(cacheSize + 1);
+	for (size_t k = 0; k < indexCount; ++k)
+	{
+		const uint32_t v = indices[k];
+		auto hit = std::find(cache.begin(), cache.end(), v);
+		if (hit != cache.end())
+		{
+			if (model == WaveCacheModel::Lru)
+			{
+				std::rotate(cache.begin(), hit, hit + 1);
+			}
+			continue;
+		}
+
+		++stats.Misses;
+		cache.insert(cache.begin(), v);
+		if (cache.size() > cacheSize)
+		{
+			cache.pop_back();
+		}
+	}
+	return stats;
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t cacheSize)
+{
+	cacheSize = std::min(std::max<size_t>(cacheSize, 4), MaxCacheSize);
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	// Dense vertex numbers, so per-vertex state fits in arrays.
+	std::vector<uint32_t> vertices(indices, indices + 3*triangleCount);
+	std::sort(vertices.begin(), vertices.end());
+	vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+	std::vector<uint32_t> dense(3*triangleCount);
+	for (size_t k = 0; k < dense.size(); ++k)
+	{
+		dense[k] = uint32_t(std::lower_bound(vertices.begin(), vertices.end(), indices[k]) - vertices.begin());
+	}
+
+	// Triangles of every vertex; the first remaining[v] of them are not yet emitted.
+	const size_t vertexCount = vertices.size();
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t v : dense)
+	{
+		++remaining[v];
+	}
+
+	std::vector<uint32_t> first(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		first[v + 1] = first[v] + remaining[v];
+	}
+
+	std::vector<uint32_t> adjacent(dense.size());
+	{
+		std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+		for (size_t k = 0; k < dense.size(); ++k)
+		{
+			adjacent[fill[dense[k]]++] = uint32_t(k / 3);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		vertexScore[v] = VertexScore(-1, cacheSize, remaining[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	size_t best = 0;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		triangleScore[t] = vertexScore[dense[3*t]] + vertexScore[dense[3*t + 1]] + vertexScore[dense[3*t + 2]];
+		if (triangleScore[t] > triangleScore[best])
+		{
+			best = t;
+		}
+	}
+
+	// Room for the new triangle's vertices before the oldest fall out.
+	uint32_t cache[MaxCacheSize + 3];
+	uint32_t nextCache[MaxCacheSize + 3];
+	size_t cached = 0;
+
+	std::vector<uint32_t> order;
+	order.reserve(triangleCount);
+	size_t scan = 0;
+
+	while (order.size() < triangleCount)
+	{
+		order.push_back(uint32_t(best));
+		emitted[best] = true;
+
+		// The triangle's vertices go to the front of the cache.
+		size_t next = 0;
+		for (size_t e = 0; e < 3; ++e)
+		{
+			const uint32_t v = dense[3*best + e];
+			nextCache[next++] = v;
+
+			uint32_t* list = &adjacent[first[v]];
+			uint32_t* end = list + remaining[v];
+			*std::find(list, end, uint32_t(best)) = *(end - 1);
+			--remaining[v];
+		}
+		for (size_t k = 0; k < cached; ++k)
+		{
+			const uint32_t v = cache[k];
+			if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+			{
+				nextCache[next++] = v;
+			}
+		}
+
+		// Rescore the cache and everything it touches, including the
+		// vertices that just fell out of it.
+		for (size_t k = 0; k < next; ++k)
+		{
+			const uint32_t v = nextCache[k];
+			cachePosition[v] = k < cacheSize ? int(k) : -1;
+			vertexScore[v] = VertexScore(cachePosition[v], cacheSize, remaining[v]);
+		}
+
+		float bestScore = -1.0f;
+		for (size_t k = 0; k < next; ++k)
+		{
+			const uint32_t v = nextCache[k];
+			for (uint32_t a = first[v]; a < first[v] + remaining[v]; ++a)
+			{
+				const uint32_t t = adjacent[a];
+				triangleScore[t] = vertexScore[dense[3*t]] + vertexScore[dense[3*t + 1]] + vertexScore[dense[3*t + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+
+		cached = std::min(next, cacheSize);
+		std::copy(nextCache, nextCache + cached, cache);
+
+		// Nothing in the cache is used any more: start on the next
+		// triangle not yet emitted.
+		if (bestScore < 0.0f)
+		{
+			while (scan < triangleCount && emitted[scan])
+			{
+				++scan;
+			}
+			best = scan;
+		}
+	}
+
+	std::vector<uint32_t> reordered(3*triangleCount);
+	for (size_t k = 0; k < triangleCount; ++k)
+	{
+		std::copy(indices + 3*order[k], indices + 3*order[k] + 3, &reordered[3*k]);
+	}
+	std::copy(reordered.begin(), reordered.end(), indices);
+}
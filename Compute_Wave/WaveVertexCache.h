@@ -0,0 +1,41 @@
+//
+// WaveVertexCache.h
+// Post-transform vertex cache model and triangle reordering for index lists.
+//
+// A GPU shades each vertex an index list names unless it is still in a small
+// cache of recently shaded vertices, so the order of the triangles decides how
+// often a shared vertex is shaded again.  SimulateVertexCache() counts those
+// misses for a FIFO cache (most hardware) or an LRU one, as ACMR (misses per
+// triangle, 0.5 at best for a grid) and ATVR (misses per distinct vertex, 1 at
+// best).  OptimizeVertexCache() reorders the triangles of any list with Tom
+// Forsyth's linear-speed algorithm.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class WaveCacheModel
+{
+	Fifo,
+	Lru,
+};
+
+struct WaveCacheStats
+{
+	size_t Triangles;
+	size_t Vertices;	// distinct
+	size_t Misses;
+
+	double Acmr()const { return Triangles ? double(Misses) / double(Triangles) : 0.0; }
+	double Atvr()const { return Vertices ? double(Misses) / double(Vertices) : 0.0; }
+};
+
+// Runs indexCount indices (whole triangles) through a cache of cacheSize
+// vertices that starts empty.
+WaveCacheStats SimulateVertexCache(const uint32_t* indices, size_t indexCount, size_t cacheSize, WaveCacheModel model);
+
+// Reorders the triangles of indices in place for a cache of about cacheSize
+// vertices (at most 64).  Triangles keep their winding and their first vertex.
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t cacheSize = 32);
@@ -2,26 +2,200 @@
 // Waves.cpp by Frank Luna (C) 2008 All Rights Reserved.
 //=======================================================================================
 
-#include "pch.h"
 #include "Waves.h"
+#include "WaveThreadPool.h"
+#include "WaveAllocator.h"
+#include "WaveCheckpoint.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <cerrno>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
 
 using namespace DirectX;
 
+namespace
+{
+	// Rows per parallel task.  Small enough to balance the load, large enough
+	// that the per-task overhead stays negligible.
+	const size_t RowsPerBand = 16;
+
+	// Grids with fewer interior cells than this are updated serially; waking
+	// the workers would cost more than the step itself.
+	const size_t MinParallelCells = 128*128;
+
+	// Default temporal blocking: 8 steps over 64x384 tiles keeps the two
+	// scratch planes (tile plus halo) around 256KB, inside a typical L2.
+	const size_t DefaultBlockSteps = 8;
+	const size_t DefaultTileRows = 64;
+	const size_t DefaultTileCols = 384;
+
+	// Queued impulses are grouped by DisturbTileSize x DisturbTileSize tiles.
+	const size_t DisturbTileSize = 64;
+
+	// Plane layout, in floats.  Rows start on cache lines; a row pitch that is
+	// a multiple of 4KB would make the rows above and below alias in the L1
+	// (and defeat the loop stream detector), so such pitches get one more line.
+	const size_t CacheLineFloats = 64 / sizeof(float);
+	const size_t PageFloats = 4096 / sizeof(float);
+
+	size_t PaddedRowStride(size_t cols)
+	{
+		size_t stride = (cols + CacheLineFloats - 1) / CacheLineFloats * CacheLineFloats;
+		if (stride % PageFloats == 0)
+		{
+			stride += CacheLineFloats;
+		}
+		return stride;
+	}
+
+	// Distance between the two planes of a block: whole pages plus eight
+	// cache lines, so prev[j] and curr[j] (in either order) never share an
+	// address modulo 4KB and the store to prev does not stall loads of curr.
+	size_t PlaneStride(size_t rows, size_t rowStride)
+	{
+		return (rows*rowStride + PageFloats - 1) / PageFloats * PageFloats + 8*CacheLineFloats;
+	}
+
+	// True if any cell in [j0, j1) of either row has |x| >= the float whose
+	// bits are threshold.  For non-negative floats the order of the values
+	// matches the order of their bits as signed integers, and an integer
+	// compare vectorizes where a float max reduction (NaN and signed zero
+	// rules) does not.  NaN counts as loud.
+	bool RowIsLoud(const float* a, const float* b, size_t j0, size_t j1, int32_t threshold)
+	{
+		int loud = 0;
+		for (size_t j = j0; j < j1; ++j)
+		{
+			int32_t x, y;
+			std::memcpy(&x, a + j, sizeof(x));
+			std::memcpy(&y, b + j, sizeof(y));
+			loud |= int((x & 0x7fffffff) >= threshold) | int((y & 0x7fffffff) >= threshold);
+		}
+		return loud != 0;
+	}
+
+	// The bits of x as an integer that orders as the floats do (-0 just below
+	// +0), so that a min/max reduction over heights vectorizes, as in
+	// RowIsLoud().  Applying it twice gives the bits back.
+	int32_t OrderedBits(int32_t bits)
+	{
+		return bits ^ ((bits >> 31) & 0x7fffffff);
+	}
+
+	// Lowest and highest of heights[j0] to heights[j1], both included.
+	void HeightRange(const float* heights, size_t j0, size_t j1, float& lo, float& hi)
+	{
+		int32_t low = INT32_MAX;
+		int32_t high = INT32_MIN;
+		for (size_t j = j0; j <= j1; ++j)
+		{
+			int32_t bits;
+			std::memcpy(&bits, heights + j, sizeof(bits));
+			bits = OrderedBits(bits);
+			low = std::min(low, bits);
+			high = std::max(high, bits);
+		}
+
+		low = OrderedBits(low);
+		high = OrderedBits(high);
+		std::memcpy(&lo, &low, sizeof(lo));
+		std::memcpy(&hi, &high, sizeof(hi));
+	}
+
+	// One row segment on its way to a WaveOutputSink.
+	struct WaveVertexRow
+	{
+		const float* Heights;
+		size_t FirstCol;
+		size_t LastCol;
+		float X0;
+		float Dx;
+		float Z;
+	};
+
+	// PayloadBytes < 0 copies sink.PayloadSize bytes.
+	template<int PayloadBytes>
+	void EmitVertices(char* dst, const WaveOutputSink& sink, const WaveVertexRow& row)
+	{
+		const size_t payloadSize = PayloadBytes < 0 ? sink.PayloadSize : size_t(PayloadBytes);
+
+		for (size_t j = row.FirstCol; j < row.LastCol; ++j, dst += sink.Stride)
+		{
+			// Same expressions as operator[], so both give identical vertices.
+			const float v[3] = { row.X0 + j*row.Dx, row.Heights[j - row.FirstCol], row.Z };
+			std::memcpy(dst, v, sizeof(v));
+
+			if (payloadSize)
+			{
+				std::memcpy(dst + sizeof(v), sink.Payload, payloadSize);
+			}
+		}
+	}
+}
+
 Waves::Waves()
 : mNumRows(0), mNumCols(0), mVertexCount(0), mTriangleCount(0), 
-  mK1(0.0f), mK2(0.0f), mK3(0.0f), mTimeStep(0.0f), mSpatialStep(0.0f),
-  mPrevSolution(0), mCurrSolution(0), mTex(nullptr)
+  mK1(0.0f), mK2(0.0f), mK3(0.0f), mSpatialStep(0.0f),
+  mHalfWidth(0.0f), mHalfDepth(0.0f), mRowStride(0), mPlaneStride(0), mPrevSolution(nullptr), mCurrSolution(nullptr),
+  mKernelIsa(DetectWaveKernelIsa()), mKernel(GetWaveRowKernel(mKernelIsa)),
+  mBlockSteps(DefaultBlockSteps), mTileRows(DefaultTileRows), mTileCols(DefaultTileCols),
+  mNextPrevSolution(nullptr), mNextCurrSolution(nullptr),
+  mActivityEpsilon(0.0f), mActivityTileSize(0), mTilesAcross(0), mTilesDown(0), mActiveTileCount(0),
+  mBrushes(1, WaveBrush::Gaussian()),
+  mAllocator(&DefaultWaveAllocator()), mBlockAllocator(nullptr),
+  mBlock(nullptr), mBlockBytes(0), mNextBlock(nullptr), mNextBlockBytes(0)
 {
 }
 
 Waves::~Waves()
 {
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
-	delete[] mTex;
+	ReleaseBlocks();
+}
+
+void Waves::SetAllocator(WaveAllocator* allocator)
+{
+	mAllocator = allocator ? allocator : &DefaultWaveAllocator();
+}
+
+void Waves::ReleaseBlocks()
+{
+	if (mMapping)
+	{
+		mMapping.reset();
+	}
+	else if (mBlockAllocator)
+	{
+		mBlockAllocator->Free(mBlock, mBlockBytes);
+	}
+
+	if (mBlockAllocator)
+	{
+		mBlockAllocator->Free(mNextBlock, mNextBlockBytes);
+	}
+
+	mBlock = mNextBlock = nullptr;
+	mBlockBytes = mNextBlockBytes = 0;
+	mPrevSolution = mCurrSolution = nullptr;
+	mNextPrevSolution = mNextCurrSolution = nullptr;
+}
+
+float* Waves::AllocateBlock(size_t bytes)
+{
+	void* block = mBlockAllocator->Allocate(bytes, 64);
+	if (!block)
+	{
+		throw std::bad_alloc();
+	}
+
+	// Padding included, so every float of the block is defined.
+	std::memset(block, 0, bytes);
+	return static_cast<float*>(block);
 }
 
 size_t Waves::RowCount()const
@@ -44,7 +218,29 @@ size_t Waves::TriangleCount()const
 	return mTriangleCount;
 }
 
-void Waves::Init(size_t m, size_t n, float dx, float dt, float speed, float damping)
+XMFLOAT3 Waves::operator[](int i)const
+{
+	size_t row = size_t(i) / mNumCols;
+	size_t col = size_t(i) % mNumCols;
+
+	float x = -mHalfWidth + col*mSpatialStep;
+	float z = mHalfDepth - row*mSpatialStep;
+
+	return XMFLOAT3(x, mCurrSolution[row*mRowStride + col], z);
+}
+
+XMFLOAT2 Waves::GetTex(size_t i)const
+{
+	size_t row = i / mNumCols;
+	size_t col = i % mNumCols;
+
+	float du = 1.0f / (mNumCols - 1);
+	float dv = 1.0f / (mNumRows - 1);
+
+	return XMFLOAT2(col * du, row * dv);
+}
+
+void Waves::SetLayout(size_t m, size_t n, float dx)
 {
 	mNumRows  = m;
 	mNumCols  = n;
@@ -52,88 +248,912 @@ void Waves::Init(size_t m, size_t n, float dx, float dt, float speed, float damp
 	mVertexCount   = m*n;
 	mTriangleCount = (m-1)*(n-1)*2;
 
-	mTimeStep = 0.0f;
 	mSpatialStep = dx;
 
+	// Vertex x/z and texture coordinates are not stored; operator[] and
+	// GetTex() rebuild them from these extents.
+	mHalfWidth = (n-1)*dx*0.5f;
+	mHalfDepth = (m-1)*dx*0.5f;
+
+	mRowStride = PaddedRowStride(n);
+	mPlaneStride = PlaneStride(m, mRowStride);
+}
+
+void Waves::Init(size_t m, size_t n, float dx, float dt, float speed, float damping)
+{
+	SetLayout(m, n, dx);
+
+	mClock.TimeStep = dt;
+	mClock.Accumulator = 0.0f;
+
 	float d = damping*dt+2.0f;
 	float e = (speed*speed)*(dt*dt)/(dx*dx);
 	mK1     = (damping*dt-2.0f)/ d;
 	mK2     = (4.0f-8.0f*e) / d;
 	mK3     = (2.0f*e) / d;
 
-	float du = 1.0f / (n - 1);
-	float dv = 1.0f / (m - 1);
+	mImpulses.clear();
+
+	const size_t bytes = 2*mPlaneStride*sizeof(float);
+
+	// In case Init() called again: keep the blocks if they are big enough and
+	// came from the allocator in use.
+	if (mMapping || mBlockAllocator != mAllocator || mBlockBytes < bytes)
+	{
+		ReleaseBlocks();
+		mBlockAllocator = mAllocator;
+		mBlock = AllocateBlock(bytes);
+		mBlockBytes = bytes;
+	}
+	else
+	{
+		std::memset(mBlock, 0, mBlockBytes);
+	}
+
+	if (mNextBlock && mNextBlockBytes < bytes)
+	{
+		mBlockAllocator->Free(mNextBlock, mNextBlockBytes);
+		mNextBlock = nullptr;
+		mNextBlockBytes = 0;
+	}
+	else if (mNextBlock)
+	{
+		// Tiles never write the row padding, and the first swap makes this
+		// block the live planes, so it must not keep the old layout's heights.
+		std::memset(mNextBlock, 0, mNextBlockBytes);
+	}
+
+	mPrevSolution = mBlock;
+	mCurrSolution = mBlock + mPlaneStride;
+	mNextPrevSolution = mNextBlock;
+	mNextCurrSolution = mNextBlock ? mNextBlock + mPlaneStride : nullptr;
+
+	// The grid starts flat, and is asleep everywhere.
+	if (mActivityEpsilon > 0.0f)
+	{
+		ResetActivityTiles(false);
+	}
+}
+
+bool Waves::Save(const char* path)const
+{
+	WaveCheckpointHeader header = {};
+	std::memcpy(header.Magic, WaveCheckpointMagic, sizeof(header.Magic));
+	header.Version = WaveCheckpointVersion;
+	header.ByteOrder = WaveCheckpointByteOrder;
+	header.HeaderBytes = WaveCheckpointPageSize;
+	header.Rows = mNumRows;
+	header.Cols = mNumCols;
+	header.RowStride = mRowStride;
+	header.PlaneStride = mPlaneStride;
+	header.SpatialStep = mSpatialStep;
+	header.K1 = mK1;
+	header.K2 = mK2;
+	header.K3 = mK3;
+	header.TimeStep = mClock.TimeStep;
+	header.Accumulator = mClock.Accumulator;
+
+	// Written next to path and renamed over it, so path is never left half
+	// written and a grid mapping the old file keeps its pages.
+	const std::string temp = std::string(path) + ".tmp";
+	std::FILE* file = std::fopen(temp.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	// The header page, zero padded, then the planes in the order of mBlock.
+	std::vector<char> page(WaveCheckpointPageSize, 0);
+	std::memcpy(page.data(), &header, sizeof(header));
+
+	bool ok = std::fwrite(page.data(), 1, page.size(), file) == page.size();
+	ok = ok && std::fwrite(mPrevSolution, sizeof(float), mPlaneStride, file) == mPlaneStride;
+	ok = ok && std::fwrite(mCurrSolution, sizeof(float), mPlaneStride, file) == mPlaneStride;
+	ok = std::fclose(file) == 0 && ok;
+
+#if defined(_WIN32)
+	// rename() does not replace existing files here.
+	ok = ok && (std::remove(path) == 0 || errno == ENOENT);
+#endif
+	ok = ok && std::rename(temp.c_str(), path) == 0;
+
+	if (!ok)
+	{
+		std::remove(temp.c_str());
+	}
+	return ok;
+}
+
+bool Waves::Load(const char* path)
+{
+	std::unique_ptr<WaveFileMapping> mapping(new WaveFileMapping(path));
+	if (!mapping->Data() || mapping->Size() < sizeof(WaveCheckpointHeader))
+	{
+		return false;
+	}
+
+	WaveCheckpointHeader header;
+	std::memcpy(&header, mapping->Data(), sizeof(header));
+
+	// Bounded so the size checks below cannot overflow.
+	const uint64_t MaxSide = uint64_t(1) << 24;
+
+	bool valid = std::memcmp(header.Magic, WaveCheckpointMagic, sizeof(header.Magic)) == 0 &&
+		header.Version == WaveCheckpointVersion &&
+		header.ByteOrder == WaveCheckpointByteOrder &&
+		header.HeaderBytes >= WaveCheckpointPageSize && header.HeaderBytes % WaveCheckpointPageSize == 0 &&
+		header.Rows >= 3 && header.Rows <= MaxSide &&
+		header.Cols >= 3 && header.Cols <= MaxSide &&
+		header.RowStride >= header.Cols && header.RowStride <= 2*MaxSide &&
+		header.PlaneStride >= header.Rows*header.RowStride && header.PlaneStride <= 4*MaxSide*MaxSide &&
+		std::isfinite(header.TimeStep) && header.TimeStep > 0.0f &&
+		std::isfinite(header.SpatialStep) && header.SpatialStep > 0.0f &&
+		std::isfinite(header.K1) && std::isfinite(header.K2) && std::isfinite(header.K3) &&
+		std::isfinite(header.Accumulator) && header.Accumulator >= 0.0f && header.Accumulator < header.TimeStep;
+
+	// HeaderBytes is not bounded above, so compare without adding to it.
+	valid = valid && header.HeaderBytes <= mapping->Size() &&
+		(mapping->Size() - header.HeaderBytes) / (2*sizeof(float)) >= header.PlaneStride;
+	if (!valid)
+	{
+		return false;
+	}
+
+	ReleaseBlocks();
+	mImpulses.clear();
+
+	SetLayout(size_t(header.Rows), size_t(header.Cols), header.SpatialStep);
+	mK1 = header.K1;
+	mK2 = header.K2;
+	mK3 = header.K3;
+	mClock.TimeStep = header.TimeStep;
+	mClock.Accumulator = header.Accumulator;
+
+	// Blocks for temporal blocking still come from the allocator.
+	mBlockAllocator = mAllocator;
+	mBlockBytes = 2*mPlaneStride*sizeof(float);
 
-	// In case Init() called again.
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
-	delete[] mTex;
+	const float* planes = reinterpret_cast<const float*>(static_cast<const char*>(mapping->Data()) + header.HeaderBytes);
 
-	mPrevSolution = new XMFLOAT3[m*n];
-	mCurrSolution = new XMFLOAT3[m*n];
-	mTex = new XMFLOAT2[m*n];
+	if (header.RowStride == mRowStride && header.PlaneStride == mPlaneStride)
+	{
+		mBlock = const_cast<float*>(planes);
+		mMapping = std::move(mapping);
+	}
+	else
+	{
+		mBlock = AllocateBlock(mBlockBytes);
+		for (size_t plane = 0; plane < 2; ++plane)
+		{
+			for (size_t i = 0; i < mNumRows; ++i)
+			{
+				const float* src = planes + plane*header.PlaneStride + i*header.RowStride;
+				std::copy(src, src + mNumCols, mBlock + plane*mPlaneStride + i*mRowStride);
+			}
+		}
+	}
+
+	mPrevSolution = mBlock;
+	mCurrSolution = mBlock + mPlaneStride;
+
+	// Nothing is known about where the waves are.
+	if (mActivityEpsilon > 0.0f)
+	{
+		ResetActivityTiles(true);
+	}
+
+	return true;
+}
+
+WaveStepReport Waves::Update(float dt)
+{
+	WaveStepReport report = ConsumeTime(dt);
+
+	AdvanceTo(report.Steps, nullptr);
+
+	return report;
+}
+
+WaveStepReport Waves::Update(float dt, const WaveOutputSink& sink)
+{
+	WaveStepReport report = ConsumeTime(dt);
+
+	AdvanceTo(report.Steps, &sink);
+
+	return report;
+}
+
+WaveStepReport Waves::ConsumeTime(float dt)
+{
+	return mClock.Consume(dt);
+}
+
+void Waves::SetMaxSubsteps(size_t steps)
+{
+	mClock.MaxSubsteps = std::max<size_t>(steps, 1);
+}
 
-	// Generate grid vertices in system memory.
+void Waves::StepRows(size_t firstRow, size_t lastRow, const WaveOutputSink* sink)
+{
+	const WaveConstants k = { mK1, mK2, mK3 };
+
+	// Only update interior points; we use zero boundary conditions.
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to 
+	// keep consistent with our row indices going down.
+	//
+	// After this update we will be discarding the old previous
+	// buffer, so the kernel overwrites that buffer with the new update.
+	//
+	// A row's gradients need the new rows on both sides, so they trail the
+	// sweep by one row.  The row above the band is another band's unless it
+	// is the boundary; the first row of such a band is left to
+	// EmitGradientSeams(), and so is the last unless the boundary follows.
+	const size_t gradientRow = firstRow == 1 ? 1 : firstRow + 1;
 
-	float halfWidth = (n-1)*dx*0.5f;
-	float halfDepth = (m-1)*dx*0.5f;
-	for(size_t i = 0; i < m; ++i)
+	for(size_t i = firstRow; i < lastRow; ++i)
 	{
-		float z = halfDepth - i*dx;
-		for(size_t j = 0; j < n; ++j)
+		size_t row = i*mRowStride + 1;
+		mKernel(mPrevSolution + row, mCurrSolution + row, mRowStride, mNumCols - 2, k);
+
+		// The new row, boundary cells included, is still hot: hand it out now.
+		if (sink)
 		{
-			float x = -halfWidth + j*dx;
+			EmitRow(*sink, i, 0, mNumCols, mPrevSolution + i*mRowStride);
 
-			mPrevSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mCurrSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mTex[i*n + j] = XMFLOAT2(j * du, i * dv);
+			if (i > gradientRow)
+			{
+				EmitGradientRow(*sink, i - 1, mPrevSolution, mRowStride);
+			}
 		}
 	}
+
+	if (sink && lastRow == mNumRows - 1 && lastRow - 1 >= gradientRow)
+	{
+		EmitGradientRow(*sink, lastRow - 1, mPrevSolution, mRowStride);
+	}
 }
 
-void Waves::Update(float dt)
+size_t Waves::BandCount()const
 {
-	static float t = 0;
+	return (mNumRows - 2 + RowsPerBand - 1) / RowsPerBand;
+}
+
+void Waves::StepBand(size_t band, const WaveOutputSink* sink)
+{
+	size_t first = 1 + band*RowsPerBand;
+	size_t last = std::min(first + RowsPerBand, mNumRows - 1);
+	StepRows(first, last, sink);
+}
+
+void Waves::Step(const WaveOutputSink* sink)
+{
+	if (mActivityEpsilon > 0.0f)
+	{
+		StepSparse(sink);
+		return;
+	}
+
+	if (mThreadPool && (mNumRows - 2)*(mNumCols - 2) >= MinParallelCells)
+	{
+		// Each band writes only its own rows of the previous buffer and reads
+		// the current buffer, so the bands are independent.
+		mThreadPool->Run(BandCount(), [&](size_t band) { StepBand(band, sink); });
 
-	// Accumulate time.
-	t += dt;
+		if (sink)
+		{
+			EmitGradientSeams(*sink);
+		}
+	}
+	else
+	{
+		StepRows(1, mNumRows - 1, sink);
+	}
+
+	// The boundary rows are not swept but must still reach the sink.
+	if (sink)
+	{
+		EmitRow(*sink, 0, 0, mNumCols, mPrevSolution);
+		EmitRow(*sink, mNumRows - 1, 0, mNumCols, mPrevSolution + (mNumRows - 1)*mRowStride);
+		EmitGradientRow(*sink, 0, mPrevSolution, mRowStride);
+		EmitGradientRow(*sink, mNumRows - 1, mPrevSolution, mRowStride);
+	}
+
+	EndStep();
+}
+
+void Waves::EndStep()
+{
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevSolution, mCurrSolution);
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	// Only StepSparse() keeps the activity mask up to date; after a dense step
+	// (run by a WaveBatch) any tile may hold waves again.
+	if (mActivityEpsilon > 0.0f)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		for(DWORD i = 1; i < mNumRows-1; ++i)
+		ResetActivityTiles(true);
+	}
+}
+
+void Waves::Advance(size_t steps)
+{
+	AdvanceTo(steps, nullptr);
+}
+
+void Waves::Advance(size_t steps, const WaveOutputSink& sink)
+{
+	AdvanceTo(steps, &sink);
+}
+
+void Waves::AdvanceTo(size_t steps, const WaveOutputSink* sink)
+{
+	ApplyDisturbances();
+
+	// Nothing to sweep: the caller still expects every vertex.
+	if (steps == 0 && sink)
+	{
+		WriteVertices(mCurrSolution, mRowStride, *sink);
+		return;
+	}
+
+	while (steps > 0)
+	{
+		// The tiles of a temporal block know nothing of the activity mask.
+		size_t block = mActivityEpsilon > 0.0f ? 1 : std::min(steps, mBlockSteps);
+
+		// Only the last run produces the heights the sink wants.
+		const WaveOutputSink* out = block == steps ? sink : nullptr;
+
+		if (block == 1)
+		{
+			Step(out);
+		}
+		else
+		{
+			AdvanceBlock(block, out);
+		}
+
+		steps -= block;
+	}
+}
+
+void Waves::EmitRow(const WaveOutputSink& sink, size_t i, size_t firstCol, size_t lastCol, const float* heights)const
+{
+	if (!sink.Data)
+	{
+		return;
+	}
+
+	char* dst = static_cast<char*>(sink.Data) + (i*mNumCols + firstCol)*sink.Stride;
+
+	const WaveVertexRow row = { heights, firstCol, lastCol, -mHalfWidth, mSpatialStep, mHalfDepth - i*mSpatialStep };
+
+	// Fixed payload sizes let the compiler turn the copy into plain moves.
+	switch (sink.Payload ? sink.PayloadSize : 0)
+	{
+	case 0:  EmitVertices<0>(dst, sink, row); break;
+	case 4:  EmitVertices<4>(dst, sink, row); break;
+	case 8:  EmitVertices<8>(dst, sink, row); break;
+	case 12: EmitVertices<12>(dst, sink, row); break;
+	case 16: EmitVertices<16>(dst, sink, row); break;
+	default: EmitVertices<-1>(dst, sink, row); break;
+	}
+}
+
+void Waves::EmitGradientRow(const WaveOutputSink& sink, size_t i, const float* plane, size_t rowStride)const
+{
+	if (!sink.GradientX && !sink.GradientZ)
+	{
+		return;
+	}
+
+	const float* row = plane + i*rowStride;
+	const size_t n = mNumCols;
+
+	if (sink.GradientX)
+	{
+		float* gx = sink.GradientX + i*n;
+		const float central = 0.5f / mSpatialStep;
+		const float edge = 1.0f / mSpatialStep;
+
+		gx[0] = (row[1] - row[0])*edge;
+		for (size_t j = 1; j + 1 < n; ++j)
+		{
+			gx[j] = (row[j + 1] - row[j - 1])*central;
+		}
+		gx[n - 1] = (row[n - 1] - row[n - 2])*edge;
+	}
+
+	if (sink.GradientZ)
+	{
+		float* gz = sink.GradientZ + i*n;
+		// +z is row 0: the row above is further along z.
+		const float* above = i > 0 ? row - rowStride : row;
+		const float* below = i + 1 < mNumRows ? row + rowStride : row;
+		const float scale = (i > 0 && i + 1 < mNumRows ? 0.5f : 1.0f) / mSpatialStep;
+
+		for (size_t j = 0; j < n; ++j)
+		{
+			gz[j] = (above[j] - below[j])*scale;
+		}
+	}
+}
+
+void Waves::EmitGradientSeams(const WaveOutputSink& sink)const
+{
+	if (!sink.GradientX && !sink.GradientZ)
+	{
+		return;
+	}
+
+	for (size_t band = 0; band < BandCount(); ++band)
+	{
+		const size_t first = 1 + band*RowsPerBand;
+		const size_t last = std::min(first + RowsPerBand, mNumRows - 1);
+
+		if (first > 1)
 		{
-			for(DWORD j = 1; j < mNumCols-1; ++j)
+			EmitGradientRow(sink, first, mPrevSolution, mRowStride);
+		}
+		if (last < mNumRows - 1 && (first == 1 || last - 1 > first))
+		{
+			EmitGradientRow(sink, last - 1, mPrevSolution, mRowStride);
+		}
+	}
+}
+
+void Waves::WriteVertices(const float* heights, size_t rowStride, const WaveOutputSink& sink)const
+{
+	for (size_t i = 0; i < mNumRows; ++i)
+	{
+		EmitRow(sink, i, 0, mNumCols, heights + i*rowStride);
+
+		// Trails by a row, as in StepRows(), to read rows while they are hot.
+		if (i > 0)
+		{
+			EmitGradientRow(sink, i - 1, heights, rowStride);
+		}
+	}
+	EmitGradientRow(sink, mNumRows - 1, heights, rowStride);
+}
+
+void Waves::WriteVertices(const float* heights, size_t rowStride, const WaveOutputSink& sink,
+	size_t firstRow, size_t lastRow, size_t firstCol, size_t lastCol)const
+{
+	lastRow = std::min(lastRow, mNumRows);
+	lastCol = std::min(lastCol, mNumCols);
+	if (firstCol >= lastCol)
+	{
+		return;
+	}
+
+	for (size_t i = firstRow; i < lastRow; ++i)
+	{
+		EmitRow(sink, i, firstCol, lastCol, heights + i*rowStride + firstCol);
+	}
+}
+
+void Waves::HeightBounds(const float* heights, size_t rowStride, size_t blockRows, size_t blockCols,
+	float* minOut, float* maxOut)const
+{
+	if (mNumRows < 2 || mNumCols < 2 || blockRows == 0 || blockCols == 0)
+	{
+		return;
+	}
+
+	const size_t down = (mNumRows - 2) / blockRows + 1;
+	const size_t across = (mNumCols - 2) / blockCols + 1;
+	std::fill(minOut, minOut + down*across, FLT_MAX);
+	std::fill(maxOut, maxOut + down*across, -FLT_MAX);
+
+	// One pass over the rows.  A row on the edge between two rows of blocks
+	// belongs to both, as a column on the edge between two blocks does.
+	for (size_t i = 0; i < mNumRows; ++i)
+	{
+		const float* row = heights + i*rowStride;
+		const size_t below = std::min(i / blockRows, down - 1);
+		const size_t above = i > 0 && i % blockRows == 0 ? i / blockRows - 1 : below;
+
+		for (size_t c = 0; c < across; ++c)
+		{
+			const size_t j0 = c*blockCols;
+			const size_t j1 = std::min(j0 + blockCols, mNumCols - 1);
+
+			float lo, hi;
+			HeightRange(row, j0, j1, lo, hi);
+
+			for (size_t b : { above*across + c, below*across + c })
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				minOut[b] = std::min(minOut[b], lo);
+				maxOut[b] = std::max(maxOut[b], hi);
 			}
 		}
+	}
+}
+
+void Waves::SetTemporalBlocking(size_t blockSteps, size_t tileRows, size_t tileCols)
+{
+	mBlockSteps = std::max<size_t>(blockSteps, 1);
+	mTileRows = std::max<size_t>(tileRows, 1);
+	mTileCols = std::max<size_t>(tileCols, 1);
+}
+
+void Waves::AdvanceBlock(size_t steps, const WaveOutputSink* sink)
+{
+	if (!mNextPrevSolution)
+	{
+		mNextBlockBytes = 2*mPlaneStride*sizeof(float);
+		mNextBlock = AllocateBlock(mNextBlockBytes);
+		mNextPrevSolution = mNextBlock;
+		mNextCurrSolution = mNextBlock + mPlaneStride;
+	}
+
+	const size_t tileCount =
+		((mNumRows + mTileRows - 1) / mTileRows) *
+		((mNumCols + mTileCols - 1) / mTileCols);
+
+	// Tiles only read the current planes and write disjoint parts of the next
+	// ones, so they can run in any order and in parallel.
+	if (mThreadPool)
+	{
+		mThreadPool->Run(tileCount, [&](size_t tile) { AdvanceTile(tile, steps, sink); });
+	}
+	else
+	{
+		for (size_t tile = 0; tile < tileCount; ++tile)
+		{
+			AdvanceTile(tile, steps, sink);
+		}
+	}
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+	std::swap(mPrevSolution, mNextPrevSolution);
+	std::swap(mCurrSolution, mNextCurrSolution);
 
-		t = 0.0f; // reset time
+	// A tile's new heights end at its edge, so its edge gradients need the
+	// neighbouring tiles: the gradients take a pass of their own here.
+	if (sink && (sink->GradientX || sink->GradientZ))
+	{
+		for (size_t i = 0; i < mNumRows; ++i)
+		{
+			EmitGradientRow(*sink, i, mCurrSolution, mRowStride);
+		}
 	}
 }
 
+void Waves::AdvanceTile(size_t tile, size_t steps, const WaveOutputSink* sink)
+{
+	const size_t tilesPerRow = (mNumCols + mTileCols - 1) / mTileCols;
+
+	// Tile extents.
+	const size_t r0 = (tile / tilesPerRow) * mTileRows;
+	const size_t c0 = (tile % tilesPerRow) * mTileCols;
+	const size_t r1 = std::min(r0 + mTileRows, mNumRows);
+	const size_t c1 = std::min(c0 + mTileCols, mNumCols);
+
+	// Tile plus a halo of one cell per step, clipped to the grid.
+	const size_t R0 = r0 > steps ? r0 - steps : 0;
+	const size_t C0 = c0 > steps ? c0 - steps : 0;
+	const size_t R1 = std::min(r1 + steps, mNumRows);
+	const size_t C1 = std::min(c1 + steps, mNumCols);
+	const size_t width = C1 - C0;
+	const size_t height = R1 - R0;
+
+	thread_local std::vector<float> scratch;
+	scratch.resize(2*width*height);
+
+	float* prev = scratch.data();
+	float* curr = prev + width*height;
+
+	for (size_t i = R0; i < R1; ++i)
+	{
+		std::copy(mPrevSolution + i*mRowStride + C0, mPrevSolution + i*mRowStride + C1, prev + (i-R0)*width);
+		std::copy(mCurrSolution + i*mRowStride + C0, mCurrSolution + i*mRowStride + C1, curr + (i-R0)*width);
+	}
+
+	const WaveConstants k = { mK1, mK2, mK3 };
+
+	// Every step the valid region shrinks by one cell on each side that is not
+	// a grid boundary; after the last step it is exactly the tile, and the
+	// older plane is still valid one cell beyond it.
+	for (size_t s = 1; s <= steps; ++s)
+	{
+		const size_t lo  = std::max<size_t>(r0 + s > steps ? r0 + s - steps : 0, 1);
+		const size_t hi  = std::min(r1 + steps - s, mNumRows - 1);
+		const size_t clo = std::max<size_t>(c0 + s > steps ? c0 + s - steps : 0, 1);
+		const size_t chi = std::min(c1 + steps - s, mNumCols - 1);
+
+		if (clo < chi)
+		{
+			for (size_t i = lo; i < hi; ++i)
+			{
+				size_t cell = (i-R0)*width + (clo-C0);
+				mKernel(prev + cell, curr + cell, width, chi - clo, k);
+			}
+		}
+
+		std::swap(prev, curr);
+	}
+
+	for (size_t i = r0; i < r1; ++i)
+	{
+		const size_t src = (i-R0)*width + (c0-C0);
+		std::copy(prev + src, prev + src + (c1-c0), mNextPrevSolution + i*mRowStride + c0);
+		std::copy(curr + src, curr + src + (c1-c0), mNextCurrSolution + i*mRowStride + c0);
+
+		// Tiles cover the whole grid, boundary included.
+		if (sink)
+		{
+			EmitRow(*sink, i, c0, c1, curr + src);
+		}
+	}
+}
+
+void Waves::SetActivityTracking(float epsilon, size_t tileSize)
+{
+	mActivityEpsilon = std::max(epsilon, 0.0f);
+	mActivityTileSize = std::max<size_t>(tileSize, 1);
+
+	if (mActivityEpsilon > 0.0f)
+	{
+		// Nothing is known about the current heights yet.
+		ResetActivityTiles(true);
+	}
+	else
+	{
+		mTilesAcross = mTilesDown = mActiveTileCount = 0;
+		mTileAwake.clear();
+		mTileLoud.clear();
+		mTileStep.clear();
+		mStepTiles.clear();
+		mStepTileRows.clear();
+	}
+}
+
+Waves::TileRect Waves::ActivityTile(size_t tile)const
+{
+	TileRect rect;
+	rect.Row0 = (tile / mTilesAcross) * mActivityTileSize;
+	rect.Col0 = (tile % mTilesAcross) * mActivityTileSize;
+	rect.Row1 = std::min(rect.Row0 + mActivityTileSize, mNumRows);
+	rect.Col1 = std::min(rect.Col0 + mActivityTileSize, mNumCols);
+	return rect;
+}
+
+void Waves::ResetActivityTiles(bool awake)
+{
+	mTilesAcross = (mNumCols + mActivityTileSize - 1) / mActivityTileSize;
+	mTilesDown = (mNumRows + mActivityTileSize - 1) / mActivityTileSize;
+
+	const size_t count = mTilesAcross*mTilesDown;
+	mTileAwake.assign(count, awake ? 1 : 0);
+
+	// Awake tiles are measured by the next step.
+	mTileLoud.assign(count, 0);
+	mTileStep.assign(count, 0);
+	mActiveTileCount = awake ? count : 0;
+}
+
+void Waves::WakeRect(size_t row0, size_t row1, size_t col0, size_t col1)
+{
+	if (mActivityEpsilon > 0.0f)
+	{
+		for (size_t ty = row0 / mActivityTileSize; ty <= row1 / mActivityTileSize; ++ty)
+		{
+			for (size_t tx = col0 / mActivityTileSize; tx <= col1 / mActivityTileSize; ++tx)
+			{
+				mTileAwake[ty*mTilesAcross + tx] = 1;
+			}
+		}
+	}
+}
+
+void Waves::WakeCell(size_t i, size_t j)
+{
+	if (mActivityEpsilon > 0.0f)
+	{
+		mTileAwake[(i / mActivityTileSize)*mTilesAcross + j / mActivityTileSize] = 1;
+	}
+}
+
+void Waves::StepSparse(const WaveOutputSink* sink)
+{
+	// Waves travel one cell per step, so a sleeping tile next to an awake one
+	// may receive some: update awake tiles and their neighbours.
+	mStepTiles.clear();
+	mStepTileRows.clear();
+	for (size_t ty = 0; ty < mTilesDown; ++ty)
+	{
+		const size_t before = mStepTiles.size();
+
+		for (size_t tx = 0; tx < mTilesAcross; ++tx)
+		{
+			const size_t t = ty*mTilesAcross + tx;
+
+			bool update = mTileAwake[t] ||
+				(tx > 0 && mTileAwake[t - 1]) ||
+				(tx + 1 < mTilesAcross && mTileAwake[t + 1]) ||
+				(ty > 0 && mTileAwake[t - mTilesAcross]) ||
+				(ty + 1 < mTilesDown && mTileAwake[t + mTilesAcross]);
+
+			mTileStep[t] = update ? 1 : 0;
+			if (update)
+			{
+				mStepTiles.push_back(t);
+			}
+		}
+
+		if (mStepTiles.size() != before)
+		{
+			mStepTileRows.push_back(ty);
+		}
+	}
+
+	for (size_t t : mStepTiles)
+	{
+		mTileAwake[t] = 1;
+	}
+
+	// Like row bands, rows of tiles write disjoint cells of the previous plane.
+	if (mThreadPool && mStepTileRows.size() > 1 && (mNumRows - 2)*(mNumCols - 2) >= MinParallelCells)
+	{
+		mThreadPool->Run(mStepTileRows.size(), [&](size_t task) { StepTileRow(mStepTileRows[task]); });
+	}
+	else
+	{
+		for (size_t ty : mStepTileRows)
+		{
+			StepTileRow(ty);
+		}
+	}
+
+	// A tile sleeps once it and its neighbours are quiet.  The decision only
+	// reads the loud flags, so all tiles are decided before any is flushed.
+	auto quiet = [&](size_t t) { return !mTileLoud[t]; };
+
+	size_t sleepers = 0;
+	for (size_t t : mStepTiles)
+	{
+		const size_t tx = t % mTilesAcross;
+		const size_t ty = t / mTilesAcross;
+
+		bool sleep = quiet(t) &&
+			(tx == 0 || quiet(t - 1)) &&
+			(tx + 1 == mTilesAcross || quiet(t + 1)) &&
+			(ty == 0 || quiet(t - mTilesAcross)) &&
+			(ty + 1 == mTilesDown || quiet(t + mTilesAcross));
+
+		if (sleep)
+		{
+			mTileAwake[t] = 0;
+			++sleepers;
+		}
+	}
+
+	for (size_t t : mStepTiles)
+	{
+		if (!mTileAwake[t])
+		{
+			const TileRect r = ActivityTile(t);
+			for (size_t i = r.Row0; i < r.Row1; ++i)
+			{
+				std::fill(mPrevSolution + i*mRowStride + r.Col0, mPrevSolution + i*mRowStride + r.Col1, 0.0f);
+				std::fill(mCurrSolution + i*mRowStride + r.Col0, mCurrSolution + i*mRowStride + r.Col1, 0.0f);
+			}
+		}
+	}
+
+	mActiveTileCount = mStepTiles.size() - sleepers;
+
+	std::swap(mPrevSolution, mCurrSolution);
+
+	// Flushing may still change cells after they were computed, so the sink
+	// is filled once the step is final.
+	if (sink)
+	{
+		WriteVertices(mCurrSolution, mRowStride, *sink);
+	}
+}
+
+void Waves::StepTileRow(size_t tileRow)
+{
+	const WaveConstants k = { mK1, mK2, mK3 };
+	const uint8_t* step = mTileStep.data() + tileRow*mTilesAcross;
+	uint8_t* loud = mTileLoud.data() + tileRow*mTilesAcross;
+
+	int32_t threshold;
+	std::memcpy(&threshold, &mActivityEpsilon, sizeof(threshold));
+
+	const size_t r0 = tileRow*mActivityTileSize;
+	const size_t r1 = std::min(r0 + mActivityTileSize, mNumRows);
+
+	for (size_t tx = 0; tx < mTilesAcross; ++tx)
+	{
+		if (step[tx])
+		{
+			loud[tx] = 0;
+		}
+	}
+
+	// Grid row by grid row, so that each run of adjacent updated tiles is one
+	// long kernel call over contiguous memory, as in the dense sweep.
+	for (size_t i = r0; i < r1; ++i)
+	{
+		const bool interior = i > 0 && i + 1 < mNumRows;
+
+		for (size_t tx = 0; tx < mTilesAcross; )
+		{
+			if (!step[tx])
+			{
+				++tx;
+				continue;
+			}
+
+			const size_t first = tx;
+			while (tx < mTilesAcross && step[tx])
+			{
+				++tx;
+			}
+
+			const size_t c0 = first*mActivityTileSize;
+			const size_t c1 = std::min(tx*mActivityTileSize, mNumCols);
+			const size_t clo = std::max<size_t>(c0, 1);
+			const size_t chi = std::min(c1, mNumCols - 1);
+
+			if (interior && clo < chi)
+			{
+				size_t cell = i*mRowStride + clo;
+				mKernel(mPrevSolution + cell, mCurrSolution + cell, mRowStride, chi - clo, k);
+			}
+
+			// Check the new row and the one it replaces while they are in cache.
+			for (size_t t = first; t < tx; ++t)
+			{
+				const size_t j0 = t*mActivityTileSize;
+				const size_t j1 = std::min(j0 + mActivityTileSize, mNumCols);
+				if (!loud[t] && RowIsLoud(mPrevSolution + i*mRowStride, mCurrSolution + i*mRowStride, j0, j1, threshold))
+				{
+					loud[t] = 1;
+				}
+			}
+		}
+	}
+}
+
+void Waves::SetThreadCount(size_t threads)
+{
+	if (threads == 1)
+	{
+		mThreadPool.reset();
+		return;
+	}
+
+	mThreadPool = std::make_unique<WaveThreadPool>(threads);
+	if (mThreadPool->ThreadCount() == 1)
+	{
+		mThreadPool.reset();
+	}
+}
+
+size_t Waves::ThreadCount()const
+{
+	return mThreadPool ? mThreadPool->ThreadCount() : 1;
+}
+
+bool Waves::SetKernel(WaveKernelIsa isa)
+{
+	WaveRowKernel kernel = GetWaveRowKernel(isa);
+	if (!kernel)
+	{
+		return false;
+	}
+
+	mKernelIsa = isa;
+	mKernel = kernel;
+	return true;
+}
+
 void Waves::Disturb(size_t i, size_t j, float magnitude)
 {
 	// Don't disturb boundaries.
@@ -143,10 +1163,106 @@ void Waves::Disturb(size_t i, size_t j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrSolution[i*mRowStride+j]     += magnitude;
+	mCurrSolution[i*mRowStride+j+1]   += halfMag;
+	mCurrSolution[i*mRowStride+j-1]   += halfMag;
+	mCurrSolution[(i+1)*mRowStride+j] += halfMag;
+	mCurrSolution[(i-1)*mRowStride+j] += halfMag;
+
+	WakeCell(i, j);
+	WakeCell(i, j+1);
+	WakeCell(i, j-1);
+	WakeCell(i+1, j);
+	WakeCell(i-1, j);
+}
+
+size_t Waves::AddBrush(const WaveBrush& brush)
+{
+	mBrushes.push_back(brush);
+	return mBrushes.size() - 1;
+}
+
+void Waves::QueueDisturbance(float row, float col, float radius, float magnitude, size_t brush)
+{
+	assert(brush < mBrushes.size());
+
+	// NaN would survive the clamps below and in StampImpulse() and reach a
+	// size_t conversion; /fp:fast cannot be trusted to order NaN compares.
+	if (!std::isfinite(row) || !std::isfinite(col) || !std::isfinite(radius) || !std::isfinite(magnitude))
+	{
+		return;
+	}
+
+	// Centres off the grid still sort next to the edge they are closest to.
+	const size_t tilesAcross = (mNumCols + DisturbTileSize - 1) / DisturbTileSize;
+	const float maxRow = float(mNumRows - 1);
+	const float maxCol = float(mNumCols - 1);
+	const size_t ti = size_t(std::min(std::max(row, 0.0f), maxRow)) / DisturbTileSize;
+	const size_t tj = size_t(std::min(std::max(col, 0.0f), maxCol)) / DisturbTileSize;
+
+	WaveImpulse impulse;
+	impulse.Row = row;
+	impulse.Col = col;
+	impulse.Radius = std::max(radius, 1.0f);
+	impulse.Magnitude = magnitude;
+	impulse.Brush = uint32_t(brush);
+	impulse.Tile = uint32_t(ti*tilesAcross + tj);
+	mImpulses.push_back(impulse);
+}
+
+void Waves::ApplyDisturbances()
+{
+	if (mImpulses.empty())
+	{
+		return;
+	}
+
+	// Stable, so impulses within a tile keep their queue order and the result
+	// does not depend on the sort implementation.
+	std::stable_sort(mImpulses.begin(), mImpulses.end(),
+		[](const WaveImpulse& a, const WaveImpulse& b) { return a.Tile < b.Tile; });
+
+	for (const WaveImpulse& impulse : mImpulses)
+	{
+		StampImpulse(impulse);
+	}
+
+	mImpulses.clear();
+}
+
+void Waves::StampImpulse(const WaveImpulse& impulse)
+{
+	const float r = impulse.Radius;
+
+	// Footprint clipped to the interior; boundary cells stay zero.
+	const float i0 = std::max(std::ceil(impulse.Row - r), 1.0f);
+	const float i1 = std::min(std::floor(impulse.Row + r), float(mNumRows - 2));
+	const float j0 = std::max(std::ceil(impulse.Col - r), 1.0f);
+	const float j1 = std::min(std::floor(impulse.Col + r), float(mNumCols - 2));
+
+	if (i0 > i1 || j0 > j1)
+	{
+		return;
+	}
+
+	const WaveBrush& brush = mBrushes[impulse.Brush];
+	const float invR2 = 1.0f / (r*r);
+
+	for (size_t i = size_t(i0); i <= size_t(i1); ++i)
+	{
+		const float di = float(i) - impulse.Row;
+		float* row = mCurrSolution + i*mRowStride;
+
+		for (size_t j = size_t(j0); j <= size_t(j1); ++j)
+		{
+			const float dj = float(j) - impulse.Col;
+			const float u = (di*di + dj*dj)*invR2;
+			if (u < 1.0f)
+			{
+				row[j] += impulse.Magnitude*brush.Weight(u);
+			}
+		}
+	}
+
+	WakeRect(size_t(i0), size_t(i1), size_t(j0), size_t(j1));
 }
-	
@@ -9,8 +9,43 @@
 #ifndef WAVES_H
 #define WAVES_H
 
-#include <Windows.h>
-#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "WaveTypes.h"
+#include "WaveKernels.h"
+#include "WaveClock.h"
+#include "WaveBrush.h"
+
+class WaveThreadPool;
+class WaveAllocator;
+class WaveFileMapping;
+
+// Caller memory the solver writes its vertices into as it computes them, e.g.
+// a mapped vertex buffer.  Vertex i starts Stride bytes after vertex i-1 and
+// begins with its position as three floats (x, height, z).  If Payload is set,
+// PayloadSize bytes from it are copied right after every position, so a
+// constant attribute such as a colour is filled in the same pass.
+//
+// GradientX and GradientZ, when set, are separate arrays of VertexCount()
+// floats that receive the slope of the surface at every vertex: dh/dx along a
+// row and dh/dz across rows (z falls as the row index grows), by central
+// differences and one-sided at the edges.  The normal is
+// normalize(-dh/dx, 1, -dh/dz).  A step writes them as it sweeps, from rows
+// still in cache, so shading costs no extra pass over the grid.  Data may be
+// null when only the gradients are wanted.
+struct WaveOutputSink
+{
+	void* Data = nullptr;
+	size_t Stride = 0;
+
+	const void* Payload = nullptr;
+	size_t PayloadSize = 0;
+
+	float* GradientX = nullptr;
+	float* GradientZ = nullptr;
+};
 
 class Waves
 {
@@ -23,17 +58,202 @@ public:
 	size_t VertexCount()const;
 	size_t TriangleCount()const;
 
-	// Returns the solution at the ith grid point.
-	const DirectX::XMFLOAT3& operator[](int i)const { return mCurrSolution[i]; }
+	// Returns the solution at the ith grid point.  Only the heights are stored;
+	// x and z are rebuilt from the grid spacing.
+	DirectX::XMFLOAT3 operator[](int i)const;
+
+	// Returns the texture coordinate of the ith grid point.
+	DirectX::XMFLOAT2 GetTex(size_t i)const;
+
+	// Row-major height plane of the current solution.  Rows are RowStride()
+	// floats apart: at least ColumnCount(), padded to whole cache lines and
+	// away from multiples of 4KB.  The padding cells are always zero.
+	const float* Heights()const { return mCurrSolution; }
+	size_t RowStride()const { return mRowStride; }
+
+	// Height of the ith grid point, i = row*ColumnCount() + column.
+	float Height(size_t i)const { return mCurrSolution[(i / mNumCols)*mRowStride + i % mNumCols]; }
+
+	// Writes every vertex of a height plane laid out like this grid's (rows
+	// rowStride floats apart) to sink.  Reads nothing but the layout set by
+	// Init(), so another thread may call it while this grid steps.
+	void WriteVertices(const float* heights, size_t rowStride, const WaveOutputSink& sink)const;
+
+	// Writes only the vertices of rows [firstRow, lastRow) and columns
+	// [firstCol, lastCol) of such a plane, where the full write would put
+	// them; the rest of sink is left alone.  No gradients are written.
+	void WriteVertices(const float* heights, size_t rowStride, const WaveOutputSink& sink,
+		size_t firstRow, size_t lastRow, size_t firstCol, size_t lastCol)const;
 
-	//
-	const DirectX::XMFLOAT2& GetTex(size_t i) const { return mTex[i]; }
+	// Lowest and highest height of every block of blockRows x blockCols
+	// quads of such a plane, the vertices on its edges included, with the
+	// blocks cut as WaveLodMesh cuts its patches: block (r, c) goes to
+	// minOut[r*across + c] and maxOut[r*across + c], for
+	// across = (ColumnCount() - 2) / blockCols + 1 and
+	// (RowCount() - 2) / blockRows + 1 rows of blocks.
+	void HeightBounds(const float* heights, size_t rowStride, size_t blockRows, size_t blockCols,
+		float* minOut, float* maxOut)const;
+
+	// Memory for the height planes, from the next Init() on; nullptr selects
+	// DefaultWaveAllocator().  The allocator is not owned and must outlive
+	// the planes.  Init() keeps the current planes when they are big enough
+	// and come from the same allocator.
+	void SetAllocator(WaveAllocator* allocator);
+	WaveAllocator* Allocator()const { return mAllocator; }
 
 	void Init(size_t m, size_t n, float dx, float dt, float speed, float damping);
-	void Update(float dt);
+
+	// Writes the grid to a versioned binary checkpoint: size, spacing,
+	// simulation constants, clock and both height planes.  Queued
+	// disturbances are not saved.  The file is written beside path and
+	// renamed over it.  Returns false if it cannot be written.
+	bool Save(const char* path)const;
+
+	// Replaces the grid with a checkpoint written by Save().  The file is
+	// mapped copy-on-write and its planes are stepped in place, so loading
+	// costs no more than mapping it, whatever the grid size; a checkpoint
+	// written with a different plane layout is copied instead.  Settings
+	// (kernel, threads, blocking, tracking, brushes) are kept; with activity
+	// tracking on, every tile starts awake.  The file must not be modified in
+	// place until the next Init() or Load(); Save() over it is fine (except on
+	// Windows, where it fails while mapped).  Returns false, leaving the grid
+	// untouched, if the file is missing or is not a valid checkpoint.
+	bool Load(const char* path);
+
+	// Adds dt to this grid's clock and runs as many fixed time steps (the dt
+	// passed to Init) as it covers, up to the substep budget.  Whole steps over
+	// the budget are dropped; the fractional remainder carries to the next call.
+	WaveStepReport Update(float dt);
+
+	// As Update(), and also writes every vertex of the new solution to sink.
+	// The rows of the last step are written right after the stencil produces
+	// them, while they are still in cache, so no separate copy pass over the
+	// grid is needed.  Every vertex is written even if no step is due, which
+	// makes it safe to use with write-discard mappings.
+	WaveStepReport Update(float dt, const WaveOutputSink& sink);
+
+	// Most steps a single Update() may run.  Bounds the work per frame.
+	void SetMaxSubsteps(size_t steps);
+	size_t MaxSubsteps()const { return mClock.MaxSubsteps; }
+
+	// Time accumulated towards the next step, and the fixed step passed to Init().
+	float Accumulator()const { return mClock.Accumulator; }
+	float TimeStep()const { return mClock.TimeStep; }
+
+	// Distance between neighbouring grid points.
+	float SpatialStep()const { return mSpatialStep; }
+
+	// Advances the simulation by steps time steps, independent of the clock.
+	// Runs of up to the temporal block length are computed tile by tile: each
+	// tile and a halo of one row/column per step is copied to a scratch buffer
+	// that stays in cache while the tile advances every step of the run, so the
+	// full planes are streamed once per run instead of once per step.  Results
+	// are bit-identical to calling Update() once per step.
+	void Advance(size_t steps);
+	void Advance(size_t steps, const WaveOutputSink& sink);
+
+	// Temporal block length and tile size (in cells, halo excluded) used by Advance().
+	void SetTemporalBlocking(size_t blockSteps, size_t tileRows, size_t tileCols);
+
+	// Disturbing a cell wakes its activity tile (see SetActivityTracking()).
 	void Disturb(size_t i, size_t j, float magnitude);
 
+	// Registers a brush for QueueDisturbance() and returns its id.  Brush 0,
+	// always present, is WaveBrush::Gaussian().
+	size_t AddBrush(const WaveBrush& brush);
+
+	// Queues an impulse of the given brush centred at (row, col), in cells and
+	// not necessarily on a grid point.  Cells within radius (at least 1) of
+	// the centre get magnitude times the brush weight.  Cells outside the
+	// interior are clipped, so impulses may overlap or miss the grid.
+	// Impulses with any non-finite argument are ignored.
+	void QueueDisturbance(float row, float col, float radius, float magnitude, size_t brush = 0);
+	size_t QueuedDisturbanceCount()const { return mImpulses.size(); }
+
+	// Applies every queued impulse to the current solution and empties the
+	// queue.  The impulses are sorted by tile first, so the writes sweep the
+	// grid once instead of scattering.  Update() and Advance() call this
+	// before stepping.
+	void ApplyDisturbances();
+
+	// Splits the grid into tileSize x tileSize tiles and only updates awake
+	// tiles and their neighbours.  After each step a tile whose heights (in
+	// both planes) and whose four neighbours' heights are all below epsilon in
+	// magnitude is put to sleep: its cells are flushed to exactly zero, so
+	// skipping it is exact until a wave reaches it from an awake neighbour.
+	// The flush is the only approximation; epsilon bounds its size.  An
+	// epsilon of 0 (the default) disables tracking and updates every cell.
+	// While tracking, Advance() steps one at a time instead of in temporal
+	// blocks, and all tiles wake after a step run by a WaveBatch.
+	void SetActivityTracking(float epsilon, size_t tileSize = 32);
+	float ActivityEpsilon()const { return mActivityEpsilon; }
+
+	// Tiles awake after the last step, and tiles in the grid; both 0 when
+	// tracking is off.
+	size_t ActiveTileCount()const { return mActiveTileCount; }
+	size_t TileCount()const { return mTileAwake.size(); }
+
+	// Selects the stencil kernel used by Update().  The best kernel for this
+	// CPU is picked on construction; returns false if isa is not available.
+	bool SetKernel(WaveKernelIsa isa);
+	WaveKernelIsa Kernel()const { return mKernelIsa; }
+
+	// Number of threads Update() splits the interior rows over, including the
+	// calling thread.  The workers are created here, once; 1 (the default)
+	// updates serially and 0 uses every hardware thread.  Each cell is computed
+	// by the same kernel whatever band it falls in and nothing is reduced
+	// across bands, so the result is bit-identical to the serial update.
+	void SetThreadCount(size_t threads);
+	size_t ThreadCount()const;
+
 private:
+	friend class WaveBatch;
+
+	// Advances the clock by dt and returns how many steps are due, without running them.
+	WaveStepReport ConsumeTime(float dt);
+
+	// One step is BandCount() independent StepBand() calls followed by EndStep().
+	size_t BandCount()const;
+	void StepBand(size_t band, const WaveOutputSink* sink = nullptr);
+	void EndStep();
+
+	// sink, when not null, receives the rows the call produces.
+	void AdvanceTo(size_t steps, const WaveOutputSink* sink);
+	void StepRows(size_t firstRow, size_t lastRow, const WaveOutputSink* sink);
+	void Step(const WaveOutputSink* sink);
+	void AdvanceBlock(size_t steps, const WaveOutputSink* sink);
+	void AdvanceTile(size_t tile, size_t steps, const WaveOutputSink* sink);
+
+	// Activity tracking.
+	struct TileRect
+	{
+		size_t Row0, Row1;
+		size_t Col0, Col1;
+	};
+	TileRect ActivityTile(size_t tile)const;
+	void ResetActivityTiles(bool awake);
+	void WakeCell(size_t i, size_t j);
+	void StepSparse(const WaveOutputSink* sink);
+	void StepTileRow(size_t tileRow);
+
+	void SetLayout(size_t m, size_t n, float dx);
+	void ReleaseBlocks();
+	float* AllocateBlock(size_t bytes);
+
+	void StampImpulse(const WaveImpulse& impulse);
+	void WakeRect(size_t row0, size_t row1, size_t col0, size_t col1);
+
+	// Writes cells [firstCol, lastCol) of row i to sink; heights points at firstCol.
+	void EmitRow(const WaveOutputSink& sink, size_t i, size_t firstCol, size_t lastCol, const float* heights)const;
+
+	// Writes the gradients of row i of a plane (rows rowStride floats apart)
+	// to sink, if it wants them; rows i-1 and i+1 must be final.
+	void EmitGradientRow(const WaveOutputSink& sink, size_t i, const float* plane, size_t rowStride)const;
+
+	// Gradients of the rows next to band edges, which StepRows() cannot write
+	// because a neighbour belongs to another band.
+	void EmitGradientSeams(const WaveOutputSink& sink)const;
+
 	size_t mNumRows;
 	size_t mNumCols;
 
@@ -45,12 +265,63 @@ private:
 	float mK2;
 	float mK3;
 
-	float mTimeStep;
 	float mSpatialStep;
 
-	DirectX::XMFLOAT3* mPrevSolution;
-	DirectX::XMFLOAT3* mCurrSolution;
-	DirectX::XMFLOAT2* mTex;
+	// Fixed-step clock; its time step is the dt passed to Init().
+	WaveClock mClock;
+
+	// Grid extents used to rebuild x/z on demand.
+	float mHalfWidth;
+	float mHalfDepth;
+
+	// Height planes; the stencil only ever touches these.  Both live in
+	// mBlock, mPlaneStride floats apart, until temporal blocking swaps them
+	// with the planes in mNextBlock.
+	size_t mRowStride;
+	size_t mPlaneStride;
+	float* mPrevSolution;
+	float* mCurrSolution;
+
+	WaveKernelIsa mKernelIsa;
+	WaveRowKernel mKernel;
+
+	std::unique_ptr<WaveThreadPool> mThreadPool;
+
+	// Temporal blocking.  Tiles read the current planes and write these, which
+	// are swapped in once every tile has finished; allocated on first use.
+	size_t mBlockSteps;
+	size_t mTileRows;
+	size_t mTileCols;
+	float* mNextPrevSolution;
+	float* mNextCurrSolution;
+
+	// Activity tracking.  Sleeping tiles are all zero in both planes.
+	// mTileLoud flags tiles with a |height| of at least the epsilon after
+	// the last step; mTileStep flags the tiles the current step updates.
+	float mActivityEpsilon;
+	size_t mActivityTileSize;
+	size_t mTilesAcross;
+	size_t mTilesDown;
+	size_t mActiveTileCount;
+	std::vector<uint8_t> mTileAwake;
+	std::vector<uint8_t> mTileLoud;
+	std::vector<uint8_t> mTileStep;
+	std::vector<size_t> mStepTiles;
+	std::vector<size_t> mStepTileRows;
+
+	// Disturbance queue.
+	std::vector<WaveBrush> mBrushes;
+	std::vector<WaveImpulse> mImpulses;
+
+	// mAllocator serves the next Init(); mBlockAllocator owns the blocks,
+	// except mBlock while it lies in a checkpoint mapping.
+	std::unique_ptr<WaveFileMapping> mMapping;
+	WaveAllocator* mAllocator;
+	WaveAllocator* mBlockAllocator;
+	float* mBlock;
+	size_t mBlockBytes;
+	float* mNextBlock;
+	size_t mNextBlockBytes;
 };
 
 #endif // WAVES_H
\ No newline at end of file